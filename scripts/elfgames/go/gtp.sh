@@ -9,7 +9,8 @@
 MODEL=$1
 shift
 
-game=elfgames.go.game model=df_pred model_file=elfgames.go.df_model3 python3 df_console.py --mode online --keys_in_reply V rv \
+# BOARD_SIZE=9 runs the 9x9 engine (see src_py/elfgames/go/engine.py).
+board_size=$BOARD_SIZE game=elfgames.go.game model=df_pred model_file=elfgames.go.df_model3 python3 df_console.py --mode online --keys_in_reply V rv \
     --use_mcts --mcts_verbose_time --mcts_use_prior --mcts_persistent_tree --load $MODEL \
     --server_addr localhost --port 1234 \
     --replace_prefix resnet.module,resnet \
@@ -14,7 +14,8 @@ echo $ADDR
 
 source ../../devmode_set_pythonpath.sh
 
-root=$ROOT/$ADDR game=elfgames.go.client model=df_pred model_file=elfgames.go.df_model3 python3 -u selfplay.py \
+# BOARD_SIZE=9 runs the 9x9 engine (see src_py/elfgames/go/engine.py).
+board_size=$BOARD_SIZE root=$ROOT/$ADDR game=elfgames.go.client model=df_pred model_file=elfgames.go.df_model3 python3 -u selfplay.py \
     --common.mode selfplay --selfplay_timeout_usec 10 --common.base.batchsize 128 --common.base.num_game_thread 32 --keys_in_reply V rv --common.net.port 2341 --common.net.server_addr $ADDR \
     --use_mcts --use_mcts_ai2 \
     --policy_distri_cutoff 30 \
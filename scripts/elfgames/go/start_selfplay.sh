@@ -30,7 +30,8 @@ shift
 DIM=224
 NUM_BLOCK=20
 
-game=elfgames.go.game model=df_pred model_file=elfgames.go.df_model3 python3 selfplay.py \
+# BOARD_SIZE=9 runs the 9x9 engine (see src_py/elfgames/go/engine.py).
+board_size=$BOARD_SIZE game=elfgames.go.game model=df_pred model_file=elfgames.go.df_model3 python3 selfplay.py \
     --mode selfplay --selfplay_timeout_usec 10 \
     --batchsize $BATCHSIZE --mcts_rollout_per_batch $BATCHSIZE \
     --num_games 1 --keys_in_reply V rv --port 2341 --server_id myserver \
@@ -6,7 +6,8 @@
 # This source code is licensed under the BSD-style license found in the
 # LICENSE file in the root directory of this source tree.
 
-save=./myserver game=elfgames.go.game model=df_kl model_file=elfgames.go.df_model3 \
+# BOARD_SIZE=9 runs the 9x9 engine (see src_py/elfgames/go/engine.py).
+board_size=$BOARD_SIZE save=./myserver game=elfgames.go.game model=df_kl model_file=elfgames.go.df_model3 \
     stdbuf -o 0 -e 0 python -u ./train.py \
     --mode train    --batchsize 2048 \
     --num_games 2048    --keys_in_reply V \
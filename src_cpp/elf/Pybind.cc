@@ -83,12 +83,25 @@ void register_common_func(pybind11::module& m) {
 
   py::class_<Size>(m, "Size").def("vec", &Size::vec, ref);
 
+  py::enum_<SharedMemOptions::BatchTarget>(m, "BatchTarget")
+      .value("FIXED", SharedMemOptions::FIXED)
+      .value("MAX_THROUGHPUT", SharedMemOptions::MAX_THROUGHPUT)
+      .value("LATENCY_SLO", SharedMemOptions::LATENCY_SLO)
+      .export_values();
+
   py::class_<SharedMemOptions>(m, "SharedMemOptions")
       .def(py::init<const std::string&, int>())
       .def("idx", &SharedMemOptions::getIdx)
       .def("batchsize", &SharedMemOptions::getBatchSize)
       .def("label", &SharedMemOptions::getLabel, ref)
-      .def("setTimeout", &SharedMemOptions::setTimeout);
+      .def("setTimeout", &SharedMemOptions::setTimeout)
+      .def("num_slot", &SharedMemOptions::getNumSlot)
+      .def("setNumSlot", &SharedMemOptions::setNumSlot)
+      .def(
+          "setBatchTarget",
+          &SharedMemOptions::setBatchTarget,
+          py::arg("target"),
+          py::arg("latency_slo_usec") = 0);
 
   py::class_<SharedMemData>(m, "SharedMemData")
       .def("__getitem__", &SharedMemData::get, ref)
@@ -202,7 +215,8 @@ void register_game(pybind11::module& m) {
       ;
 
   py::class_<GameContext, GCInterface>(m, "GameContext")
-      .def(py::init<const Options&>());
+      .def(py::init<const Options&>())
+      .def("batchStats", &GameContext::batchStats);
 
   py::class_<BatchSender, GameContext>(m, "BatchSender")
       .def(py::init<const Options&, elf::remote::Interface &>())
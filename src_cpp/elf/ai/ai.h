@@ -95,14 +95,16 @@ class AIClientT : public AI_T<S, A> {
   using BatchCtrl = typename AI_T<S, A>::BatchCtrl;
 
   AIClientT(elf::GameClientInterface* client, const std::vector<std::string>& targets)
-      : client_(client), targets_(targets) {}
+      : client_(client), targets_(targets), planS_(targets), planA_(targets) {}
 
   // Given the current state, perform action and send the action to _a;
   // Return false if this procedure fails.
   bool act(const S& s, A* a) override {
     auto binder = client_->getBinder();
-    elf::FuncsWithState funcs_s = binder.BindStateToFunctions(targets_, &s);
-    elf::FuncsWithState funcs_a = binder.BindStateToFunctions(targets_, a);
+    elf::FuncsWithState funcs_s =
+        elf::Binder::BindStateToPlan(planS_.get(binder), &s);
+    elf::FuncsWithState funcs_a =
+        elf::Binder::BindStateToPlan(planA_.get(binder), a);
     funcs_s.add(funcs_a);
 
     // return client_->sendWait(targets_, &funcs);
@@ -118,9 +120,9 @@ class AIClientT : public AI_T<S, A> {
     auto binder = client_->getBinder();
 
     std::vector<elf::FuncsWithState> funcs_s =
-        binder.BindStateToFunctions(targets_, batch_s);
+        elf::Binder::BindStateToPlan(planS_.get(binder), batch_s);
     std::vector<elf::FuncsWithState> funcs_a =
-        binder.BindStateToFunctions(targets_, batch_a);
+        elf::Binder::BindStateToPlan(planA_.get(binder), batch_a);
 
     // return client_->sendWait(targets_, &funcs);
     comm::ReplyStatus status;
@@ -164,6 +166,8 @@ class AIClientT : public AI_T<S, A> {
  private:
   elf::GameClientInterface* client_;
   std::vector<std::string> targets_;
+  elf::CachedPlanT<const S> planS_;
+  elf::CachedPlanT<A> planA_;
 };
 
 } // namespace ai
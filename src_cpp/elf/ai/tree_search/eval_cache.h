@@ -0,0 +1,225 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace elf {
+namespace ai {
+namespace tree_search {
+
+// Cache of evaluation results (e.g. neural network outputs), keyed by a
+// 64-bit hash of everything the evaluation depends on.
+//
+// The cache is split into kNumShard shards, each with its own mutex, and
+// holds at most capacity() entries. A full shard evicts with the clock
+// algorithm: every hit marks its slot, and the clock hand clears marks until
+// it finds an unmarked slot to reuse.
+//
+// Each entry is tagged with the model version that produced it. Inserting an
+// entry of a newer version makes all older entries stale, so a model update
+// invalidates the cache without a sweep.
+template <typename Entry>
+class EvalCacheT {
+ public:
+  static constexpr size_t kNumShard = 64;
+
+  // One cache per entry type, shared by all games of the process.
+  static EvalCacheT& get() {
+    static EvalCacheT* cache = new EvalCacheT();
+    return *cache;
+  }
+
+  EvalCacheT(size_t capacity = 0) {
+    setCapacity(capacity);
+  }
+
+  EvalCacheT(const EvalCacheT&) = delete;
+  EvalCacheT& operator=(const EvalCacheT&) = delete;
+
+  // 0 disables the cache. Shrinking drops the existing entries.
+  void setCapacity(size_t capacity) {
+    size_t per_shard = (capacity + kNumShard - 1) / kNumShard;
+    for (Shard& shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      if (per_shard < shard.slots.size()) {
+        shard.clear();
+      }
+      shard.capacity = per_shard;
+    }
+    capacity_ = per_shard * kNumShard;
+  }
+
+  size_t capacity() const {
+    return capacity_;
+  }
+
+  bool enabled() const {
+    return capacity_ > 0;
+  }
+
+  // A negative version accepts the newest version inserted so far.
+  bool lookup(uint64_t key, int64_t version, Entry* entry) {
+    if (version < 0) {
+      version = version_.load(std::memory_order_relaxed);
+    }
+    numLookup_.fetch_add(1, std::memory_order_relaxed);
+
+    Shard& shard = _shard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(key);
+    if (it == shard.index.end()) {
+      return false;
+    }
+    Slot& slot = shard.slots[it->second];
+    if (slot.version != version) {
+      numStale_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    slot.referenced = true;
+    *entry = slot.entry;
+    numHit_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  void insert(uint64_t key, int64_t version, const Entry& entry) {
+    int64_t v = version_.load(std::memory_order_relaxed);
+    while (v < version &&
+           !version_.compare_exchange_weak(v, version, std::memory_order_relaxed))
+      ;
+
+    Shard& shard = _shard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (shard.capacity == 0) {
+      return;
+    }
+    numInsert_.fetch_add(1, std::memory_order_relaxed);
+
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+      Slot& slot = shard.slots[it->second];
+      slot.version = version;
+      slot.entry = entry;
+      return;
+    }
+
+    size_t i;
+    if (shard.slots.size() < shard.capacity) {
+      i = shard.slots.size();
+      shard.slots.emplace_back();
+    } else {
+      i = shard.evict();
+      numEvict_.fetch_add(1, std::memory_order_relaxed);
+    }
+    Slot& slot = shard.slots[i];
+    slot.key = key;
+    slot.version = version;
+    slot.referenced = false;
+    slot.entry = entry;
+    shard.index[key] = i;
+  }
+
+  void clear() {
+    for (Shard& shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      shard.clear();
+    }
+  }
+
+  size_t size() const {
+    size_t n = 0;
+    for (const Shard& shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      n += shard.slots.size();
+    }
+    return n;
+  }
+
+  uint64_t numLookup() const {
+    return numLookup_.load(std::memory_order_relaxed);
+  }
+
+  uint64_t numHit() const {
+    return numHit_.load(std::memory_order_relaxed);
+  }
+
+  std::string info() const {
+    uint64_t num_lookup = numLookup();
+    uint64_t num_hit = numHit();
+    std::stringstream ss;
+    ss << "#Entries: " << size() << "/" << capacity_
+       << ", version: " << version_.load() << ", #Lookups: " << num_lookup
+       << ", #Hits: " << num_hit << " ("
+       << (num_lookup > 0 ? 100.0 * num_hit / num_lookup : 0.0)
+       << "%), #Stale: " << numStale_.load() << ", #Inserts: "
+       << numInsert_.load() << ", #Evictions: " << numEvict_.load();
+    return ss.str();
+  }
+
+ private:
+  struct Slot {
+    uint64_t key = 0;
+    int64_t version = -1;
+    bool referenced = false;
+    Entry entry;
+  };
+
+  struct alignas(64) Shard {
+    mutable std::mutex mutex;
+    std::vector<Slot> slots;
+    std::unordered_map<uint64_t, size_t> index;
+    size_t hand = 0;
+    size_t capacity = 0;
+
+    // Free a slot of a full shard. Returns its index.
+    size_t evict() {
+      while (slots[hand].referenced) {
+        slots[hand].referenced = false;
+        hand = (hand + 1) % slots.size();
+      }
+      size_t i = hand;
+      hand = (hand + 1) % slots.size();
+      index.erase(slots[i].key);
+      return i;
+    }
+
+    void clear() {
+      slots.clear();
+      index.clear();
+      hand = 0;
+    }
+  };
+
+  Shard shards_[kNumShard];
+  std::atomic<size_t> capacity_{0};
+  std::atomic<int64_t> version_{-1};
+
+  std::atomic<uint64_t> numLookup_{0};
+  std::atomic<uint64_t> numHit_{0};
+  std::atomic<uint64_t> numStale_{0};
+  std::atomic<uint64_t> numInsert_{0};
+  std::atomic<uint64_t> numEvict_{0};
+
+  Shard& _shard(uint64_t key) {
+    // Zobrist keys are uniform, but mix anyway so that any key works.
+    return shards_[((key * 0x9E3779B97F4A7C15ULL) >> 32) % kNumShard];
+  }
+};
+
+} // namespace tree_search
+} // namespace ai
+} // namespace elf
@@ -0,0 +1,125 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+#include "elf/ai/tree_search/eval_cache.h"
+
+using namespace elf::ai::tree_search;
+
+using Cache = EvalCacheT<int>;
+
+TEST(EvalCacheTest, testLookup) {
+  Cache cache(1000);
+  int v = 0;
+  EXPECT_FALSE(cache.lookup(1, 0, &v));
+
+  cache.insert(1, 0, 10);
+  cache.insert(2, 0, 20);
+  EXPECT_TRUE(cache.lookup(1, 0, &v));
+  EXPECT_EQ(v, 10);
+  EXPECT_TRUE(cache.lookup(2, -1, &v));
+  EXPECT_EQ(v, 20);
+
+  cache.insert(1, 0, 11);
+  EXPECT_TRUE(cache.lookup(1, 0, &v));
+  EXPECT_EQ(v, 11);
+  EXPECT_EQ(cache.size(), 2u);
+  EXPECT_EQ(cache.numLookup(), 4u);
+  EXPECT_EQ(cache.numHit(), 3u);
+}
+
+// A newer model makes the older entries stale.
+TEST(EvalCacheTest, testVersion) {
+  Cache cache(1000);
+  int v = 0;
+  cache.insert(1, 3, 10);
+  EXPECT_TRUE(cache.lookup(1, 3, &v));
+  EXPECT_FALSE(cache.lookup(1, 2, &v));
+
+  cache.insert(2, 4, 20);
+  EXPECT_FALSE(cache.lookup(1, -1, &v));
+  EXPECT_TRUE(cache.lookup(2, -1, &v));
+  // Explicitly asking for the old version still works.
+  EXPECT_TRUE(cache.lookup(1, 3, &v));
+
+  cache.insert(1, 4, 11);
+  EXPECT_TRUE(cache.lookup(1, -1, &v));
+  EXPECT_EQ(v, 11);
+}
+
+// Entries that keep being hit survive, the others are evicted.
+TEST(EvalCacheTest, testEviction) {
+  const int kCapacity = Cache::kNumShard * 64;
+  const int kNumHot = 16;
+  Cache cache(kCapacity);
+  int v = 0;
+
+  // A quarter of the capacity, so that no shard is full yet.
+  for (int i = 0; i < kCapacity / 4; ++i) {
+    cache.insert(i, 0, i);
+  }
+  for (int round = 1; round <= 20; ++round) {
+    for (int i = 0; i < kNumHot; ++i) {
+      EXPECT_TRUE(cache.lookup(i, 0, &v))
+          << "round " << round << ", key " << i;
+    }
+    for (int i = 0; i < kCapacity / 4; ++i) {
+      cache.insert(round * 100000 + i, 0, i);
+    }
+  }
+
+  EXPECT_LE(cache.size(), (size_t)kCapacity);
+  int num_cold = 0;
+  for (int i = kNumHot; i < kCapacity / 4; ++i) {
+    num_cold += cache.lookup(i, 0, &v);
+  }
+  EXPECT_EQ(num_cold, 0);
+}
+
+TEST(EvalCacheTest, testDisabled) {
+  Cache cache;
+  int v = 0;
+  EXPECT_FALSE(cache.enabled());
+  cache.insert(1, 0, 10);
+  EXPECT_FALSE(cache.lookup(1, 0, &v));
+  EXPECT_EQ(cache.size(), 0u);
+}
+
+TEST(EvalCacheTest, testConcurrent) {
+  Cache cache(10000);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; ++t) {
+    threads.emplace_back([&cache, t]() {
+      int v = 0;
+      for (int i = 0; i < 20000; ++i) {
+        uint64_t key = (i * 7 + t) % 30000;
+        if (cache.lookup(key, 0, &v)) {
+          EXPECT_EQ(v, (int)key);
+        } else {
+          cache.insert(key, 0, key);
+        }
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  EXPECT_LE(cache.size(), cache.capacity());
+  EXPECT_GT(cache.numHit(), 0u);
+  std::cout << cache.info() << std::endl;
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,431 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <unordered_set>
+#include <vector>
+
+#include "elf/ai/tree_search/tree_search_base.h"
+#include "elf/ai/tree_search/tree_search_options.h"
+#include "elf/concurrency/ParkingLot.h"
+
+namespace elf {
+namespace ai {
+namespace tree_search {
+
+// A game that is just a hash of its move sequence (or of the set of moves
+// played, if commutative). Every position has num_action moves with
+// pseudo-random priors and value, derived from the hash, so searches are
+// reproducible without a model.
+struct SyntheticState {
+  int depth = 0;
+  uint64_t hash = 1;
+
+  bool operator==(const SyntheticState& other) const {
+    return depth == other.depth && hash == other.hash;
+  }
+};
+
+struct SyntheticActorParams {
+  int num_action = 20;
+  int max_depth = 40;
+  // Busy time spent per evaluated state (model compute on this thread).
+  int eval_usec = 0;
+  // Idle time before a batch comes back (round trip to an inference server).
+  int latency_usec = 0;
+  uint64_t seed = 0;
+  // Move order does not matter: every permutation of a move sequence leads to
+  // the same state (many transpositions).
+  bool commutative = false;
+
+  std::string info() const {
+    std::stringstream ss;
+    ss << "[num_action=" << num_action << "][max_depth=" << max_depth
+       << "][eval_usec=" << eval_usec << "][latency_usec=" << latency_usec
+       << "][seed=" << seed << "][commutative=" << commutative << "]";
+    return ss.str();
+  }
+};
+
+// Brings the batches of all the SyntheticActors back on their deadline, on
+// one thread for the process (as a remote inference server would, without a
+// thread per actor).
+class SyntheticServer {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  static SyntheticServer& get() {
+    static SyntheticServer server;
+    return server;
+  }
+
+  // Call f (on the server thread) once deadline has passed.
+  void schedule(Clock::time_point deadline, std::function<void()> f) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      pending_.emplace(deadline, std::move(f));
+    }
+    cv_.notify_one();
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::multimap<Clock::time_point, std::function<void()>> pending_;
+  bool done_ = false;
+  std::thread thread_;
+
+  SyntheticServer() : thread_([this]() { _serve(); }) {}
+
+  ~SyntheticServer() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      done_ = true;
+    }
+    cv_.notify_one();
+    thread_.join();
+  }
+
+  void _serve() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!done_) {
+      if (pending_.empty()) {
+        cv_.wait(lock);
+        continue;
+      }
+      auto it = pending_.begin();
+      if (Clock::now() < it->first) {
+        cv_.wait_until(lock, it->first);
+        continue;
+      }
+      std::function<void()> f = std::move(it->second);
+      pending_.erase(it);
+      lock.unlock();
+      f();
+      lock.lock();
+    }
+  }
+};
+
+class SyntheticActor {
+ public:
+  using State = SyntheticState;
+  using Action = int;
+  using Info = void;
+  using NodeResponse = NodeResponseT<Action, Info>;
+  using Callback = std::function<void(size_t, NodeResponse&&)>;
+
+  SyntheticActor(const SyntheticActorParams& params)
+      : params_(params), rng_(params.seed) {}
+
+  std::mt19937* rng() {
+    return &rng_;
+  }
+
+  void setID(int) {}
+
+  bool forward(State& s, const Action& a) {
+    if (s.depth >= params_.max_depth) {
+      return false;
+    }
+    s.depth++;
+    if (params_.commutative) {
+      uint64_t h = (a + 1) * 0x9E3779B97F4A7C15ULL;
+      s.hash += h ^ (h >> 31);
+    } else {
+      s.hash = s.hash * 6364136223846793005ULL + a + 1442695040888963407ULL;
+    }
+    return true;
+  }
+
+  void evaluate(const State& s, NodeResponse* resp) {
+    if (params_.eval_usec > 0) {
+      auto end = std::chrono::steady_clock::now() +
+          std::chrono::microseconds(params_.eval_usec);
+      while (std::chrono::steady_clock::now() < end) {
+      }
+    }
+
+    std::mt19937 r(s.hash ^ (s.hash >> 32));
+    resp->pi.clear();
+    resp->value = (r() % 2001) / 1000.0 - 1.0;
+    resp->q_flip = s.depth % 2 == 1;
+
+    if (s.depth >= params_.max_depth) {
+      return;
+    }
+
+    std::vector<float> p(params_.num_action);
+    float sum = 0;
+    for (auto& v : p) {
+      v = (r() % 1000 + 10) / 1000.0;
+      sum += v;
+    }
+    resp->pi.reserve(params_.num_action);
+    for (int i = 0; i < params_.num_action; ++i) {
+      resp->pi.add(i, p[i] / sum);
+    }
+  }
+
+  void evaluate(const std::vector<const State*>& states, Callback callback) {
+    if (states.empty()) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(batches_->mutex);
+      batches_->maxInflight = std::max(
+          batches_->maxInflight,
+          batches_->numInflight + batches_->back.size() + 1);
+    }
+    std::this_thread::sleep_for(
+        std::chrono::microseconds(params_.latency_usec));
+    _reply(states, callback);
+  }
+
+  // The batch comes back latency_usec later (from SyntheticServer), and is
+  // evaluated in poll_evaluations().
+  void evaluate_async(
+      const std::vector<const State*>& states,
+      Callback callback) {
+    {
+      std::lock_guard<std::mutex> lock(batches_->mutex);
+      batches_->numInflight++;
+      batches_->maxInflight = std::max(
+          batches_->maxInflight,
+          batches_->numInflight + batches_->back.size());
+    }
+    // The actor may be gone when the batch comes back.
+    std::weak_ptr<_Batches> weak = batches_;
+    SyntheticServer::get().schedule(
+        SyntheticServer::Clock::now() +
+            std::chrono::microseconds(params_.latency_usec),
+        [weak, req = Request{states, callback}]() mutable {
+          std::shared_ptr<_Batches> b = weak.lock();
+          if (b == nullptr) {
+            return;
+          }
+          {
+            std::lock_guard<std::mutex> lock(b->mutex);
+            b->numInflight--;
+            b->back.push_back(std::move(req));
+          }
+          b->cv.notify_all();
+          elf::concurrency::ParkingLot::unpark(b.get());
+        });
+  }
+
+  // Evaluate the batches that came back. If block is true, wait for one if
+  // none has.
+  void poll_evaluations(bool block) {
+    std::deque<Request> back;
+    {
+      std::unique_lock<std::mutex> lock(batches_->mutex);
+      if (block) {
+        batches_->cv.wait(lock, [this]() {
+          return !batches_->back.empty() || batches_->numInflight == 0;
+        });
+      }
+      back.swap(batches_->back);
+    }
+    for (Request& req : back) {
+      _reply(req.states, req.callback);
+    }
+  }
+
+  // Most batches that were sent and not evaluated yet at once.
+  size_t maxInflight() {
+    std::lock_guard<std::mutex> lock(batches_->mutex);
+    return batches_->maxInflight;
+  }
+
+  // Call wake() once a batch has come back, or right away if one has.
+  void on_evaluations(std::function<void()> wake) {
+    elf::concurrency::ParkingLot::parkAsync(
+        batches_.get(),
+        [b = batches_]() {
+          std::lock_guard<std::mutex> lock(b->mutex);
+          return !b->back.empty();
+        },
+        std::move(wake));
+  }
+
+ private:
+  struct Request {
+    std::vector<const State*> states;
+    Callback callback;
+  };
+
+  // The batches sent and not evaluated yet: numInflight still with the
+  // server, back the ones that came back.
+  struct _Batches {
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t numInflight = 0;
+    std::deque<Request> back;
+    size_t maxInflight = 0;
+  };
+
+  SyntheticActorParams params_;
+  std::mt19937 rng_;
+  std::shared_ptr<_Batches> batches_ = std::make_shared<_Batches>();
+
+  void _reply(const std::vector<const State*>& states, Callback& callback) {
+    for (size_t i = 0; i < states.size(); ++i) {
+      NodeResponse resp;
+      evaluate(*states[i], &resp);
+      callback(i, std::move(resp));
+    }
+  }
+};
+
+// Options of the tests that search with SyntheticActor. Callers set the
+// features they test on top.
+inline TSOptions syntheticOptions(
+    int num_thread,
+    int num_rollout_per_thread,
+    int num_rollout_per_batch = 8) {
+  TSOptions options;
+  options.num_thread = num_thread;
+  options.num_rollout_per_thread = num_rollout_per_thread;
+  options.num_rollout_per_batch = num_rollout_per_batch;
+  options.virtual_loss = 1;
+  options.alg_opt.c_puct = 1.5;
+  return options;
+}
+
+// Actor factory for TreeSearchT: actor i gets params, seeded with
+// params.seed + i.
+inline std::function<SyntheticActor*(int)> syntheticActorGen(
+    const SyntheticActorParams& params) {
+  return [params](int i) {
+    SyntheticActorParams p = params;
+    p.seed += i;
+    return new SyntheticActor(p);
+  };
+}
+
+template <>
+struct StateTrait<SyntheticState, int> {
+ public:
+  static std::string to_string(const SyntheticState& s) {
+    return "depth: " + std::to_string(s.depth);
+  }
+
+  static bool equals(const SyntheticState& s1, const SyntheticState& s2) {
+    return s1 == s2;
+  }
+
+  static bool moves_since(
+      const SyntheticState&,
+      const SyntheticState&,
+      std::vector<int>*) {
+    return false;
+  }
+
+  static uint64_t hash(const SyntheticState& s) {
+    return s.hash ^ ((uint64_t)s.depth << 56);
+  }
+
+  // The depth is part of the state, so there is no cycle.
+  static bool transposes(const SyntheticState& s1, const SyntheticState& s2) {
+    return s1 == s2;
+  }
+};
+
+struct SearchGraphStats {
+  // Nodes that have been evaluated.
+  size_t num_evaluated = 0;
+  // Distinct states among them.
+  size_t num_distinct_state = 0;
+  // Nodes that keep their state.
+  size_t num_state = 0;
+};
+
+// Walk the graph of a settled search from the root, replaying the moves with
+// actor. Every kept state is the one its moves give, every node has as many
+// visits as its edges together, and no virtual loss is left. If
+// state_materialize_depth > 0, only the evaluated nodes at a depth multiple
+// of it keep their state.
+template <typename SearchTree>
+SearchGraphStats checkSearchGraph(
+    SearchTree& tree,
+    SyntheticActor& actor,
+    int state_materialize_depth = 0) {
+  using Node = typename SearchTree::Node;
+  auto& storage = tree.getStorage();
+  const Node* root = tree.getRootNode();
+  std::unordered_set<const Node*> visited;
+  std::unordered_set<uint64_t> states;
+  std::vector<std::tuple<const Node*, SyntheticState, int>> stack;
+  stack.emplace_back(root, *root->getStatePtr(), 0);
+  SearchGraphStats stats;
+
+  while (!stack.empty()) {
+    const Node* node;
+    SyntheticState s;
+    int depth;
+    std::tie(node, s, depth) = stack.back();
+    stack.pop_back();
+    if (!visited.insert(node).second) {
+      continue;
+    }
+
+    if (node->getStatePtr() != nullptr) {
+      stats.num_state++;
+      EXPECT_EQ(s, *node->getStatePtr());
+    }
+    if (node->isVisited()) {
+      stats.num_evaluated++;
+      states.insert(StateTrait<SyntheticState, int>::hash(s));
+      if (state_materialize_depth > 0) {
+        EXPECT_EQ(
+            node->getStatePtr() != nullptr,
+            depth % state_materialize_depth == 0)
+            << "depth " << depth;
+      }
+    }
+
+    const auto& pi = node->getStateActions().pi;
+    int edge_visits = 0;
+    for (size_t i = 0; i < pi.size(); ++i) {
+      auto e = pi.edge(i);
+      edge_visits += e.num_visits;
+      EXPECT_EQ(e.virtual_loss, 0);
+      const Node* child = storage[e.child_node];
+      if (child == nullptr) {
+        continue;
+      }
+      SyntheticState next = s;
+      EXPECT_TRUE(actor.forward(next, pi.action(i)));
+      stack.emplace_back(child, next, depth + 1);
+    }
+    EXPECT_EQ(edge_visits, node->getNumVisits());
+  }
+  stats.num_distinct_state = states.size();
+  return stats;
+}
+
+} // namespace tree_search
+} // namespace ai
+} // namespace elf
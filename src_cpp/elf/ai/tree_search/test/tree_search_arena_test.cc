@@ -0,0 +1,218 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "elf/ai/tree_search/test/synthetic_actor.h"
+#include "elf/ai/tree_search/tree_search.h"
+
+using namespace elf::ai::tree_search;
+
+using SearchTree = SearchTreeT<SyntheticState, int, void>;
+using Node = SearchTree::Node;
+using NodeResponse = NodeResponseT<int, void>;
+
+// Build a full tree of the given depth and fan-out. Leaves are left
+// unevaluated.
+template <typename Tree>
+static int
+expand(Tree& tree, typename Tree::Node* node, int depth, int fanout) {
+  int n = 1;
+  if (depth == 0) {
+    return n;
+  }
+
+  NodeResponse resp;
+  for (int i = 0; i < fanout; ++i) {
+    resp.pi.add(i, 1.0 / fanout);
+  }
+  node->setEvaluation(std::move(resp));
+
+  auto& storage = tree.getStorage();
+  for (int i = 0; i < fanout; ++i) {
+    NodeId child = node->followEdgeCreateIfNull(i, storage);
+    n += expand(tree, storage[child], depth - 1, fanout);
+  }
+  return n;
+}
+
+template <typename Tree>
+static void collect(
+    Tree& tree,
+    const typename Tree::Node* node,
+    std::set<NodeId>* ids) {
+  const auto& pi = node->getStateActions().pi;
+  for (size_t i = 0; i < pi.size(); ++i) {
+    NodeId child = pi.edge(i).child_node;
+    if (child != InvalidNodeId) {
+      EXPECT_TRUE(ids->insert(child).second);
+      collect(tree, tree.getStorage()[child], ids);
+    }
+  }
+}
+
+// Trees built one after the other, from several threads, reuse the nodes
+// released by the previous ones instead of growing the arena.
+TEST(TreeSearchArenaTest, testReuse) {
+  using Arena = NodeArenaT<Node>;
+  Arena& arena = Arena::get();
+
+  auto build = [](int rounds) {
+    for (int r = 0; r < rounds; ++r) {
+      SearchTree tree;
+      tree.resetTree(SyntheticState());
+      int n = expand(tree, tree.getRootNode(), 3, 8);
+      EXPECT_EQ(n, 1 + 8 + 64 + 512);
+
+      std::set<NodeId> ids;
+      collect(tree, tree.getRootNode(), &ids);
+      EXPECT_EQ((int)ids.size(), n - 1);
+    }
+  };
+
+  build(1);
+  const size_t num_node = arena.numNode();
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back(build, 20);
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  build(20);
+
+  // 4 trees alive at a time fit in the first chunk.
+  std::cout << arena.info() << std::endl;
+  EXPECT_EQ(num_node, Arena::kChunkSize);
+  EXPECT_EQ(arena.numNode(), Arena::kChunkSize);
+}
+
+// A state that counts its instances.
+struct CountedState {
+  static std::atomic<int> num_alive;
+
+  CountedState() {
+    num_alive++;
+  }
+  CountedState(const CountedState&) {
+    num_alive++;
+  }
+  ~CountedState() {
+    num_alive--;
+  }
+  bool operator==(const CountedState&) const {
+    return true;
+  }
+};
+
+std::atomic<int> CountedState::num_alive(0);
+
+// Released trees are freed by the reclaimer, without waiting for their nodes
+// to be allocated again.
+TEST(TreeSearchArenaTest, testBackgroundReclaim) {
+  using CountedTree = SearchTreeT<CountedState, int, void>;
+  using Arena = NodeArenaT<CountedTree::Node>;
+
+  int n = 0;
+  {
+    CountedTree tree;
+    tree.resetTree(CountedState());
+    n = expand(tree, tree.getRootNode(), 3, 8);
+
+    std::set<NodeId> ids;
+    collect(tree, tree.getRootNode(), &ids);
+    for (NodeId id : ids) {
+      tree.getStorage()[id]->setStateIfUnset(
+          []() { return new CountedState(); });
+    }
+    EXPECT_EQ(CountedState::num_alive, n);
+  }
+
+  Arena::get().waitReclaimed();
+  EXPECT_EQ(CountedState::num_alive, 0);
+  std::cout << Arena::get().info() << std::endl;
+}
+
+// A node with several parents is kept until the last of them is released.
+TEST(TreeSearchArenaTest, testSharedNode) {
+  using CountedTree = SearchTreeT<CountedState, int, void>;
+  using Arena = NodeArenaT<CountedTree::Node>;
+  using CountedResponse = NodeResponseT<int, void>;
+
+  CountedTree tree;
+  auto& storage = tree.getStorage();
+  auto evaluate = [](CountedTree::Node* node, int num_action) {
+    CountedResponse resp;
+    for (int i = 0; i < num_action; ++i) {
+      resp.pi.add(i, 1.0 / num_action);
+    }
+    node->setEvaluation(std::move(resp));
+  };
+  auto setState = [](CountedTree::Node* node) {
+    node->setStateIfUnset([]() { return new CountedState(); });
+  };
+
+  // root -> a -> c, root -> b -> c.
+  tree.resetTree(CountedState());
+  CountedTree::Node* root = tree.getRootNode();
+  evaluate(root, 2);
+  CountedTree::Node* a = storage[root->followEdgeCreateIfNull(0, storage)];
+  CountedTree::Node* b = storage[root->followEdgeCreateIfNull(1, storage)];
+  setState(a);
+  setState(b);
+  evaluate(a, 1);
+  evaluate(b, 1);
+  NodeId c = a->followEdgeCreateIfNull(0, storage);
+  setState(storage[c]);
+  EXPECT_EQ(b->followEdgeLinkIfNull(0, [&](int, float) {
+    storage[c]->addRef();
+    return c;
+  }), c);
+  EXPECT_EQ(CountedState::num_alive, 4);
+
+  // root and a go, b and c stay.
+  tree.treeAdvance({1}, CountedState());
+  tree.deleteOldRoot();
+  Arena::get().waitReclaimed();
+  EXPECT_EQ(CountedState::num_alive, 2);
+  EXPECT_EQ(tree.getRootNode(), b);
+
+  tree.treeAdvance({0}, CountedState());
+  tree.deleteOldRoot();
+  Arena::get().waitReclaimed();
+  EXPECT_EQ(CountedState::num_alive, 1);
+  EXPECT_EQ(tree.getRootNode(), storage[c]);
+}
+
+TEST(TreeSearchArenaTest, testBudget) {
+  using Arena = NodeArenaT<Node>;
+  Arena& arena = Arena::get();
+  const size_t num_node = arena.numNode();
+  arena.setMaxNumNode(num_node + 100);
+
+  // 1 + 300 + 300^2 nodes: more than the budget, even with all the free
+  // nodes of the arena reused.
+  SearchTree tree;
+  tree.resetTree(SyntheticState());
+  EXPECT_THROW(expand(tree, tree.getRootNode(), 2, 300), std::runtime_error);
+  EXPECT_LE(arena.numNode(), num_node + 100);
+
+  arena.setMaxNumNode(10000000);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,199 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Search throughput of TreeSearchT against SyntheticActor, over a sweep of
+// num_thread x num_rollout_per_batch x virtual_loss x num_outstanding_batch.
+// Prints one line per configuration and repetition, as JSON (default) or CSV:
+//
+//   bench_cpp_elf_tree_search --num_thread=1,2,4,8 --virtual_loss=0,1
+//       --latency_usec=500 --format=csv
+//
+// speedup is the throughput over the mean one with the first value of
+// num_outstanding_batch, e.g. that of pipelining one search thread:
+//
+//   bench_cpp_elf_tree_search --num_thread=1 --num_rollout_per_batch=8
+//       --virtual_loss=1 --latency_usec=5000 --num_outstanding_batch=1,4
+//
+// Run with --help for the flags and their defaults.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "elf/ai/tree_search/test/synthetic_actor.h"
+#include "elf/ai/tree_search/tree_search.h"
+
+using namespace elf::ai::tree_search;
+
+using TreeSearch = TreeSearchT<SyntheticState, int, SyntheticActor>;
+using Node = TreeSearch::Node;
+
+struct Flag {
+  std::string value;
+  std::string help;
+};
+
+static std::map<std::string, Flag> defaultFlags() {
+  return {
+      {"num_thread", {"1,2,4,8", "Search threads (list)"}},
+      {"num_rollout_per_batch", {"1,8", "Rollouts per batch (list)"}},
+      {"virtual_loss", {"0,1", "Virtual loss (list)"}},
+      {"num_rollout_per_thread", {"2000", "Rollouts per thread and search"}},
+      {"num_outstanding_batch", {"1", "Batches in flight per thread (list)"}},
+      {"num_action", {"20", "Moves per position"}},
+      {"max_depth", {"40", "Depth of the game"}},
+      {"eval_usec", {"0", "Busy time per evaluated state"}},
+      {"latency_usec", {"0", "Round trip of a batch"}},
+      {"c_puct", {"1.5", "Exploration constant"}},
+      {"num_repeat", {"3", "Searches per configuration"}},
+      {"format", {"json", "json or csv"}},
+  };
+}
+
+static std::vector<double> parseList(const std::string& s) {
+  std::vector<double> values;
+  std::stringstream ss(s);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    values.push_back(atof(item.c_str()));
+  }
+  return values;
+}
+
+// #Nodes below root (root excluded) that have been allocated.
+static size_t countNodes(TreeSearch::SearchTree& tree, const Node* root) {
+  auto& storage = tree.getStorage();
+  std::vector<const Node*> stack{root};
+  size_t n = 0;
+  while (!stack.empty()) {
+    const Node* node = stack.back();
+    stack.pop_back();
+    const auto& pi = node->getStateActions().pi;
+    for (size_t i = 0; i < pi.size(); ++i) {
+      const Node* child = storage[pi.edge(i).child_node];
+      if (child != nullptr) {
+        n++;
+        stack.push_back(child);
+      }
+    }
+  }
+  return n;
+}
+
+int main(int argc, char** argv) {
+  std::map<std::string, Flag> flags = defaultFlags();
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    size_t eq = arg.find('=');
+    if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos ||
+        flags.find(arg.substr(2, eq - 2)) == flags.end()) {
+      std::cout << "Usage: " << argv[0] << " [--flag=value ...]" << std::endl;
+      for (const auto& f : flags) {
+        std::cout << "  --" << f.first << " (" << f.second.value
+                  << "): " << f.second.help << std::endl;
+      }
+      return arg == "--help" ? 0 : 1;
+    }
+    flags[arg.substr(2, eq - 2)].value = arg.substr(eq + 1);
+  }
+
+  auto flag = [&flags](const std::string& key) {
+    return atof(flags[key].value.c_str());
+  };
+  const bool csv = flags["format"].value == "csv";
+  const int num_repeat = flag("num_repeat");
+
+  if (csv) {
+    std::cout << "num_thread,num_rollout_per_batch,virtual_loss,repeat,"
+              << "num_outstanding_batch,num_rollout,num_node,sec,"
+              << "rollouts_per_sec,nodes_per_sec,speedup,"
+              << "num_collision,num_idle,nsec_select,nsec_expand,nsec_wait,"
+              << "nsec_idle,nsec_backprop" << std::endl;
+  }
+
+  SyntheticActorParams params;
+  params.num_action = flag("num_action");
+  params.max_depth = flag("max_depth");
+  params.eval_usec = flag("eval_usec");
+  params.latency_usec = flag("latency_usec");
+
+  for (double num_thread : parseList(flags["num_thread"].value)) {
+    for (double batch : parseList(flags["num_rollout_per_batch"].value)) {
+      for (double virtual_loss : parseList(flags["virtual_loss"].value)) {
+        // Mean rollouts/sec with the first num_outstanding_batch.
+        double base_rollouts_per_sec = 0;
+        for (double outstanding :
+             parseList(flags["num_outstanding_batch"].value)) {
+          TSOptions options = syntheticOptions(
+              num_thread, flag("num_rollout_per_thread"), batch);
+          options.num_outstanding_batch = outstanding;
+          options.virtual_loss = virtual_loss;
+          options.alg_opt.c_puct = flag("c_puct");
+
+          std::vector<double> rollouts_per_sec;
+          for (int repeat = 0; repeat < num_repeat; ++repeat) {
+            params.seed = repeat * 1000;
+            TreeSearch ts(options, syntheticActorGen(params));
+            ts.getSearchTree().resetTree(SyntheticState());
+
+            CtrlOptions ctrl;
+            auto start = std::chrono::steady_clock::now();
+            ts.run(ctrl);
+            std::chrono::duration<double> dur =
+                std::chrono::steady_clock::now() - start;
+
+            SearchStats stats = ts.getStats();
+            size_t num_node = countNodes(
+                ts.getSearchTree(), ts.getSearchTree().getRootNode());
+            double sec = dur.count();
+            rollouts_per_sec.push_back(stats.num_rollout / sec);
+            double speedup = base_rollouts_per_sec > 0
+                ? rollouts_per_sec.back() / base_rollouts_per_sec
+                : 1.0;
+
+            if (csv) {
+              std::cout << num_thread << "," << batch << "," << virtual_loss
+                        << "," << repeat << "," << outstanding << ","
+                        << stats.num_rollout << "," << num_node << "," << sec
+                        << "," << rollouts_per_sec.back() << ","
+                        << num_node / sec << "," << speedup << ","
+                        << stats.num_collision << "," << stats.num_idle << ","
+                        << stats.nsec_select << "," << stats.nsec_expand
+                        << "," << stats.nsec_wait << "," << stats.nsec_idle
+                        << "," << stats.nsec_backprop << std::endl;
+            } else {
+              json j;
+              options.setJsonFields(j["options"]);
+              j["actor"] = params.info();
+              j["repeat"] = repeat;
+              j["num_node"] = num_node;
+              j["sec"] = sec;
+              j["rollouts_per_sec"] = rollouts_per_sec.back();
+              j["nodes_per_sec"] = num_node / sec;
+              j["speedup"] = speedup;
+              stats.setJsonFields(j["stats"]);
+              std::cout << j.dump() << std::endl;
+            }
+          }
+          if (base_rollouts_per_sec == 0) {
+            for (double r : rollouts_per_sec) {
+              base_rollouts_per_sec += r / rollouts_per_sec.size();
+            }
+          }
+        }
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,89 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <iostream>
+#include <vector>
+
+#include "elf/ai/tree_search/test/synthetic_actor.h"
+#include "elf/ai/tree_search/tree_search.h"
+
+using namespace elf::ai::tree_search;
+
+using TreeSearch = TreeSearchT<SyntheticState, int, SyntheticActor>;
+using SearchTree = TreeSearch::SearchTree;
+
+static TSOptions makeOptions(int num_thread, int state_materialize_depth) {
+  TSOptions options = syntheticOptions(num_thread, 2000);
+  options.state_materialize_depth = state_materialize_depth;
+  return options;
+}
+
+static SyntheticActorParams actorParams() {
+  SyntheticActorParams params;
+  params.num_action = 4;
+  return params;
+}
+
+// A single thread searches the same tree whether the states are kept or not,
+// with a fraction of the states.
+TEST(TreeSearchLazyStateTest, testSameSearch) {
+  std::vector<int> visits[2];
+  size_t num_state[2];
+  int depths[2] = {1, 3};
+
+  for (int k = 0; k < 2; ++k) {
+    TreeSearch ts(makeOptions(1, depths[k]), syntheticActorGen(actorParams()));
+    ts.getSearchTree().resetTree(SyntheticState());
+    CtrlOptions ctrl;
+    ts.run(ctrl);
+
+    num_state[k] =
+        checkSearchGraph(ts.getSearchTree(), ts.getActor(0), depths[k])
+            .num_state;
+    const auto& pi = ts.getSearchTree().getRootNode()->getStateActions().pi;
+    for (size_t i = 0; i < pi.size(); ++i) {
+      visits[k].push_back(pi.edge(i).num_visits);
+    }
+    std::cout << "Materialize depth: " << depths[k]
+              << ", #States: " << num_state[k] << std::endl;
+  }
+  EXPECT_EQ(visits[0], visits[1]);
+  EXPECT_LT(num_state[1] * 2, num_state[0]);
+}
+
+// Several threads and batches in flight share the rebuilt paths.
+TEST(TreeSearchLazyStateTest, testThreads) {
+  TSOptions options = makeOptions(4, 2);
+  options.num_outstanding_batch = 2;
+  options.persistent_tree = true;
+  TreeSearch ts(options, syntheticActorGen(actorParams()));
+  SearchTree& tree = ts.getSearchTree();
+  SyntheticActor& actor = ts.getActor(0);
+
+  SyntheticState s;
+  tree.resetTree(s);
+  CtrlOptions ctrl;
+  for (int move = 0; move < 5; ++move) {
+    ts.run(ctrl);
+    // Depths have changed since the nodes of the previous searches were
+    // created.
+    checkSearchGraph(tree, actor, move == 0 ? 2 : 0);
+    // The new root gets its state, whatever its depth.
+    int a = ts.chooseAction().best_action;
+    ASSERT_TRUE(actor.forward(s, a));
+    tree.treeAdvance({a}, s);
+  }
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
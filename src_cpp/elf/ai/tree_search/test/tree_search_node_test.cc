@@ -0,0 +1,109 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "elf/ai/tree_search/test/synthetic_actor.h"
+#include "elf/ai/tree_search/tree_search.h"
+
+using namespace elf::ai::tree_search;
+
+using SearchTree = SearchTreeT<SyntheticState, int, void>;
+using Node = SearchTree::Node;
+using NodeResponse = NodeResponseT<int, void>;
+
+// Threads waiting on a leaf wake up when, and only when, that leaf is
+// evaluated.
+TEST(TreeSearchNodeTest, testWaitEvaluation) {
+  SearchTree tree;
+  auto& storage = tree.getStorage();
+  NodeId id_a = storage.allocateNode(InvalidNodeId, 0, 0.0);
+  NodeId id_b = storage.allocateNode(InvalidNodeId, 0, 0.0);
+  Node* a = storage[id_a];
+  Node* b = storage[id_b];
+  ASSERT_TRUE(a->requestEvaluation());
+  ASSERT_TRUE(b->requestEvaluation());
+
+  std::atomic<int> num_a(0), num_b(0);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([&]() {
+      a->waitEvaluation();
+      num_a++;
+    });
+    threads.emplace_back([&]() {
+      b->waitEvaluation();
+      num_b++;
+    });
+  }
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_EQ(num_a, 0);
+  EXPECT_EQ(num_b, 0);
+
+  a->setEvaluation(NodeResponse());
+  while (num_a < 4) {
+    std::this_thread::yield();
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_EQ(num_b, 0);
+
+  b->setEvaluation(NodeResponse());
+  for (auto& t : threads) {
+    t.join();
+  }
+  EXPECT_EQ(num_b, 4);
+
+  // No wait once evaluated.
+  EXPECT_EQ(a->waitEvaluation(), 0u);
+  storage.releaseSubTree(id_a);
+  storage.releaseSubTree(id_b);
+}
+
+// The callbacks of a leaf run once it is evaluated, on the thread that
+// evaluates it, or right away once it has been.
+TEST(TreeSearchNodeTest, testOnEvaluated) {
+  SearchTree tree;
+  auto& storage = tree.getStorage();
+  NodeId id_a = storage.allocateNode(InvalidNodeId, 0, 0.0);
+  NodeId id_b = storage.allocateNode(InvalidNodeId, 0, 0.0);
+  Node* a = storage[id_a];
+  Node* b = storage[id_b];
+  ASSERT_TRUE(a->requestEvaluation());
+  ASSERT_TRUE(b->requestEvaluation());
+
+  int num_a = 0, num_b = 0;
+  for (int i = 0; i < 3; ++i) {
+    a->onEvaluated([&num_a]() { num_a++; });
+    b->onEvaluated([&num_b]() { num_b++; });
+  }
+  EXPECT_EQ(num_a, 0);
+
+  std::thread([a]() { a->setEvaluation(NodeResponse()); }).join();
+  EXPECT_EQ(num_a, 3);
+  EXPECT_EQ(num_b, 0);
+
+  a->onEvaluated([&num_a]() { num_a++; });
+  EXPECT_EQ(num_a, 4);
+
+  b->setEvaluation(NodeResponse());
+  EXPECT_EQ(num_b, 3);
+  storage.releaseSubTree(id_a);
+  storage.releaseSubTree(id_b);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,63 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "elf/ai/tree_search/tree_search_options.h"
+
+using namespace elf::ai::tree_search;
+
+// A peer that predates the pipelined and DAG search sends none of their
+// fields.
+TEST(TSOptionsTest, testLoadOlderMessage) {
+  TSOptions sent;
+  sent.num_thread = 4;
+  sent.num_outstanding_batch = 3;
+  sent.use_transposition = true;
+  sent.state_materialize_depth = 4;
+  json j;
+  sent.setJsonFields(j);
+  j.erase("num_outstanding_batch");
+  j.erase("use_transposition");
+  j.erase("state_materialize_depth");
+
+  TSOptions opt = TSOptions::createFromJson(j);
+  EXPECT_EQ(opt.num_thread, 4);
+  EXPECT_EQ(opt.num_outstanding_batch, 1);
+  EXPECT_FALSE(opt.use_transposition);
+  EXPECT_EQ(opt.state_materialize_depth, 1);
+}
+
+TEST(TSOptionsTest, testHostFieldsStayLocal) {
+  TSOptions sent;
+  sent.max_num_node = 100;
+  sent.use_search_pool = true;
+  sent.search_pool_size = 2;
+  json j;
+  sent.setJsonFields(j);
+  EXPECT_TRUE(j.find("max_num_node") == j.end());
+  EXPECT_TRUE(j.find("use_search_pool") == j.end());
+  EXPECT_TRUE(j.find("search_pool_size") == j.end());
+
+  TSOptions received = TSOptions::createFromJson(j);
+  EXPECT_TRUE(received == sent);
+
+  TSOptions local;
+  local.max_num_node = 5000;
+  local.search_pool_size = 8;
+  received.setHostFields(local);
+  EXPECT_EQ(received.max_num_node, 5000);
+  EXPECT_FALSE(received.use_search_pool);
+  EXPECT_EQ(received.search_pool_size, 8);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,226 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <dirent.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "elf/ai/tree_search/test/synthetic_actor.h"
+#include "elf/ai/tree_search/tree_search.h"
+#include "elf/concurrency/Fiber.h"
+#include "elf/concurrency/WorkStealingPool.h"
+
+using namespace elf::ai::tree_search;
+using elf::concurrency::FiberPool;
+using elf::concurrency::WorkStealingPool;
+
+using TreeSearch = TreeSearchT<SyntheticState, int, SyntheticActor>;
+using SearchTree = TreeSearch::SearchTree;
+
+const int kNumPoolThread = 4;
+
+static TSOptions poolOptions(
+    int num_thread,
+    int num_rollout_per_thread,
+    int num_rollout_per_batch) {
+  TSOptions options = syntheticOptions(
+      num_thread, num_rollout_per_thread, num_rollout_per_batch);
+  options.use_search_pool = true;
+  options.search_pool_size = kNumPoolThread;
+  return options;
+}
+
+static SyntheticActorParams actorParams(int num_action, int latency_usec) {
+  SyntheticActorParams params;
+  params.num_action = num_action;
+  params.latency_usec = latency_usec;
+  return params;
+}
+
+// Number of threads of the process.
+static int numProcessThread() {
+  DIR* dir = opendir("/proc/self/task");
+  if (dir == nullptr) {
+    return -1;
+  }
+  int n = 0;
+  while (dirent* entry = readdir(dir)) {
+    if (entry->d_name[0] != '.') {
+      n++;
+    }
+  }
+  closedir(dir);
+  return n;
+}
+
+// Every task runs once, including the ones submitted by tasks.
+TEST(TreeSearchPoolTest, testTasks) {
+  std::atomic<int> count(0);
+  {
+    WorkStealingPool pool(3);
+    for (int i = 0; i < 1000; ++i) {
+      pool.submit([&pool, &count]() {
+        count++;
+        for (int j = 0; j < 3; ++j) {
+          pool.submit([&count]() { count++; });
+        }
+      });
+    }
+    // The destructor runs all of them.
+  }
+  EXPECT_EQ(count.load(), 4000);
+}
+
+// Many games, each with its own tree and searches, share a few threads.
+TEST(TreeSearchPoolTest, testGames) {
+  const int kNumGame = 16;
+  const int kNumMove = 3;
+  TSOptions options = poolOptions(2, 200, 4);
+  options.persistent_tree = true;
+
+  std::vector<std::thread> games;
+  std::atomic<int> num_move(0);
+  for (int g = 0; g < kNumGame; ++g) {
+    games.emplace_back([&options, &num_move]() {
+      TreeSearch ts(options, syntheticActorGen(actorParams(8, 200)));
+      SearchTree& tree = ts.getSearchTree();
+      SyntheticActor& actor = ts.getActor(0);
+      SyntheticState s;
+      tree.resetTree(s);
+      CtrlOptions ctrl;
+
+      for (int move = 0; move < kNumMove; ++move) {
+        int a = ts.run(ctrl).best_action;
+        EXPECT_GE(
+            tree.getRootNode()->getNumVisits(),
+            options.num_thread * options.num_rollout_per_thread);
+        ASSERT_TRUE(actor.forward(s, a));
+        tree.treeAdvance({a}, s);
+        num_move++;
+      }
+    });
+  }
+  for (auto& g : games) {
+    g.join();
+  }
+
+  WorkStealingPool& pool = WorkStealingPool::get();
+  EXPECT_EQ(num_move.load(), kNumGame * kNumMove);
+  EXPECT_EQ(pool.numThread(), (size_t)kNumPoolThread);
+  std::cout << pool.info() << std::endl;
+}
+
+// More searches than threads, which often wait for the leaves of each
+// other and for the actor. They give their thread back to the pool meanwhile:
+// the leaves they wait for are evaluated by searches that need a thread too.
+TEST(TreeSearchPoolTest, testWaitingSearches) {
+  TSOptions options = poolOptions(4 * kNumPoolThread, 100, 8);
+
+  TreeSearch ts(options, syntheticActorGen(actorParams(2, 500)));
+  ts.getSearchTree().resetTree(SyntheticState());
+  CtrlOptions ctrl;
+  for (int i = 0; i < 3; ++i) {
+    ts.run(ctrl);
+    EXPECT_GE(
+        ts.getSearchTree().getRootNode()->getNumVisits(),
+        options.num_thread * options.num_rollout_per_thread);
+  }
+  EXPECT_EQ(WorkStealingPool::get().numThread(), (size_t)kNumPoolThread);
+}
+
+// The searches of all the games run on the threads of the pool: besides
+// them, each game only has its own thread (which waits for the search).
+TEST(TreeSearchPoolTest, testThreadsBounded) {
+  const int kNumGame = 8;
+  TSOptions options = poolOptions(4, 200, 4);
+  options.num_outstanding_batch = 2;
+  options.persistent_tree = true;
+
+  // Both start their threads once for the process.
+  WorkStealingPool::get(kNumPoolThread);
+  SyntheticServer::get();
+  int num_before = numProcessThread();
+  ASSERT_GT(num_before, 0);
+
+  std::vector<std::thread> games;
+  std::atomic<int> num_done(0);
+  for (int g = 0; g < kNumGame; ++g) {
+    games.emplace_back([&options, &num_done]() {
+      TreeSearch ts(options, syntheticActorGen(actorParams(8, 500)));
+      SearchTree& tree = ts.getSearchTree();
+      SyntheticActor& actor = ts.getActor(0);
+      SyntheticState s;
+      tree.resetTree(s);
+      CtrlOptions ctrl;
+
+      for (int move = 0; move < 3; ++move) {
+        int a = ts.run(ctrl).best_action;
+        ASSERT_TRUE(actor.forward(s, a));
+        tree.treeAdvance({a}, s);
+      }
+      num_done++;
+    });
+  }
+  int num_max = 0;
+  while (num_done < kNumGame) {
+    num_max = std::max(num_max, numProcessThread());
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  for (auto& g : games) {
+    g.join();
+  }
+
+  // With a thread per search, that would be kNumGame * (1 + num_thread).
+  EXPECT_LE(num_max, num_before + kNumGame);
+  EXPECT_EQ(WorkStealingPool::get().numThread(), (size_t)kNumPoolThread);
+}
+
+// Same, with the games in fibers on two threads: waiting for a search (or
+// for it to stop) only suspends the game.
+TEST(TreeSearchPoolTest, testGameFibers) {
+  const int kNumGame = 16;
+  const int kNumMove = 3;
+  TSOptions options = poolOptions(2, 100, 4);
+  options.persistent_tree = true;
+
+  std::atomic<int> num_move(0);
+  {
+    FiberPool pool(2);
+    for (int g = 0; g < kNumGame; ++g) {
+      pool.spawn([&options, &num_move]() {
+        TreeSearch ts(options, syntheticActorGen(actorParams(8, 200)));
+        SearchTree& tree = ts.getSearchTree();
+        SyntheticActor& actor = ts.getActor(0);
+        SyntheticState s;
+        tree.resetTree(s);
+        CtrlOptions ctrl;
+
+        for (int move = 0; move < kNumMove; ++move) {
+          int a = ts.run(ctrl).best_action;
+          EXPECT_GT(tree.getRootNode()->getNumVisits(), 0);
+          ASSERT_TRUE(actor.forward(s, a));
+          tree.treeAdvance({a}, s);
+          num_move++;
+        }
+      });
+    }
+  }
+  EXPECT_EQ(num_move.load(), kNumGame * kNumMove);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,99 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <iostream>
+
+#include "elf/ai/tree_search/test/synthetic_actor.h"
+#include "elf/ai/tree_search/tree_search.h"
+
+using namespace elf::ai::tree_search;
+
+using TreeSearch = TreeSearchT<SyntheticState, int, SyntheticActor>;
+
+// Rollouts per second on one tree as num_thread grows. With a cheap actor
+// this is dominated by selection and backprop, i.e. by contention on the
+// nodes near the root.
+TEST(TreeSearchSpeedTest, testThreadScaling) {
+  using namespace std::chrono;
+
+  const int kRolloutPerThread = 4000;
+
+  for (int num_thread : {1, 2, 4, 8, 16}) {
+    TreeSearch ts(
+        syntheticOptions(num_thread, kRolloutPerThread),
+        syntheticActorGen(SyntheticActorParams()));
+    ts.getSearchTree().resetTree(SyntheticState());
+
+    CtrlOptions ctrl;
+    auto start = high_resolution_clock::now();
+    ts.run(ctrl);
+    duration<double> dur = high_resolution_clock::now() - start;
+
+    // Search threads are idle now, so the statistics have settled: every
+    // backprop updated exactly one edge, and all virtual losses have been
+    // removed.
+    checkSearchGraph(ts.getSearchTree(), ts.getActor(0));
+    const auto* root = ts.getSearchTree().getRootNode();
+    EXPECT_GE(root->getNumVisits(), num_thread * kRolloutPerThread / 2);
+
+    // Every rollout reported by the threads went through the root.
+    SearchStats stats = ts.getStats();
+    EXPECT_GE(stats.num_rollout, (uint64_t)root->getNumVisits());
+    EXPECT_GT(stats.nsec_select, 0u);
+    EXPECT_GT(stats.nsec_backprop, 0u);
+
+    std::cout << "#Thread: " << num_thread
+              << ", #Rollouts: " << root->getNumVisits()
+              << ", Time spent: " << dur.count() << " seconds, Rollouts/sec: "
+              << root->getNumVisits() / dur.count() << std::endl;
+    std::cout << stats.info() << std::endl;
+  }
+}
+
+// One thread, with an actor whose replies take a while to come back. With a
+// single batch in flight the thread idles for each round trip; with several,
+// it keeps selecting leaves while earlier batches are being evaluated. The
+// speedup this gives is measured by tree_search_bench (--latency_usec=5000
+// --num_thread=1 --num_outstanding_batch=1,4).
+TEST(TreeSearchSpeedTest, testPipelining) {
+  const int kRollout = 1000;
+
+  for (int num_outstanding_batch : {1, 4}) {
+    TSOptions options = syntheticOptions(1, kRollout);
+    options.num_outstanding_batch = num_outstanding_batch;
+    SyntheticActorParams params;
+    params.latency_usec = 5000;
+    TreeSearch ts(options, syntheticActorGen(params));
+    ts.getSearchTree().resetTree(SyntheticState());
+
+    CtrlOptions ctrl;
+    ts.run(ctrl);
+
+    // All the batches came back before run() returned.
+    checkSearchGraph(ts.getSearchTree(), ts.getActor(0));
+    const auto* root = ts.getSearchTree().getRootNode();
+    EXPECT_GE(root->getNumVisits(), kRollout / 2);
+
+    // The thread sent a batch while as many as it may were in flight. Each
+    // round trip takes 5 msec, so it has had the time to fill all of them.
+    size_t max_inflight = ts.getActor(0).maxInflight();
+    EXPECT_EQ(max_inflight, (size_t)num_outstanding_batch);
+    std::cout << "#Outstanding batch: " << num_outstanding_batch
+              << ", #Rollouts: " << root->getNumVisits()
+              << ", Most batches in flight: " << max_inflight << std::endl;
+  }
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,151 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <iostream>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "elf/ai/tree_search/test/synthetic_actor.h"
+#include "elf/ai/tree_search/tree_search.h"
+
+using namespace elf::ai::tree_search;
+
+using TreeSearch = TreeSearchT<SyntheticState, int, SyntheticActor>;
+using SearchTree = TreeSearch::SearchTree;
+using Node = TreeSearch::Node;
+
+static TSOptions makeOptions(bool use_transposition) {
+  TSOptions options = syntheticOptions(2, 1000);
+  options.use_transposition = use_transposition;
+  return options;
+}
+
+static SyntheticActorParams actorParams() {
+  SyntheticActorParams params;
+  params.num_action = 8;
+  params.commutative = true;
+  return params;
+}
+
+// With transpositions merged, no state is evaluated twice, and the
+// statistics stay consistent.
+TEST(TreeSearchTranspositionTest, testDAG) {
+  for (bool use_transposition : {false, true}) {
+    TreeSearch ts(
+        makeOptions(use_transposition), syntheticActorGen(actorParams()));
+    ts.getSearchTree().resetTree(SyntheticState());
+    CtrlOptions ctrl;
+    ts.run(ctrl);
+
+    auto& storage = ts.getSearchTree().getStorage();
+    SearchGraphStats n = checkSearchGraph(ts.getSearchTree(), ts.getActor(0));
+    std::cout << "Transposition: " << use_transposition
+              << ", #Evaluated: " << n.num_evaluated
+              << ", #States: " << n.num_distinct_state << ", "
+              << storage.info() << std::endl;
+    if (use_transposition) {
+      EXPECT_GT(storage.numTransposition(), 0u);
+      EXPECT_EQ(n.num_evaluated, n.num_distinct_state);
+    } else {
+      EXPECT_EQ(storage.numTransposition(), 0u);
+      EXPECT_GT(n.num_evaluated, n.num_distinct_state);
+    }
+  }
+}
+
+// The edge of each parent of a shared node has the N and Q of the node,
+// including the visits through the other parents (which the edges of the
+// parents that link the node later would otherwise start without).
+TEST(TreeSearchTranspositionTest, testLinkedEdges) {
+  TreeSearch ts(makeOptions(true), syntheticActorGen(actorParams()));
+  SearchTree& tree = ts.getSearchTree();
+  tree.resetTree(SyntheticState());
+  CtrlOptions ctrl;
+  ts.run(ctrl);
+  auto& storage = tree.getStorage();
+
+  // The edges that lead to each node.
+  std::unordered_map<Node*, std::vector<std::pair<Node*, EdgeIdx>>> parents;
+  std::vector<Node*> stack = {tree.getRootNode()};
+  while (!stack.empty()) {
+    Node* node = stack.back();
+    stack.pop_back();
+    const auto& pi = node->getStateActions().pi;
+    for (size_t i = 0; i < pi.size(); ++i) {
+      Node* child = storage[pi.edge(i).child_node];
+      if (child == nullptr) {
+        continue;
+      }
+      auto& edges = parents[child];
+      if (edges.empty()) {
+        stack.push_back(child);
+      }
+      edges.emplace_back(node, i);
+    }
+  }
+
+  size_t num_linked = 0;
+  for (const auto& p : parents) {
+    const Node* child = p.first;
+    if (p.second.size() < 2 || child->getNumBackups() == 0) {
+      continue;
+    }
+    num_linked += p.second.size();
+    for (const auto& edge : p.second) {
+      edge.first->syncLinkedEdges(storage);
+      auto e = edge.first->getStateActions().pi.edge(edge.second);
+      EXPECT_EQ(e.num_visits, child->getNumBackups());
+      EXPECT_NEAR(
+          e.reward / e.num_visits,
+          child->getUnsignedBackupRewards() / child->getNumBackups(),
+          1e-4);
+    }
+  }
+  EXPECT_GT(num_linked, 0u);
+  checkSearchGraph(tree, ts.getActor(0));
+}
+
+// Moving the root down releases the nodes that are no longer reachable,
+// including parents of shared nodes, and keeps the others intact.
+TEST(TreeSearchTranspositionTest, testTreeAdvance) {
+  TSOptions options = makeOptions(true);
+  options.persistent_tree = true;
+  TreeSearch ts(options, syntheticActorGen(actorParams()));
+  SyntheticActor& actor = ts.getActor(0);
+  SearchTree& tree = ts.getSearchTree();
+
+  SyntheticState s;
+  tree.resetTree(s);
+  CtrlOptions ctrl;
+
+  for (int move = 0; move < 10; ++move) {
+    ts.run(ctrl);
+    checkSearchGraph(tree, actor);
+    // Follow the most visited edge.
+    int a = ts.chooseAction().best_action;
+    ASSERT_TRUE(actor.forward(s, a));
+    tree.treeAdvance({a}, s);
+  }
+  ts.run(ctrl);
+  size_t num_evaluated = checkSearchGraph(tree, actor).num_evaluated;
+
+  std::cout << tree.getStorage().info() << ", #Evaluated: " << num_evaluated
+            << std::endl;
+  tree.resetTree(SyntheticState());
+  ts.run(ctrl);
+  checkSearchGraph(tree, actor);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
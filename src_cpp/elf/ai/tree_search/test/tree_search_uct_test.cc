@@ -0,0 +1,136 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <string.h>
+
+#include <chrono>
+#include <iostream>
+#include <random>
+
+#include "elf/ai/tree_search/tree_search_edges.h"
+#include "elf/ai/tree_search/tree_search_uct.h"
+
+using namespace elf::ai::tree_search;
+
+using EdgeArray = EdgeArrayT<int>;
+
+static bool sameBits(float a, float b) {
+  return memcmp(&a, &b, sizeof(float)) == 0;
+}
+
+// Edges with few distinct priors and statistics, so that scores often tie.
+static EdgeArray makeEdges(size_t n, std::mt19937* rng) {
+  EdgeArray pi;
+  for (size_t i = 0; i < n; ++i) {
+    pi.add(i, ((*rng)() % 5 + 1) / 100.0f);
+  }
+  for (size_t i = 0; i < n; ++i) {
+    int visits = (*rng)() % 3 == 0 ? 0 : (*rng)() % 50;
+    pi.numVisits()[i] = visits;
+    pi.rewards()[i] = visits > 0 ? (int)((*rng)() % (2 * visits + 1)) - visits
+                                 : 0;
+    pi.virtualLosses()[i] = (*rng)() % 4 == 0 ? (*rng)() % 3 : 0;
+  }
+  return pi;
+}
+
+// The first edge with the highest score, as EdgeInfo::getScore() gives it.
+static EdgeIdx referenceBestEdge(
+    const EdgeArray& pi,
+    float c_puct,
+    bool flip_q_sign,
+    int total_parent_visits,
+    float unsigned_default_q) {
+  EdgeIdx best = InvalidEdgeIdx;
+  float max_score = std::numeric_limits<float>::lowest();
+  for (size_t i = 0; i < pi.size(); ++i) {
+    Score s = pi.edge(i).getScore(
+        flip_q_sign, total_parent_visits, unsigned_default_q);
+    float score = c_puct > 0 ? s.prior_probability * c_puct + s.q : s.q;
+    if (score > max_score) {
+      max_score = score;
+      best = i;
+    }
+  }
+  return best;
+}
+
+// select() (vectorized if the build allows) matches the scalar path bit for
+// bit, on every array size around the vector widths.
+TEST(TreeSearchUCTTest, testSameAsScalar) {
+  std::mt19937 rng(0);
+  for (size_t n = 0; n < 400; n += (n < 40 ? 1 : 13)) {
+    for (int trial = 0; trial < 8; ++trial) {
+      EdgeArray pi = makeEdges(n, &rng);
+      float c_puct = trial % 4 == 3 ? 0.0f : 1.5f;
+      bool flip_q_sign = trial % 2;
+      int total_parent_visits = rng() % 1000 + 1;
+      float unsigned_default_q = (int)(rng() % 201 - 100) / 100.0f;
+
+      UCTKernel kernel(
+          c_puct, flip_q_sign, total_parent_visits, unsigned_default_q);
+      UCTSelection v = kernel.select(
+          pi.priors(), pi.rewards(), pi.numVisits(), pi.virtualLosses(), n);
+      UCTSelection s = kernel.selectScalar(
+          pi.priors(), pi.rewards(), pi.numVisits(), pi.virtualLosses(), n);
+
+      ASSERT_EQ(v.best_edge, s.best_edge) << "n = " << n;
+      ASSERT_TRUE(sameBits(v.max_score, s.max_score)) << "n = " << n;
+      ASSERT_TRUE(sameBits(v.total_unsigned_q, s.total_unsigned_q))
+          << "n = " << n;
+      ASSERT_EQ(v.total_visits, s.total_visits) << "n = " << n;
+      EXPECT_EQ(
+          s.best_edge,
+          referenceBestEdge(
+              pi, c_puct, flip_q_sign, total_parent_visits, unsigned_default_q))
+          << "n = " << n;
+    }
+  }
+}
+
+TEST(TreeSearchUCTTest, testSpeed) {
+  const size_t n = 362;
+  const int num_iter = 100000;
+  std::mt19937 rng(1);
+  EdgeArray pi = makeEdges(n, &rng);
+  UCTKernel kernel(1.5, false, 1000, 0.0);
+
+  int sum = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < num_iter; ++i) {
+    sum += kernel
+               .select(
+                   pi.priors(), pi.rewards(), pi.numVisits(),
+                   pi.virtualLosses(), n)
+               .best_edge;
+  }
+  auto mid = std::chrono::steady_clock::now();
+  for (int i = 0; i < num_iter; ++i) {
+    sum -= kernel
+               .selectScalar(
+                   pi.priors(), pi.rewards(), pi.numVisits(),
+                   pi.virtualLosses(), n)
+               .best_edge;
+  }
+  auto end = std::chrono::steady_clock::now();
+  EXPECT_EQ(sum, 0);
+
+  using ns = std::chrono::nanoseconds;
+  std::cout << "#Edges: " << n << ", select: "
+            << std::chrono::duration_cast<ns>(mid - start).count() / num_iter
+            << " ns, scalar: "
+            << std::chrono::duration_cast<ns>(end - mid).count() / num_iter
+            << " ns" << std::endl;
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
@@ -8,9 +8,13 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <fstream>
 #include <functional>
 #include <iostream>
+#include <list>
+#include <memory>
 #include <mutex>
 #include <random>
 #include <sstream>
@@ -24,6 +28,7 @@
 #include "elf/comm/primitive.h"
 #include "elf/concurrency/ConcurrentQueue.h"
 #include "elf/concurrency/Counter.h"
+#include "elf/concurrency/WorkStealingPool.h"
 #include "elf/utils/member_check.h"
 
 #include "tree_search_node.h"
@@ -40,6 +45,12 @@
  * s.pi(): return vector<pair<A, float>> for the candidate actions and its prob.
  * s.value(): return a float for the value of current state.
  *
+ * With num_outstanding_batch > 1, the actor may also provide
+ * a.evaluate_async(states, callback): submit a batch and return at once.
+ * a.poll_evaluations(bool block): run the callbacks of the batches that came
+ * back (waiting for at least one if block is true).
+ * Without them, the search evaluates one batch at a time.
+ *
  */
 
 namespace elf {
@@ -82,7 +93,8 @@ inline std::ostream& operator<<(std::ostream& oo, const MCTSSignal& signal) {
   return oo;
 }
 
-using SignalQ = elf::concurrency::ConcurrentQueue<MCTSSignal>;
+// Popped by whichever thread runs the search (see use_search_pool).
+using SignalQ = elf::concurrency::ConcurrentQueueMoodyCamelNoCheck<MCTSSignal>;
 using ReplyQ = elf::concurrency::ConcurrentQueue<MCTSReply>;
 
 struct MCTSThreadState {
@@ -94,6 +106,68 @@ struct MCTSThreadState {
 
 using StateQ = elf::concurrency::ConcurrentQueue<MCTSThreadState>;
 
+// Where the search threads spent their time since the root last changed.
+// The evaluation callbacks run inside the actor; their time counts as expand
+// and backprop, not as wait.
+struct SearchStats {
+  uint64_t num_rollout = 0;
+  // Rollouts whose leaf was already requested (by another thread, or by an
+  // earlier rollout of the batch), which only add virtual loss.
+  uint64_t num_collision = 0;
+  // Batches with no leaf to evaluate, after which the thread sleeps.
+  uint64_t num_idle = 0;
+
+  // Descending from the root, forward() included.
+  uint64_t nsec_select = 0;
+  // Setting the evaluations on the leaves.
+  uint64_t nsec_expand = 0;
+  // Waiting for the actor.
+  uint64_t nsec_wait = 0;
+  // Sleeping on a leaf another thread evaluates (see num_idle).
+  uint64_t nsec_idle = 0;
+  // Updating the edge statistics and removing the virtual losses.
+  uint64_t nsec_backprop = 0;
+
+  void add(const SearchStats& other) {
+    num_rollout += other.num_rollout;
+    num_collision += other.num_collision;
+    num_idle += other.num_idle;
+    nsec_select += other.nsec_select;
+    nsec_expand += other.nsec_expand;
+    nsec_wait += other.nsec_wait;
+    nsec_idle += other.nsec_idle;
+    nsec_backprop += other.nsec_backprop;
+  }
+
+  std::string info() const {
+    std::stringstream ss;
+    ss << "#Rollouts: " << num_rollout << ", #Collisions: " << num_collision
+       << ", #Idle: " << num_idle << ", select: " << nsec_select / 1e6
+       << " msec, expand: " << nsec_expand / 1e6
+       << " msec, wait: " << nsec_wait / 1e6
+       << " msec, idle: " << nsec_idle / 1e6
+       << " msec, backprop: " << nsec_backprop / 1e6 << " msec";
+    return ss.str();
+  }
+
+  void setJsonFields(json& j) const {
+    JSON_SAVE(j, num_rollout);
+    JSON_SAVE(j, num_collision);
+    JSON_SAVE(j, num_idle);
+    JSON_SAVE(j, nsec_select);
+    JSON_SAVE(j, nsec_expand);
+    JSON_SAVE(j, nsec_wait);
+    JSON_SAVE(j, nsec_idle);
+    JSON_SAVE(j, nsec_backprop);
+  }
+
+  static uint64_t nsecNow() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+};
+
 struct RunContext {
   int run_id;
   int idx;
@@ -125,6 +199,7 @@ class TreeSearchSingleThreadT {
   }
 
   void sendSignal(const MCTSSignal& signal) {
+    numSignal_++;
     input_q_.push(signal);
   }
 
@@ -136,94 +211,170 @@ class TreeSearchSingleThreadT {
 
   template <typename Actor>
   bool run(Actor& actor, SearchTree& search_tree, StateQ& ctrl) {
-    _set_ostream(actor);
-    bool wait_state = true;
-    int rollouts_curr_root = 0;
-    int rollouts_since_last_resume = 0;
-
-    Node* root = nullptr;
-
-    while (true) {
-      MCTSSignal signal = MCTS_CMD_INVALID;
-      if (input_q_.pop(&signal, std::chrono::seconds(0))) {
-        switch (signal) {
-          case MCTS_CMD_STOP:
-            return true;
-          case MCTS_CMD_RESUME:
-            rollouts_since_last_resume = 0;
-            wait_state = false;
-            break;
-          case MCTS_CMD_PAUSE:
-            wait_state = true;
-            break;
-          case MCTS_CMD_CHANGE_ROOT:
-          case MCTS_CMD_CHANGE_ROOT_AND_RESUME:
-            root = search_tree.getRootNode();
-            rollouts_curr_root = 0;
-            //std::cout << "[" << threadId_ << "] " 
-            //  << "Wait node spent: " << static_cast<float>(usec_wait_node_spent_) / 1e3 << " msec" 
-            //  << "Evaluation spent: " << static_cast<float>(usec_evaluation_) / 1e3 << " msec" << std::endl;
-            usec_wait_node_spent_ = 0;
-            usec_evaluation_ = 0;
-            if (signal == MCTS_CMD_CHANGE_ROOT_AND_RESUME) {
-              rollouts_since_last_resume = 0;
-              wait_state = false;
-            }
-            break;
-          default:
-            break;
-        }
-        reply_q_.push(MCTS_REPLY);
-      }
-
-      if (wait_state || root == nullptr) {
+    while (step(actor, search_tree, ctrl)) {
+      if (!searching()) {
         // std::cout << "[" << std::this_thread::get_id() << "] In wait state,
         // sleep for a while" << std::endl;
         std::this_thread::sleep_for(std::chrono::milliseconds(100));
-        continue;
       }
+    }
+    return true;
+  }
+
+  // Handle a pending signal, then run one batch of rollouts if searching.
+  // Returns false once stopped. All the state of the search lives here, so
+  // the steps may run on any thread, one at a time (see
+  // TSOptions::use_search_pool).
+  //
+  // On the search pool, a step does not wait for a leaf that another search
+  // evaluates, nor for an actor that evaluates asynchronously: it returns,
+  // and waitType() tells what the next step should wait for.
+  template <typename Actor>
+  bool step(Actor& actor, SearchTree& search_tree, StateQ& ctrl) {
+    if (!started_) {
+      _set_ostream(actor);
+      started_ = true;
+    }
+    waitType_ = WAIT_NONE;
+    waitLeaf_ = nullptr;
 
+    if (signal_ == MCTS_CMD_INVALID) {
+      input_q_.pop(&signal_, std::chrono::seconds(0));
+    }
+    if (signal_ != MCTS_CMD_INVALID) {
+      // Batches in flight point into the tree, which may change once we
+      // reply.
+      if (!drain_batches(actor)) {
+        return true;
+      }
+      MCTSSignal signal = signal_;
+      signal_ = MCTS_CMD_INVALID;
+      numSignal_--;
+
+      switch (signal) {
+        case MCTS_CMD_STOP:
+          // stop() waits for the reply before joining.
+          reply_q_.push(MCTS_REPLY);
+          return false;
+        case MCTS_CMD_RESUME:
+          rolloutsSinceLastResume_ = 0;
+          waitState_ = false;
+          break;
+        case MCTS_CMD_PAUSE:
+          waitState_ = true;
+          break;
+        case MCTS_CMD_CHANGE_ROOT:
+        case MCTS_CMD_CHANGE_ROOT_AND_RESUME:
+          root_ = search_tree.getRootNode();
+          rolloutsCurrRoot_ = 0;
+          //std::cout << "[" << threadId_ << "] " << getStats().info()
+          //          << std::endl;
+          stats_ = SearchStats();
+          if (signal == MCTS_CMD_CHANGE_ROOT_AND_RESUME) {
+            rolloutsSinceLastResume_ = 0;
+            waitState_ = false;
+          }
+          break;
+        default:
+          break;
+      }
+      reply_q_.push(MCTS_REPLY);
+    }
+
+    if (!searching()) {
+      return true;
+    }
+
+    if (!enough_rollouts()) {
       // Start from the root and run one path
       int num_rollout = batch_rollouts<Actor>(
-          RunContext(threadId_, rollouts_curr_root, options_.num_rollout_per_thread),
-          root,
+          RunContext(
+              threadId_, rolloutsCurrRoot_, options_.num_rollout_per_thread),
+          root_,
           actor,
           search_tree);
 
-      if (num_rollout == 0) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
-      }
-
       // std::cout << "#rollout: " << num_rollout << std::endl;
-      rollouts_curr_root += num_rollout;
-      rollouts_since_last_resume += num_rollout;
+      rolloutsCurrRoot_ += num_rollout;
+      rolloutsSinceLastResume_ += num_rollout;
+    }
 
-      MCTSThreadState state;
-      state.thread_id = threadId_;
-      state.num_rollout_curr_root = rollouts_curr_root;
-      state.num_rollout_since_last_resume = rollouts_since_last_resume;
-      const int max_rollouts = 1e6;
-      const int min_rollouts = 1e2;
-      if (((options_.num_rollout_per_thread > 0 &&
-          rollouts_curr_root >= options_.num_rollout_per_thread) ||
-          rollouts_curr_root >= max_rollouts) && 
-          rollouts_curr_root >= min_rollouts) {
-        state.done = true;
-        wait_state = true;
+    MCTSThreadState state;
+    state.thread_id = threadId_;
+    if (enough_rollouts()) {
+      // Done: the batches in flight land before we report.
+      if (!drain_batches(actor)) {
+        return true;
       }
-      ctrl.push(state);
+      waitType_ = WAIT_NONE;
+      waitLeaf_ = nullptr;
+      state.done = true;
+      waitState_ = true;
     }
+    state.num_rollout_curr_root = rolloutsCurrRoot_;
+    state.num_rollout_since_last_resume = rolloutsSinceLastResume_;
+    ctrl.push(state);
+    return true;
+  }
+
+  bool searching() const {
+    return !waitState_ && root_ != nullptr;
+  }
+
+  // Some signal has not been handled by step() yet.
+  bool hasSignal() const {
+    return numSignal_ > 0;
+  }
+
+  // What the last step() left to wait for, on the search pool.
+  enum WaitType {
+    WAIT_NONE = 0,
+    // The evaluation of waitLeaf(), by another search.
+    WAIT_LEAF,
+    // Some batch in flight to come back from the actor.
+    WAIT_ACTOR,
+  };
+
+  WaitType waitType() const {
+    return waitType_;
+  }
+
+  Node* waitLeaf() const {
+    return waitLeaf_;
+  }
+
+  // Only meaningful while the thread does not search.
+  SearchStats getStats() const {
+    SearchStats stats = stats_;
+    stats.num_rollout = rolloutsCurrRoot_;
+    return stats;
   }
 
  private:
   int threadId_;
   const TSOptions& options_;
-  uint64_t usec_wait_node_spent_ = 0;
-  uint64_t usec_evaluation_ = 0;
+  SearchStats stats_;
+
+  bool started_ = false;
+  bool waitState_ = true;
+  int rolloutsCurrRoot_ = 0;
+  int rolloutsSinceLastResume_ = 0;
+  Node* root_ = nullptr;
+  std::atomic<int> numSignal_{0};
+  // Received, but not handled until the batches in flight have landed.
+  MCTSSignal signal_ = MCTS_CMD_INVALID;
+  WaitType waitType_ = WAIT_NONE;
+  Node* waitLeaf_ = nullptr;
 
   struct Traj {
-    std::vector<std::pair<Node*, Action>> traj;
+    std::vector<std::pair<Node*, EdgeIdx>> traj;
     Node* leaf;
+    // State of the leaf, if the leaf does not keep it (lazy materialization).
+    std::unique_ptr<State> state;
+
+    const State* leafState() const {
+      return state != nullptr ? state.get() : leaf->getStatePtr();
+    }
   };
 
   struct TrajCount {
@@ -243,6 +394,23 @@ class TreeSearchSingleThreadT {
     }
   };
 
+  // Rollouts sent to the actor together.
+  struct Batch {
+    std::vector<Traj> trajs;
+    std::vector<Node*> locked_leaves;
+    std::vector<const State*> locked_states;
+    TrajCount ours, others;
+    // A leaf that another thread is evaluating.
+    Node* pending_leaf = nullptr;
+    size_t num_evaluated = 0;
+  };
+
+  // Batches in flight (pipelined search only).
+  std::list<std::unique_ptr<Batch>> inflight_;
+
+  // Where the states of the nodes that are not materialized are rebuilt.
+  std::unique_ptr<State> scratch_;
+
   // TODO: The weird variable name below needs to change (ssengupta@fb)
   SignalQ input_q_;
   ReplyQ reply_q_;
@@ -252,15 +420,15 @@ class TreeSearchSingleThreadT {
   template <
       typename Actor,
       std::enable_if_t<has_func_reward<Actor>::value>* U = nullptr>
-  float get_reward(const Actor& actor, const Node* node) {
-    return actor.reward(*node->getStatePtr(), node->getValue());
+  float get_reward(const Actor& actor, const State& state, const Node* node) {
+    return actor.reward(state, node->getValue());
   }
 
   template <
       typename Actor,
       typename std::enable_if<!has_func_reward<Actor>::value>::type* U =
           nullptr>
-  float get_reward(const Actor& actor, const Node* node) {
+  float get_reward(const Actor& actor, const State&, const Node* node) {
     (void)actor;
     return node->getValue();
   }
@@ -298,6 +466,73 @@ class TreeSearchSingleThreadT {
     return next_node->setStateIfUnset(func);
   }
 
+  // With state_materialize_depth = k > 1, only the nodes at a depth multiple
+  // of k keep their state. The state of the others is rebuilt on scratch_ by
+  // replaying the moves from the nearest ancestor that keeps it, as we
+  // descend. A node shared by transposition always keeps its state.
+  bool lazy_state() const {
+    return options_.state_materialize_depth > 1 && !options_.use_transposition;
+  }
+
+  // *state is the state of the parent (its own or scratch_). On success, it
+  // becomes the state of next_node, at the given depth.
+  template <typename Actor>
+  bool forward_lazy(
+      int depth,
+      const State** state,
+      const Action& action,
+      Actor& actor,
+      Node* next_node) {
+    switch (next_node->getStateType()) {
+      case Node::NODE_STATE_SET:
+        *state = next_node->getStatePtr();
+        return true;
+      case Node::NODE_STATE_INVALID:
+        return false;
+      default:
+        break;
+    }
+
+    if (*state != scratch_.get()) {
+      scratch_.reset(new State(**state));
+      *state = scratch_.get();
+    }
+    if (!actor.forward(*scratch_, action)) {
+      next_node->setStateIfUnset([]() -> State* { return nullptr; });
+      return false;
+    }
+
+    if (depth % options_.state_materialize_depth == 0) {
+      next_node->setStateIfUnset([&]() { return new State(*scratch_); });
+      *state = next_node->getStatePtr();
+    }
+    return true;
+  }
+
+  // Expand the edge with the node of the resulting state, shared with any
+  // other path that leads to an equivalent state.
+  template <typename Actor>
+  NodeId follow_edge_transposed(
+      Node* node,
+      EdgeIdx edge,
+      Actor& actor,
+      SearchTree& search_tree) {
+    auto& storage = search_tree.getStorage();
+    return node->followEdgeLinkIfNull(
+        edge, [&](const Action& action, float unsigned_parent_q) {
+          std::unique_ptr<State> state(new State(*node->getStatePtr()));
+          if (!actor.forward(*state, action)) {
+            // Same as allocateState: the node is kept, without a state.
+            NodeId id =
+                storage.allocateNode(node->getId(), action, unsigned_parent_q);
+            storage[id]->setStateIfUnset([]() -> State* { return nullptr; });
+            return id;
+          }
+          return storage.findOrAllocateNode(
+              node->getId(), action, unsigned_parent_q, std::move(state));
+        });
+  }
+
   void printHelper(const RunContext& ctx, std::string str) {
     if (output_ != nullptr) {
       *output_ << "[run=" << ctx.run_id << "][iter=" << ctx.idx << "/"
@@ -312,80 +547,283 @@ class TreeSearchSingleThreadT {
       Node* root,
       Actor& actor,
       SearchTree& search_tree) {
+    // On the search pool, evaluate asynchronously (if the actor can), so that
+    // the step does not block.
+    if (options_.num_outstanding_batch > 1 || options_.use_search_pool) {
+      return pipelined_rollouts<Actor>(ctx, root, actor, search_tree);
+    }
+    return single_batch_rollouts<Actor>(ctx, root, actor, search_tree);
+  }
+
+  template <typename Actor>
+  int single_batch_rollouts(
+      const RunContext& ctx,
+      Node* root,
+      Actor& actor,
+      SearchTree& search_tree) {
     // Start from the root and run one path
-    std::vector<Traj> trajs;
-    for (int j = 0; j < options_.num_rollout_per_batch; ++j) {
-      trajs.push_back(single_rollout<Actor>(ctx, root, actor, search_tree));
+    Batch batch;
+    collect_batch<Actor>(ctx, root, actor, search_tree, &batch);
+
+    auto on_success = [&](size_t idx, NodeResponse &&resp) {
+      on_evaluated(actor, &batch, idx, std::move(resp));
+    };
+
+    // Batch evaluate.
+    wait_actor([&]() { actor.evaluate(batch.locked_states, on_success); });
+
+    finish_batch(&batch);
+    if (batch.locked_leaves.empty()) {
+      idle(batch.pending_leaf);
     }
+    printHelper(ctx, "Done backprop");
+    return batch.locked_leaves.size();
+  }
 
-    // Now we want to batch create nodes.
-    std::vector<Node*> locked_leaves;
-    std::vector<const State*> locked_states;
-    TrajCount ours, others;
+  // Pipelined search: keep num_outstanding_batch batches in flight, and
+  // select the next batch (under the virtual losses of the ones in flight)
+  // while the actor evaluates the previous ones.
+  MEMBER_FUNC_CHECK(evaluate_async)
+  template <
+      typename Actor,
+      typename std::enable_if<has_func_evaluate_async<Actor>::value>::type* U =
+          nullptr>
+  int pipelined_rollouts(
+      const RunContext& ctx,
+      Node* root,
+      Actor& actor,
+      SearchTree& search_tree) {
+    bool stalled = false;
+    while ((int)inflight_.size() < options_.num_outstanding_batch) {
+      std::unique_ptr<Batch> batch(new Batch);
+      collect_batch<Actor>(ctx, root, actor, search_tree, batch.get());
+      if (batch->locked_leaves.empty()) {
+        // Nothing new to evaluate until some batch comes back.
+        finish_batch(batch.get());
+        if (inflight_.empty()) {
+          idle(batch->pending_leaf);
+        }
+        stalled = true;
+        break;
+      }
+
+      Batch* b = batch.get();
+      inflight_.push_back(std::move(batch));
+      actor.evaluate_async(
+          b->locked_states, [this, &actor, b](size_t idx, NodeResponse&& resp) {
+            on_evaluated(actor, b, idx, std::move(resp));
+          });
+    }
+
+    if (inflight_.empty()) {
+      return 0;
+    }
+
+    // Block only if there is nothing else to do.
+    bool block = stalled ||
+        (int)inflight_.size() >= options_.num_outstanding_batch;
+    wait_actor([&]() {
+      actor.poll_evaluations(block && !options_.use_search_pool);
+    });
+
+    printHelper(ctx, "Done backprop");
+    int num_rollout = reap_batches();
+    if (block && options_.use_search_pool && num_rollout == 0) {
+      waitType_ = WAIT_ACTOR;
+    }
+    return num_rollout;
+  }
+
+  // Without evaluate_async, nothing can be in flight while the thread
+  // selects: one batch at a time.
+  template <
+      typename Actor,
+      typename std::enable_if<!has_func_evaluate_async<Actor>::value>::type*
+          U = nullptr>
+  int pipelined_rollouts(
+      const RunContext& ctx,
+      Node* root,
+      Actor& actor,
+      SearchTree& search_tree) {
+    return single_batch_rollouts<Actor>(ctx, root, actor, search_tree);
+  }
+
+  // Time f() as waiting for the actor, except for the callbacks it runs.
+  template <typename F>
+  void wait_actor(F f) {
+    uint64_t start = SearchStats::nsecNow();
+    uint64_t in_callbacks = stats_.nsec_expand + stats_.nsec_backprop;
+    f();
+    in_callbacks = stats_.nsec_expand + stats_.nsec_backprop - in_callbacks;
+    stats_.nsec_wait += SearchStats::nsecNow() - start - in_callbacks;
+  }
+
+  // Wait for all batches in flight, and count their rollouts. On the search
+  // pool, only reap the ones that have come back: returns false if some are
+  // left.
+  template <typename Actor>
+  bool drain_batches(Actor& actor) {
+    while (!inflight_.empty()) {
+      _poll_evaluations(actor, !options_.use_search_pool);
+      int num_rollout = reap_batches();
+      rolloutsCurrRoot_ += num_rollout;
+      rolloutsSinceLastResume_ += num_rollout;
+      if (options_.use_search_pool && !inflight_.empty()) {
+        waitType_ = WAIT_ACTOR;
+        return false;
+      }
+    }
+    return true;
+  }
+
+  template <
+      typename Actor,
+      typename std::enable_if<has_func_evaluate_async<Actor>::value>::type* U =
+          nullptr>
+  void _poll_evaluations(Actor& actor, bool block) {
+    wait_actor([&]() { actor.poll_evaluations(block); });
+  }
+
+  template <
+      typename Actor,
+      typename std::enable_if<!has_func_evaluate_async<Actor>::value>::type*
+          U = nullptr>
+  void _poll_evaluations(Actor&, bool) {}
+
+  bool enough_rollouts() const {
+    const int max_rollouts = 1e6;
+    const int min_rollouts = 1e2;
+    return ((options_.num_rollout_per_thread > 0 &&
+             rolloutsCurrRoot_ >= options_.num_rollout_per_thread) ||
+            rolloutsCurrRoot_ >= max_rollouts) &&
+        rolloutsCurrRoot_ >= min_rollouts;
+  }
+
+  // Retire the batches whose leaves have all been evaluated.
+  int reap_batches() {
+    int num_rollout = 0;
+    for (auto it = inflight_.begin(); it != inflight_.end();) {
+      Batch* b = it->get();
+      if (b->num_evaluated < b->locked_leaves.size()) {
+        ++it;
+        continue;
+      }
+      finish_batch(b);
+      num_rollout += b->locked_leaves.size();
+      it = inflight_.erase(it);
+    }
+    return num_rollout;
+  }
+
+  // Select a batch of leaves and lock the ones to evaluate.
+  template <typename Actor>
+  void collect_batch(
+      const RunContext& ctx,
+      Node* root,
+      Actor& actor,
+      SearchTree& search_tree,
+      Batch* batch) {
+    uint64_t start = SearchStats::nsecNow();
+    for (int j = 0; j < options_.num_rollout_per_batch; ++j) {
+      batch->trajs.push_back(
+          single_rollout<Actor>(ctx, root, actor, search_tree));
+    }
 
     // For unlocked leaves, just let it go
     // Reason:
     //   1. Other threads lock it
     //   2. Duplicated leaf.
-    int num_real_rollout = 0;
-    for (Traj& traj : trajs) {
+    for (Traj& traj : batch->trajs) {
       if (traj.leaf->requestEvaluation()) {
-        locked_leaves.push_back(traj.leaf);
-        locked_states.push_back(traj.leaf->getStatePtr());
-        ours.add(&traj);
-        num_real_rollout ++;
+        batch->locked_leaves.push_back(traj.leaf);
+        batch->locked_states.push_back(traj.leafState());
+        batch->ours.add(&traj);
       } else {
-        others.add(&traj);
+        batch->others.add(&traj);
+        stats_.num_collision++;
+        if (traj.leaf->status() == Node::EVAL_REQUESTED) {
+          batch->pending_leaf = traj.leaf;
+        }
       }
     }
+    stats_.nsec_select += SearchStats::nsecNow() - start;
+  }
 
-    auto backprop = [&](const std::pair<Traj *, int> &p) {
-      Node *leaf = p.first->leaf;
-      int count = p.second;
-
-      usec_wait_node_spent_ += leaf->waitEvaluation();
-      float reward = get_reward(actor, leaf);
-      
-      // std::cout << leaf->getStatePtr()->showBoard() << std::endl;
-      // std::cout << "value: " << reward << std::endl << std::endl;
-      // PRINT_TS("Reward: " << reward << " Start backprop");
-
-      // Add reward back.
-      for (const auto& pp : p.first->traj) {
-        pp.first->updateEdgeStats(
-            pp.second, reward, options_.virtual_loss * count);
+  // Now the node points to a recently created node.
+  // Evaluate it and backpropagate.
+  template <typename Actor>
+  void on_evaluated(
+      Actor& actor,
+      Batch* batch,
+      size_t idx,
+      NodeResponse&& resp) {
+    uint64_t start = SearchStats::nsecNow();
+    Node* leaf = batch->locked_leaves[idx];
+    leaf->setEvaluation(std::move(resp));
+    uint64_t expanded = SearchStats::nsecNow();
+    stats_.nsec_expand += expanded - start;
+
+    const auto& p = batch->ours.find(leaf);
+    int count = p.second;
+
+    float reward = get_reward(actor, *batch->locked_states[idx], leaf);
+
+    // std::cout << leaf->getStatePtr()->showBoard() << std::endl;
+    // std::cout << "value: " << reward << std::endl << std::endl;
+    // PRINT_TS("Reward: " << reward << " Start backprop");
+
+    // Add reward back.
+    const auto& traj = p.first->traj;
+    for (size_t i = 0; i < traj.size(); ++i) {
+      traj[i].first->updateEdgeStats(
+          traj[i].second, reward, options_.virtual_loss * count);
+      if (options_.use_transposition) {
+        // The child of the edge counts it too, see Node::syncLinkedEdges.
+        Node* child = i + 1 < traj.size() ? traj[i + 1].first : p.first->leaf;
+        if (child != traj[i].first) {
+          child->addBackup(reward);
+        }
       }
-    };
+    }
+    batch->num_evaluated++;
+    stats_.nsec_backprop += SearchStats::nsecNow() - expanded;
+  }
 
-    auto remove_virtual_loss = [&](const std::pair<Traj *, int> &p) {
-      int count = p.second;
+  void finish_batch(Batch* batch) {
+    uint64_t start = SearchStats::nsecNow();
+    for (const auto& p : batch->others.counts) {
+      int count = p.second.second;
 
-      for (const auto& pp : p.first->traj) {
+      for (const auto& pp : p.second.first->traj) {
         pp.first->addVirtualLoss(
             pp.second, -options_.virtual_loss * count);
       }
-    };
-
-    auto on_success = [&](size_t idx, NodeResponse &&resp) {
-      // Now the node points to a recently created node.
-      // Evaluate it and backpropagate.
-      Node *leaf = locked_leaves[idx];
-      leaf->setEvaluation(std::move(resp));
-
-      const auto& record = ours.find(leaf);
-      backprop(record);
-    };
-
-    // Batch evaluate.
-    auto start = elf_utils::usec_since_epoch_from_now();
-    actor.evaluate(locked_states, on_success);
-    usec_evaluation_ += elf_utils::usec_since_epoch_from_now() - start;
+    }
+    stats_.nsec_backprop += SearchStats::nsecNow() - start;
+  }
 
-    for (const auto &p : others.counts) {
-      remove_virtual_loss(p.second);
-    } 
-    printHelper(ctx, "Done backprop");
-    return num_real_rollout;
+  // Every rollout ended on a leaf we cannot expand. If another thread is
+  // evaluating one, sleep until it is done (the tree will look different
+  // then), instead of polling. On the search pool, a step never blocks: the
+  // next one waits for the leaf, or if there is none, runs after the tasks
+  // queued meanwhile.
+  void idle(Node* pending_leaf) {
+    if (options_.use_search_pool) {
+      if (pending_leaf != nullptr) {
+        waitType_ = WAIT_LEAF;
+        waitLeaf_ = pending_leaf;
+      }
+      stats_.num_idle++;
+      return;
+    }
+    uint64_t start = SearchStats::nsecNow();
+    if (pending_leaf != nullptr) {
+      pending_leaf->waitEvaluation();
+    } else {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    stats_.num_idle++;
+    stats_.nsec_idle += SearchStats::nsecNow() - start;
   }
 
   template <typename Actor>
@@ -395,11 +833,19 @@ class TreeSearchSingleThreadT {
       Actor& actor,
       SearchTree& search_tree) {
     Traj traj;
+    // The root always keeps its state.
+    const State* state = node->getStatePtr();
+    assert(state != nullptr);
+
     while (node->isVisited()) {
+      if (options_.use_transposition) {
+        node->syncLinkedEdges(search_tree.getStorage());
+      }
+
       // If there is no move available, skip.
-      Action action;
+      EdgeIdx edge;
       bool has_move =
-          node->findMove(options_.alg_opt, ctx.depth, &action, output_.get());
+          node->findMove(options_.alg_opt, ctx.depth, &edge, output_.get());
       if (!has_move) {
         printHelper(ctx, "No available action");
         break;
@@ -409,17 +855,16 @@ class TreeSearchSingleThreadT {
 
       // Add virtual loss if there is any.
       if (options_.virtual_loss > 0) {
-        node->addVirtualLoss(action, options_.virtual_loss);
+        node->addVirtualLoss(edge, options_.virtual_loss);
       }
 
       // Save trajectory.
-      traj.traj.push_back(std::make_pair(node, action));
-      NodeId next =
-          node->followEdgeCreateIfNull(action, search_tree.getStorage());
+      traj.traj.push_back(std::make_pair(node, edge));
+      NodeId next = options_.use_transposition
+          ? follow_edge_transposed(node, edge, actor, search_tree)
+          : node->followEdgeCreateIfNull(edge, search_tree.getStorage());
       // PRINT_TS(" Descent node id: " << next);
 
-      assert(node->getStatePtr());
-
       // Note that next might be invalid, if there is not valid move.
       Node* next_node = search_tree.getStorage()[next];
       if (next_node == nullptr) {
@@ -432,8 +877,16 @@ class TreeSearchSingleThreadT {
       // actor takes action with node's state. If this
       // action is valid, then next_node is set with the new state
       // Otherwise next_node's state is a nullptr
-      if (!allocateState(node, action, actor, next_node)) {
-        break;
+      if (lazy_state()) {
+        if (!forward_lazy(
+                ctx.depth + 1, &state, node->getAction(edge), actor, next_node)) {
+          break;
+        }
+      } else {
+        if (!allocateState(node, node->getAction(edge), actor, next_node)) {
+          break;
+        }
+        state = next_node->getStatePtr();
       }
 
       printHelper(ctx, "After forward");
@@ -444,6 +897,11 @@ class TreeSearchSingleThreadT {
       ctx.incDepth();
     }
     traj.leaf = node;
+    if (state == scratch_.get() && !node->isVisited()) {
+      // scratch_ is reused by the next rollout, but the leaf may wait in a
+      // batch for its evaluation.
+      traj.state.reset(new State(*state));
+    }
     return traj;
   }
 };
@@ -461,11 +919,31 @@ class TreeSearchT {
 
   TreeSearchT(const TSOptions& options, std::function<Actor*(int)> actor_gen)
       : options_(options) {
+    if (options_.use_search_pool && !has_func_evaluate_async<Actor>::value) {
+      std::cout << "The actor cannot evaluate asynchronously, the "
+                << options_.num_thread << " searches get their own threads"
+                << std::endl;
+      options_.use_search_pool = false;
+    }
+    SearchTreeStorageT<State, Action, Info>::setMaxNumNode(
+        options_.max_num_node);
+    searchTree_.getStorage().setUseTransposition(options_.use_transposition);
     for (int i = 0; i < options.num_thread; ++i) {
       treeSearches_.emplace_back(new TreeSearchSingleThread(i, options_));
       actors_.emplace_back(actor_gen(i));
     }
 
+    if (options_.use_search_pool) {
+      // The searches run as tasks when they get a signal, see wakeUp().
+      pool_ = &elf::concurrency::WorkStealingPool::get(
+          options_.search_pool_size);
+      wakeups_.reset(new std::atomic<int>[options.num_thread]);
+      for (int i = 0; i < options.num_thread; ++i) {
+        wakeups_[i] = 0;
+      }
+      return;
+    }
+
     // cout << "#Thread: " << options.num_threads << endl;
     for (int i = 0; i < options.num_thread; ++i) {
       TreeSearchSingleThread* th = treeSearches_[i].get();
@@ -491,6 +969,15 @@ class TreeSearchT {
     return searchTree_;
   }
 
+  // Summed over the threads, for the last search (call it after run()).
+  SearchStats getStats() const {
+    SearchStats stats;
+    for (const auto& th : treeSearches_) {
+      stats.add(th->getStats());
+    }
+    return stats;
+  }
+
   MCTSResult runPolicyOnly() {
     if (actors_.empty() || treeSearches_.empty()) {
       throw std::range_error(
@@ -515,10 +1002,16 @@ class TreeSearchT {
       root->getStateActionsMutable().enhanceExploration(
           options_.root_epsilon, options_.root_alpha, actors_[0]->rng());
     }
+    if (options_.use_transposition) {
+      // Releasing the old roots may sweep the transposition table, which
+      // no thread may search meanwhile.
+      sendSearchSignal(MCTS_CMD_PAUSE);
+      searchTree_.deleteOldRoot();
+    }
     sendSearchSignal(MCTS_CMD_CHANGE_ROOT_AND_RESUME);
     searchTree_.deleteOldRoot();
 
-    std::vector<std::pair<int, int>> num_rollouts(threadPool_.size());
+    std::vector<std::pair<int, int>> num_rollouts(treeSearches_.size());
     size_t num_done = 0;
     uint64_t overhead = 0;
     while (true) {
@@ -530,7 +1023,7 @@ class TreeSearchT {
 
       if (state.done) {
         num_done++;
-        if (num_done == threadPool_.size()) {
+        if (num_done == treeSearches_.size()) {
           break;
         }
       }
@@ -582,6 +1075,16 @@ class TreeSearchT {
   }
 
   void stop() {
+    if (pool_ != nullptr) {
+      if (!stopped_) {
+        sendSearchSignal(MCTS_CMD_STOP);
+        // A Counter, so that a game fiber only suspends itself here.
+        numTask_.wait([](int n) { return n == 0; });
+        stopped_ = true;
+      }
+      return;
+    }
+
     if (threadPool_.empty())
       return;
 
@@ -589,6 +1092,7 @@ class TreeSearchT {
     for (auto& p : threadPool_) {
       p.join();
     }
+    threadPool_.clear();
   }
 
   ~TreeSearchT() {
@@ -607,10 +1111,79 @@ class TreeSearchT {
   StateQ ctrl_q_;
   TSOptions options_;
 
+  // With use_search_pool: the number of wake-ups of each search since its
+  // task last went idle (> 0 while it is scheduled), and the number of
+  // scheduled searches.
+  elf::concurrency::WorkStealingPool* pool_ = nullptr;
+  std::unique_ptr<std::atomic<int>[]> wakeups_;
+  elf::concurrency::Counter<int> numTask_;
+  bool stopped_ = false;
+
+  void wakeUp(size_t i) {
+    if (wakeups_[i].fetch_add(1) == 0) {
+      numTask_.increment();
+      pool_->submit([this, i]() { runTask(i); });
+    }
+  }
+
+  // One step of search i. It stays scheduled while it is searching or has
+  // signals to handle, and goes idle otherwise (until the next wakeUp()).
+  // A step that waits for a leaf or for the actor gives its thread back to
+  // the pool, and the next one is submitted once that is ready.
+  void runTask(size_t i) {
+    int n = wakeups_[i].load();
+    TreeSearchSingleThread* th = treeSearches_[i].get();
+    if (th->step(*actors_[i], searchTree_, ctrl_q_)) {
+      auto next = [this, i]() { pool_->submit([this, i]() { runTask(i); }); };
+      switch (th->waitType()) {
+        case TreeSearchSingleThread::WAIT_LEAF:
+          th->waitLeaf()->onEvaluated(next);
+          return;
+        case TreeSearchSingleThread::WAIT_ACTOR:
+          _onEvaluations(*actors_[i], next);
+          return;
+        default:
+          break;
+      }
+      if (th->searching() || th->hasSignal() ||
+          wakeups_[i].fetch_sub(n) != n) {
+        next();
+        return;
+      }
+    }
+    numTask_.increment(-1);
+  }
+
+  // Only an actor with evaluate_async() keeps the pool free while it evaluates.
+  MEMBER_FUNC_CHECK(evaluate_async)
+
+  // Call f once the actor has a batch back, if it can tell (on_evaluations),
+  // otherwise right away: the next step then polls after the tasks queued
+  // meanwhile.
+  MEMBER_FUNC_CHECK(on_evaluations)
+  template <
+      typename A,
+      typename std::enable_if<has_func_on_evaluations<A>::value>::type* U =
+          nullptr>
+  static void _onEvaluations(A& actor, std::function<void()> f) {
+    actor.on_evaluations(std::move(f));
+  }
+
+  template <
+      typename A,
+      typename std::enable_if<!has_func_on_evaluations<A>::value>::type* U =
+          nullptr>
+  static void _onEvaluations(A&, std::function<void()> f) {
+    f();
+  }
+
   void sendSearchSignal(const MCTSSignal& signal) {
     // std::cout << "Sending signal: " << signal << std::endl;
     for (size_t i = 0; i < treeSearches_.size(); ++i) {
       treeSearches_[i]->sendSignal(signal);
+      if (pool_ != nullptr) {
+        wakeUp(i);
+      }
     }
     for (size_t i = 0; i < treeSearches_.size(); ++i) {
       treeSearches_[i]->waitSignalReceived();
@@ -0,0 +1,267 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "elf/ai/tree_search/tree_search_edgeinfo.h"
+
+namespace elf {
+namespace ai {
+namespace tree_search {
+
+// Process-wide storage for the nodes of every search tree of one node type.
+//
+// Nodes live in fixed-size chunks that are allocated on demand, up to a
+// node budget. A NodeId indexes the chunk table directly, so ids are global
+// and stay valid for the life of the process.
+//
+// Nodes are reference counted (see NodeT::addRef), so that a node may have
+// several parents. release() only queues the dropped reference. A reclaimer
+// thread drops it, and clears each node left without reference (state,
+// edges; see NodeT::Clear), which drops the references to its children in
+// turn. The cleared ids go to the shared free list kBatch at a time. Each
+// thread keeps its own list of free ids and trades them with the shared list
+// in batches, so allocation is a pop from a thread-local vector, and the arena
+// mutex is only taken once per kBatch allocations or releases.
+//
+// If the free list runs dry while subtrees are still queued, the allocating
+// thread reclaims one itself rather than growing the arena.
+template <typename Node>
+class NodeArenaT {
+ public:
+  static constexpr int kChunkBits = 16;
+  static constexpr size_t kChunkSize = size_t(1) << kChunkBits;
+  static constexpr size_t kMaxNumChunk = size_t(1) << 14;
+  static constexpr size_t kBatch = 256;
+
+  static NodeArenaT& get() {
+    // Never destroyed: threads may still hand back free lists at exit.
+    static NodeArenaT* arena = new NodeArenaT();
+    return *arena;
+  }
+
+  NodeArenaT(const NodeArenaT&) = delete;
+  NodeArenaT& operator=(const NodeArenaT&) = delete;
+
+  // Nodes already allocated are kept if the budget drops below them.
+  void setMaxNumNode(size_t max_num_node) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    maxNumNode_ = std::min(max_num_node, kChunkSize * kMaxNumChunk);
+  }
+
+  // Take a free node and initialize it with args.
+  template <typename... Args>
+  NodeId alloc(Args&&... args) {
+    std::vector<NodeId>& free_ids = _local().ids;
+    if (free_ids.empty()) {
+      _refill(&free_ids);
+    }
+    NodeId id = free_ids.back();
+    free_ids.pop_back();
+
+    _node(id)->Init(std::forward<Args>(args)...);
+    return id;
+  }
+
+  // Drop a reference to id. The nodes only reachable through it are
+  // reclaimed.
+  void release(NodeId id) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      pendingRoots_.push_back(id);
+    }
+    pendingCv_.notify_one();
+  }
+
+  // Block until every released reference has been dropped.
+  void waitReclaimed() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    freeCv_.wait(lock, [this]() {
+      return pendingRoots_.empty() && numReclaiming_ == 0;
+    });
+  }
+
+  Node* operator[](NodeId i) {
+    if (i == InvalidNodeId)
+      return nullptr;
+    return _node(i);
+  }
+
+  const Node* operator[](NodeId i) const {
+    return const_cast<NodeArenaT*>(this)->operator[](i);
+  }
+
+  // #Nodes allocated so far, free or not.
+  size_t numNode() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return numNode_;
+  }
+
+  std::string info() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::stringstream ss;
+    ss << "#Nodes: " << numNode_ << "/" << maxNumNode_
+       << ", #Chunks: " << numChunk_ << ", #Free: " << freeIds_.size()
+       << ", #Subtrees to reclaim: " << pendingRoots_.size() + numReclaiming_;
+    return ss.str();
+  }
+
+ private:
+  struct LocalFreeList {
+    std::vector<NodeId> ids;
+
+    ~LocalFreeList() {
+      NodeArenaT& arena = get();
+      std::lock_guard<std::mutex> lock(arena.mutex_);
+      _moveBack(&ids, &arena.freeIds_, ids.size());
+    }
+  };
+
+  mutable std::mutex mutex_;
+  std::unique_ptr<std::atomic<Node*>[]> chunks_;
+  size_t numChunk_ = 0;
+  size_t numNode_ = 0;
+  size_t maxNumNode_ = 10000000;
+
+  // Shared list of cleared nodes.
+  std::vector<NodeId> freeIds_;
+  std::condition_variable freeCv_;
+
+  // Released references not dropped yet.
+  std::vector<NodeId> pendingRoots_;
+  size_t numReclaiming_ = 0;
+  std::condition_variable pendingCv_;
+
+  NodeArenaT() : chunks_(new std::atomic<Node*>[kMaxNumChunk]) {
+    for (size_t i = 0; i < kMaxNumChunk; ++i) {
+      chunks_[i] = nullptr;
+    }
+    // Lives as long as the arena, i.e. the process.
+    std::thread([this]() { _reclaimLoop(); }).detach();
+  }
+
+  // i must be a valid id.
+  Node* _node(NodeId i) {
+    Node* chunk = chunks_[i >> kChunkBits].load(std::memory_order_acquire);
+    return &chunk[i & (kChunkSize - 1)];
+  }
+
+  static LocalFreeList& _local() {
+    static thread_local LocalFreeList local;
+    return local;
+  }
+
+  static void
+  _moveBack(std::vector<NodeId>* from, std::vector<NodeId>* to, size_t n) {
+    to->insert(to->end(), from->end() - n, from->end());
+    from->resize(from->size() - n);
+  }
+
+  void _refill(std::vector<NodeId>* free_ids) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (freeIds_.empty()) {
+      if (!pendingRoots_.empty()) {
+        // Help the reclaimer.
+        NodeId root = pendingRoots_.back();
+        pendingRoots_.pop_back();
+        numReclaiming_++;
+        lock.unlock();
+        _reclaim(root);
+        lock.lock();
+        numReclaiming_--;
+        freeCv_.notify_all();
+      } else if (numReclaiming_ > 0) {
+        // Nodes are on their way.
+        freeCv_.wait(lock);
+      } else {
+        _grow();
+      }
+    }
+    _moveBack(&freeIds_, free_ids, std::min(kBatch, freeIds_.size()));
+  }
+
+  void _reclaimLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      pendingCv_.wait(lock, [this]() { return !pendingRoots_.empty(); });
+      NodeId root = pendingRoots_.back();
+      pendingRoots_.pop_back();
+      numReclaiming_++;
+      lock.unlock();
+      _reclaim(root);
+      lock.lock();
+      numReclaiming_--;
+      freeCv_.notify_all();
+    }
+  }
+
+  // Drop a reference to id, clear the nodes left without reference and add
+  // them to the shared free list.
+  void _reclaim(NodeId id) {
+    std::vector<NodeId> stack{id};
+    std::vector<NodeId> cleared;
+    while (!stack.empty()) {
+      NodeId i = stack.back();
+      stack.pop_back();
+      if (!_node(i)->unref()) {
+        // Still reachable from another parent or tree.
+        continue;
+      }
+      _node(i)->Clear(&stack);
+      cleared.push_back(i);
+
+      if (cleared.size() == kBatch) {
+        _free(&cleared);
+      }
+    }
+    if (!cleared.empty()) {
+      _free(&cleared);
+    }
+  }
+
+  void _free(std::vector<NodeId>* cleared) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    _moveBack(cleared, &freeIds_, cleared->size());
+    freeCv_.notify_all();
+  }
+
+  void _grow() {
+    size_t n = numNode_ < maxNumNode_
+        ? std::min(kChunkSize, maxNumNode_ - numNode_)
+        : 0;
+    if (n == 0 || numChunk_ == kMaxNumChunk) {
+      throw std::runtime_error("Out of memory!!");
+    }
+
+    Node* chunk = new Node[n];
+    const NodeId base = NodeId(numChunk_) << kChunkBits;
+    // Pushed in reverse so that ids are handed out in increasing order.
+    for (size_t i = n; i-- > 0;) {
+      chunk[i].setId(base + i);
+      freeIds_.push_back(base + i);
+    }
+    chunks_[numChunk_].store(chunk, std::memory_order_release);
+    numChunk_++;
+    numNode_ += n;
+  }
+};
+
+} // namespace tree_search
+} // namespace ai
+} // namespace elf
@@ -22,6 +22,7 @@
 #include <nlohmann/json.hpp>
 
 #include "elf/ai/tree_search/tree_search_edgeinfo.h"
+#include "elf/ai/tree_search/tree_search_edges.h"
 #include "elf/utils/utils.h"
 
 using json = nlohmann::json;
@@ -32,18 +33,20 @@ namespace tree_search {
 
 template <typename Action>
 struct _NodeResponseT {
-  std::unordered_map<Action, EdgeInfo> pi;
+  EdgeArrayT<Action> pi;
   float value = 0.0;
   bool q_flip = false;
 
   void normalize() {
+    float* priors = pi.priors();
+    const size_t n = pi.size();
     float total_prob = 1e-10;
-    for (const auto& p : pi) {
-      total_prob += p.second.prior_probability;
+    for (size_t i = 0; i < n; ++i) {
+      total_prob += priors[i];
     }
 
-    for (auto& p : pi) {
-      p.second.prior_probability /= total_prob;
+    for (size_t i = 0; i < n; ++i) {
+      priors[i] /= total_prob;
     }
   }
 
@@ -70,11 +73,9 @@ struct _NodeResponseT {
       Z += etas[i];
     }
 
-    int i = 0;
-    for (auto& p : pi) {
-      p.second.prior_probability =
-          (1 - epsilon) * p.second.prior_probability + epsilon * etas[i] / Z;
-      i++;
+    float* priors = pi.priors();
+    for (size_t i = 0; i < pi.size(); ++i) {
+      priors[i] = (1 - epsilon) * priors[i] + epsilon * etas[i] / Z;
     }
   }
 
@@ -124,6 +125,18 @@ struct StateTrait {
     // By default it is not provided.
     return false;
   }
+
+  // Transposition table key (see TSOptions::use_transposition).
+  static uint64_t hash(const S& /*s*/) {
+    return 0;
+  }
+
+  // Whether a node reached as s1 can also stand for s2. Must never hold
+  // between a state and one of its successors, so that the search graph has
+  // no cycle. By default states are never shared.
+  static bool transposes(const S& /*s1*/, const S& /*s2*/) {
+    return false;
+  }
 };
 
 template <typename Action>
@@ -214,8 +227,9 @@ struct MCTSResultT {
       random_idx = rng() % resp.pi.size();
     }
 
-    int index = 0;
-    for (const std::pair<Action, EdgeInfo>& action_edge : resp.pi) {
+    for (size_t index = 0; index < resp.pi.size(); ++index) {
+      const std::pair<Action, EdgeInfo> action_edge(
+          resp.pi.action(index), resp.pi.edge(index));
       // float score = 0;
 
       float score = (action_rank_method == MOST_VISITED)
@@ -245,7 +259,7 @@ struct MCTSResultT {
 
       if (action_rank_method == UNIFORM_RANDOM) {
         // Choose random action
-        if (index == random_idx) {
+        if ((int)index == random_idx) {
           max_score = score;
           best_action = action_edge.first;
           best_edge_info = action_edge.second;
@@ -258,8 +272,6 @@ struct MCTSResultT {
           best_edge_info = action_edge.second;
         }
       }
-
-      index++;
     }
     root_value = resp.value;
   }
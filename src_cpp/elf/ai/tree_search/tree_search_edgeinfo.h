@@ -52,6 +52,25 @@ struct EdgeInfo {
       bool flip_q_sign,
       int total_parent_visits,
       float unsigned_default_q) const {
+    return computeScore(
+        prior_probability,
+        reward,
+        num_visits,
+        virtual_loss,
+        flip_q_sign,
+        total_parent_visits,
+        unsigned_default_q);
+  }
+
+  // Same as getScore(), on the individual fields (see EdgeArrayT).
+  static Score computeScore(
+      float prior_probability,
+      float reward,
+      int num_visits,
+      float virtual_loss,
+      bool flip_q_sign,
+      int total_parent_visits,
+      float unsigned_default_q) {
     float r = reward;
     if (flip_q_sign) {
       r = -r;
@@ -0,0 +1,328 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "elf/ai/tree_search/tree_search_edgeinfo.h"
+
+namespace elf {
+namespace ai {
+namespace tree_search {
+
+// Index of an edge in EdgeArrayT.
+using EdgeIdx = int;
+const EdgeIdx InvalidEdgeIdx = -1;
+
+// fetch_add for floats (std::atomic<float> only has it from C++20).
+inline void atomicAdd(std::atomic<float>* v, float delta) {
+  float old = v->load(std::memory_order_relaxed);
+  while (!v->compare_exchange_weak(
+      old, old + delta, std::memory_order_relaxed)) {
+  }
+}
+
+// Outgoing edges of a node, as a struct of arrays (actions, priors, rewards,
+// visit counts, virtual losses, child ids) that all live in one heap block.
+// Each array starts on a cache line, so a UCT sweep reads each field
+// sequentially and can be vectorized.
+//
+// Rewards, visit counts, virtual losses and child ids are atomics: search
+// threads update them without taking the node lock, and selection reads
+// them with relaxed ordering. A sweep may therefore see a rollout half
+// applied (e.g. the visit but not yet the reward), which only perturbs the
+// scores by one rollout.
+//
+// Edges are appended while the response is built, then sortByPrior() puts
+// them in decreasing prior order (the order selection looks at them) and
+// shrinks the block to fit. Indices stay valid until the array is cleared or
+// reassigned.
+template <typename Action>
+class EdgeArrayT {
+ public:
+  static_assert(
+      std::is_trivially_copyable<Action>::value,
+      "EdgeArrayT stores actions in raw memory");
+  static_assert(
+      std::atomic<float>::is_always_lock_free &&
+          std::atomic<int>::is_always_lock_free &&
+          std::atomic<NodeId>::is_always_lock_free,
+      "Edge statistics need lock-free atomics");
+
+  EdgeArrayT() {}
+
+  EdgeArrayT(const EdgeArrayT& other) {
+    _copyFrom(other);
+  }
+
+  EdgeArrayT(EdgeArrayT&& other) noexcept {
+    _swap(other);
+  }
+
+  EdgeArrayT& operator=(const EdgeArrayT& other) {
+    if (this != &other) {
+      _release();
+      _copyFrom(other);
+    }
+    return *this;
+  }
+
+  EdgeArrayT& operator=(EdgeArrayT&& other) noexcept {
+    if (this != &other) {
+      _release();
+      _swap(other);
+    }
+    return *this;
+  }
+
+  ~EdgeArrayT() {
+    _release();
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  // Drop all edges and free the block.
+  void clear() {
+    _release();
+  }
+
+  void reserve(size_t n) {
+    if (n > capacity_) {
+      _realloc(n);
+    }
+  }
+
+  // Append an unvisited edge.
+  void add(const Action& action, float prior) {
+    if (size_ == capacity_) {
+      _realloc(std::max<size_t>(8, capacity_ * 2));
+    }
+    actions_[size_] = action;
+    priors_[size_] = prior;
+    _setEdge(size_, 0, 0, 0, InvalidNodeId);
+    size_++;
+  }
+
+  // Sort edges by decreasing prior (stable), and shrink the block to fit.
+  void sortByPrior() {
+    if (size_ == 0) {
+      return;
+    }
+    static thread_local std::vector<EdgeIdx> order;
+    order.resize(size_);
+    for (size_t i = 0; i < size_; ++i) {
+      order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [this](EdgeIdx a, EdgeIdx b) {
+      return priors_[a] > priors_[b];
+    });
+
+    EdgeArrayT sorted;
+    sorted._realloc(size_);
+    for (size_t i = 0; i < size_; ++i) {
+      const EdgeIdx j = order[i];
+      sorted.actions_[i] = actions_[j];
+      sorted.priors_[i] = priors_[j];
+      sorted._setEdge(
+          i,
+          rewards_[j].load(std::memory_order_relaxed),
+          numVisits_[j].load(std::memory_order_relaxed),
+          virtualLosses_[j].load(std::memory_order_relaxed),
+          children_[j].load(std::memory_order_relaxed));
+    }
+    sorted.size_ = size_;
+    *this = std::move(sorted);
+  }
+
+  // Index of action, or InvalidEdgeIdx.
+  EdgeIdx find(const Action& action) const {
+    for (size_t i = 0; i < size_; ++i) {
+      if (actions_[i] == action) {
+        return i;
+      }
+    }
+    return InvalidEdgeIdx;
+  }
+
+  const Action& action(EdgeIdx i) const {
+    return actions_[i];
+  }
+
+  // A copy of edge i.
+  EdgeInfo edge(EdgeIdx i) const {
+    EdgeInfo info(priors_[i]);
+    info.child_node = children_[i].load(std::memory_order_relaxed);
+    info.reward = rewards_[i].load(std::memory_order_relaxed);
+    info.num_visits = numVisits_[i].load(std::memory_order_relaxed);
+    info.virtual_loss = virtualLosses_[i].load(std::memory_order_relaxed);
+    return info;
+  }
+
+  float* priors() {
+    return priors_;
+  }
+  const float* priors() const {
+    return priors_;
+  }
+  std::atomic<float>* rewards() {
+    return rewards_;
+  }
+  const std::atomic<float>* rewards() const {
+    return rewards_;
+  }
+  std::atomic<int>* numVisits() {
+    return numVisits_;
+  }
+  const std::atomic<int>* numVisits() const {
+    return numVisits_;
+  }
+  std::atomic<float>* virtualLosses() {
+    return virtualLosses_;
+  }
+  const std::atomic<float>* virtualLosses() const {
+    return virtualLosses_;
+  }
+  std::atomic<NodeId>* children() {
+    return children_;
+  }
+  const std::atomic<NodeId>* children() const {
+    return children_;
+  }
+
+ private:
+  static constexpr size_t kAlign = 64;
+
+  void* block_ = nullptr;
+  size_t size_ = 0;
+  size_t capacity_ = 0;
+
+  Action* actions_ = nullptr;
+  float* priors_ = nullptr;
+  std::atomic<float>* rewards_ = nullptr;
+  std::atomic<int>* numVisits_ = nullptr;
+  std::atomic<float>* virtualLosses_ = nullptr;
+  std::atomic<NodeId>* children_ = nullptr;
+
+  static size_t _roundUp(size_t n) {
+    return (n + kAlign - 1) / kAlign * kAlign;
+  }
+
+  // Allocate a block for n edges and move the current ones into it.
+  void _realloc(size_t n) {
+    const size_t off_children = 0;
+    const size_t off_priors = off_children + _roundUp(n * sizeof(NodeId));
+    const size_t off_rewards = off_priors + _roundUp(n * sizeof(float));
+    const size_t off_visits = off_rewards + _roundUp(n * sizeof(float));
+    const size_t off_vl = off_visits + _roundUp(n * sizeof(int));
+    const size_t off_actions = off_vl + _roundUp(n * sizeof(float));
+    const size_t bytes = off_actions + _roundUp(n * sizeof(Action));
+
+    char* p = static_cast<char*>(
+        ::operator new(bytes, std::align_val_t(kAlign)));
+    EdgeArrayT grown;
+    grown.block_ = p;
+    grown.capacity_ = n;
+    grown.children_ = reinterpret_cast<std::atomic<NodeId>*>(p + off_children);
+    grown.priors_ = reinterpret_cast<float*>(p + off_priors);
+    grown.rewards_ = reinterpret_cast<std::atomic<float>*>(p + off_rewards);
+    grown.numVisits_ = reinterpret_cast<std::atomic<int>*>(p + off_visits);
+    grown.virtualLosses_ = reinterpret_cast<std::atomic<float>*>(p + off_vl);
+    grown.actions_ = reinterpret_cast<Action*>(p + off_actions);
+
+    if (size_ > 0) {
+      ::memcpy(grown.priors_, priors_, size_ * sizeof(float));
+      ::memcpy(grown.actions_, actions_, size_ * sizeof(Action));
+      for (size_t i = 0; i < size_; ++i) {
+        grown._setEdge(
+            i,
+            rewards_[i].load(std::memory_order_relaxed),
+            numVisits_[i].load(std::memory_order_relaxed),
+            virtualLosses_[i].load(std::memory_order_relaxed),
+            children_[i].load(std::memory_order_relaxed));
+      }
+    }
+    grown.size_ = size_;
+    _release();
+    _swap(grown);
+  }
+
+  // Construct the atomics of edge i in place.
+  void _setEdge(
+      size_t i,
+      float reward,
+      int num_visits,
+      float virtual_loss,
+      NodeId child) {
+    new (&rewards_[i]) std::atomic<float>(reward);
+    new (&numVisits_[i]) std::atomic<int>(num_visits);
+    new (&virtualLosses_[i]) std::atomic<float>(virtual_loss);
+    new (&children_[i]) std::atomic<NodeId>(child);
+  }
+
+  void _release() {
+    if (block_ != nullptr) {
+      ::operator delete(block_, std::align_val_t(kAlign));
+    }
+    block_ = nullptr;
+    size_ = 0;
+    capacity_ = 0;
+    actions_ = nullptr;
+    priors_ = nullptr;
+    rewards_ = nullptr;
+    numVisits_ = nullptr;
+    virtualLosses_ = nullptr;
+    children_ = nullptr;
+  }
+
+  void _copyFrom(const EdgeArrayT& other) {
+    if (other.size_ == 0) {
+      return;
+    }
+    _realloc(other.size_);
+    ::memcpy(priors_, other.priors_, other.size_ * sizeof(float));
+    ::memcpy(actions_, other.actions_, other.size_ * sizeof(Action));
+    for (size_t i = 0; i < other.size_; ++i) {
+      _setEdge(
+          i,
+          other.rewards_[i].load(std::memory_order_relaxed),
+          other.numVisits_[i].load(std::memory_order_relaxed),
+          other.virtualLosses_[i].load(std::memory_order_relaxed),
+          other.children_[i].load(std::memory_order_relaxed));
+    }
+    size_ = other.size_;
+  }
+
+  void _swap(EdgeArrayT& other) {
+    std::swap(block_, other.block_);
+    std::swap(size_, other.size_);
+    std::swap(capacity_, other.capacity_);
+    std::swap(actions_, other.actions_);
+    std::swap(priors_, other.priors_);
+    std::swap(rewards_, other.rewards_);
+    std::swap(numVisits_, other.numVisits_);
+    std::swap(virtualLosses_, other.virtualLosses_);
+    std::swap(children_, other.children_);
+  }
+};
+
+} // namespace tree_search
+} // namespace ai
+} // namespace elf
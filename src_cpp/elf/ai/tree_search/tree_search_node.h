@@ -8,19 +8,24 @@
 
 #pragma once
 
+#include <algorithm>
 #include <atomic>
 #include <functional>
 #include <memory>
 #include <mutex>
 #include <sstream>
-#include <list>
 #include <string>
 #include <thread>
 #include <unordered_map>
 #include <vector>
 
+#include <tbb/concurrent_hash_map.h>
+
 #include "elf/concurrency/ConcurrentQueue.h"
+#include "elf/concurrency/ParkingLot.h"
+#include "tree_search_arena.h"
 #include "tree_search_options.h"
+#include "tree_search_uct.h"
 
 namespace elf {
 namespace ai {
@@ -37,7 +42,7 @@ class NodeBaseT {
   NodeBaseT() {}
 
   // It will be called in a single thread after it is moved out of active trees. 
-  void Init() {
+  void Clear() {
     stateType_ = NODE_STATE_NULL;
     state_.reset();
   }
@@ -46,6 +51,12 @@ class NodeBaseT {
     return state_.get();
   }
 
+  // Once it is NODE_STATE_SET, getStatePtr() is safe to read from any thread.
+  StateType getStateType() const {
+    std::lock_guard<std::mutex> lock(lockState_);
+    return stateType_;
+  }
+
   bool setStateIfUnset(std::function<State*()> func) {
     if (func == nullptr) {
       return false;
@@ -88,7 +99,7 @@ class NodeBaseT {
   mutable std::mutex lockState_;
   std::unique_ptr<State> state_;
   // TODO Poor choice of variable name - think later (ssengupta@fb)
-  StateType stateType_;
+  StateType stateType_ = NODE_STATE_NULL;
 };
 
 // Tree node.
@@ -113,26 +124,76 @@ class NodeT : public NodeBaseT<State> {
 
   void setId(NodeId id) { id_ = id; }
 
-  // It will be called in a single thread after it is moved out of active trees. 
-  // Once it is called, all the nodeIds will be returned (they are the next batch of free nodes). 
-  std::list<NodeId> Init(NodeId parent, const Action& parent_a, float unsigned_parent_q) {
-    NodeBase::Init();
+  NodeId getId() const {
+    return id_;
+  }
+
+  // It will be called in a single thread after it is moved out of active trees
+  // (by the arena's reclaimer, see NodeArenaT). It frees the state and the
+  // edges, and appends the children to freed.
+  void Clear(std::vector<NodeId>* freed) {
+    NodeBase::Clear();
+
+    const auto* children = stateActions_.pi.children();
+    for (size_t i = 0; i < stateActions_.pi.size(); ++i) {
+      NodeId child = children[i].load(std::memory_order_relaxed);
+      if (child != InvalidNodeId)
+        freed->push_back(child);
+    }
+    stateActions_.clear();
+  }
+
+  // Set up a cleared node for reuse, with one reference (the edge or the
+  // tree root it is allocated for).
+  void Init(NodeId parent, const Action& parent_a, float unsigned_parent_q) {
+    uint64_t generation = (refs_.load(std::memory_order_relaxed) >> 32) + 1;
+    refs_.store(generation << 32 | 1, std::memory_order_release);
+
     status_ = NOT_VISITED;
     numVisits_ = 0,
     unsignedParentQ_ = unsigned_parent_q;
     unsignedMeanQ_ = unsignedParentQ_;
+    numBackups_ = 0;
+    unsignedBackupRewards_ = 0;
+    hasLinkedChild_ = false;
 
     parent_ = parent;
     parent_a_ = parent_a;
+  }
+
+  // A node is referenced by the edges that lead to it and by the trees that
+  // have it as root. Once the last reference is dropped, the arena reclaims
+  // it (see NodeArenaT::release).
+  void addRef() {
+    refs_.fetch_add(1, std::memory_order_relaxed);
+  }
 
-    std::list<NodeId> nodes;
-    for (const auto &p : stateActions_.pi) {
-      if (p.second.child_node != InvalidNodeId) 
-        nodes.push_back(p.second.child_node);
+  // Add a reference only if the node is still the allocation numbered
+  // generation, and has not lost its last reference yet.
+  bool tryAddRef(uint32_t generation) {
+    uint64_t refs = refs_.load(std::memory_order_acquire);
+    while ((refs >> 32) == generation && (refs & kRefMask) != 0) {
+      if (refs_.compare_exchange_weak(
+              refs, refs + 1, std::memory_order_acquire)) {
+        return true;
+      }
     }
-    stateActions_.clear();
+    return false;
+  }
+
+  bool isAlive(uint32_t generation) const {
+    uint64_t refs = refs_.load(std::memory_order_acquire);
+    return (refs >> 32) == generation && (refs & kRefMask) != 0;
+  }
+
+  // Number of times the node has been allocated.
+  uint32_t generation() const {
+    return refs_.load(std::memory_order_relaxed) >> 32;
+  }
 
-    return nodes;
+  // True if it was the last reference.
+  bool unref() {
+    return (refs_.fetch_sub(1, std::memory_order_acq_rel) & kRefMask) == 1;
   }
 
   const NodeResponse& getStateActions() const {
@@ -152,6 +213,10 @@ class NodeT : public NodeBaseT<State> {
     return numVisits_;
   }
 
+  NodeId getParent() const {
+    return parent_;
+  }
+
   float getValue() const {
     return stateActions_.value;
   }
@@ -180,142 +245,215 @@ class NodeT : public NodeBaseT<State> {
     return true;
   }
 
+  // Block until setEvaluation() is called on this node.
   uint64_t waitEvaluation() {
-    // Simple busy wait here.
+    if (status_ == VISITED)
+      return 0;
+
     auto start = elf_utils::usec_since_epoch_from_now();
-    while (status_ != VISITED) {
-      std::this_thread::sleep_for(std::chrono::microseconds(10));
-    }
+    elf::concurrency::ParkingLot::park(
+        this, [this]() { return status_ == VISITED; });
     return elf_utils::usec_since_epoch_from_now() - start;
   }
 
+  // Same, without blocking: call wake() once setEvaluation() is called on
+  // this node, or right away if it has been.
+  void onEvaluated(std::function<void()> wake) {
+    elf::concurrency::ParkingLot::parkAsync(
+        this, [this]() { return status_ == VISITED; }, std::move(wake));
+  }
+
   bool setEvaluation(NodeResponse&& resp) {
     if (status_ == VISITED)
       return false;
 
-    std::lock_guard<std::mutex> lock(lockNode_);
+    {
+      std::lock_guard<std::mutex> lock(lockNode_);
 
-    if (status_ == VISITED)
-      return false;
+      if (status_ == VISITED)
+        return false;
 
-    // Then we need to allocate sa_val_
-    stateActions_ = std::move(resp);
+      // Then we need to allocate sa_val_
+      stateActions_ = std::move(resp);
+      // Selection scans edges in this order.
+      stateActions_.pi.sortByPrior();
 
-    // Once sa_ is allocated, its structure won't change.
-    status_ = VISITED;
+      // Once sa_ is allocated, its structure won't change.
+      status_ = VISITED;
+    }
+    elf::concurrency::ParkingLot::unpark(this);
     return true;
   }
 
+  // Pick the edge to descend. Edge indices are stable once the node is
+  // visited, see getAction().
   bool findMove(
       const SearchAlgoOptions& alg_opt,
       int node_depth,
       // const NodeDynInfo& node_info,
-      Action* action,
+      EdgeIdx* edge,
       std::ostream* oo = nullptr) {
     if (status_ != VISITED)
       return false;
 
-    std::lock_guard<std::mutex> lock(lockNode_);
-
+    // No lock: the edge set is fixed once visited, and the statistics are
+    // read with relaxed ordering.
     if (stateActions_.pi.empty()) {
       return false;
     }
 
+    float default_q = unsignedMeanQ_.load(std::memory_order_relaxed);
     if (alg_opt.unexplored_q_zero ||
         (alg_opt.root_unexplored_q_zero && node_depth == 0)) {
-      unsignedMeanQ_ = 0.0;
+      default_q = 0.0;
     }
 
-    BestAction best_action = UCT(alg_opt, oo);
-    *action = best_action.action_with_max_score;
-    unsignedMeanQ_ = (unsignedParentQ_ + best_action.total_unsigned_q) /
-        (best_action.total_visits + 1);
+    BestAction best_action = UCT(alg_opt, default_q, oo);
+    *edge = best_action.edge_with_max_score;
+    unsignedMeanQ_.store(
+        (unsignedParentQ_ + best_action.total_unsigned_q) /
+            (best_action.total_visits + 1),
+        std::memory_order_relaxed);
 
     return true;
   }
 
-  bool addVirtualLoss(const Action& action, float virtual_loss) {
-    if (status_ != VISITED)
-      return false;
+  const Action& getAction(EdgeIdx edge) const {
+    return stateActions_.pi.action(edge);
+  }
 
-    auto it = stateActions_.pi.find(action);
-    if (it == stateActions_.pi.end()) {
+  bool addVirtualLoss(EdgeIdx edge, float virtual_loss) {
+    if (status_ != VISITED || !_validEdge(edge))
       return false;
-    }
-
-    EdgeInfo& info = it->second;
-    std::lock_guard<std::mutex> lockNode(lockNode_);
 
-    info.virtual_loss += virtual_loss;
+    atomicAdd(&stateActions_.pi.virtualLosses()[edge], virtual_loss);
     return true;
   }
 
-  bool updateEdgeStats(const Action& action, float reward, float virtual_loss) {
-    if (status_ != VISITED)
+  bool updateEdgeStats(EdgeIdx edge, float reward, float virtual_loss) {
+    if (status_ != VISITED || !_validEdge(edge))
       return false;
 
-    auto it = stateActions_.pi.find(action);
-    if (it == stateActions_.pi.end()) {
-      return false;
-    }
-
-    EdgeInfo& edge = it->second;
-    std::lock_guard<std::mutex> lockNode(lockNode_);
+    auto& pi = stateActions_.pi;
 
-    numVisits_++;
+    numVisits_.fetch_add(1, std::memory_order_relaxed);
 
-    // Async modification (we probably need to add a locker in the future, or
-    // not for speed).
-    //
-    edge.reward += reward;
-    edge.num_visits++;
+    // Each field is updated atomically, but not the three together.
+    atomicAdd(&pi.rewards()[edge], reward);
+    pi.numVisits()[edge].fetch_add(1, std::memory_order_relaxed);
     // Reduce virtual loss.
-    edge.virtual_loss -= virtual_loss;
+    atomicAdd(&pi.virtualLosses()[edge], -virtual_loss);
     return true;
   }
 
-  NodeId followEdgeCreateIfNull(const Action& action, SearchTreeStorage& tree) {
-    if (status_ != VISITED)
-      return InvalidNodeId;
+  // With transpositions, a node also sums up the visits and rewards of the
+  // edges that lead to it, once per backup through any of them.
+  void addBackup(float reward) {
+    numBackups_.fetch_add(1, std::memory_order_relaxed);
+    atomicAdd(&unsignedBackupRewards_, reward);
+  }
 
-    auto it = stateActions_.pi.find(action);
-    if (it == stateActions_.pi.end()) {
-      return InvalidNodeId;
+  int getNumBackups() const {
+    return numBackups_;
+  }
+
+  float getUnsignedBackupRewards() const {
+    return unsignedBackupRewards_;
+  }
+
+  // A child of this node is shared with another parent (transposition).
+  void setHasLinkedChild() {
+    hasLinkedChild_.store(true, std::memory_order_relaxed);
+  }
+
+  // The edge to a shared child does not see the visits through the other
+  // parents: read N and the rewards of such edges from the child instead.
+  // numVisits_ grows with them, and stays the sum over the edges.
+  void syncLinkedEdges(const SearchTreeStorage& tree) {
+    if (status_ != VISITED || !hasLinkedChild_.load(std::memory_order_relaxed))
+      return;
+
+    auto& pi = stateActions_.pi;
+    const auto* children = pi.children();
+    for (size_t i = 0; i < pi.size(); ++i) {
+      const Node* child = tree[children[i].load(std::memory_order_acquire)];
+      if (child == nullptr) {
+        continue;
+      }
+      int n = child->numBackups_.load(std::memory_order_relaxed);
+      int old = pi.numVisits()[i].load(std::memory_order_relaxed);
+      while (old < n) {
+        if (pi.numVisits()[i].compare_exchange_weak(
+                old, n, std::memory_order_relaxed)) {
+          numVisits_.fetch_add(n - old, std::memory_order_relaxed);
+          pi.rewards()[i].store(
+              child->unsignedBackupRewards_.load(std::memory_order_relaxed),
+              std::memory_order_relaxed);
+          break;
+        }
+      }
     }
+  }
+
+  NodeId followEdgeCreateIfNull(EdgeIdx edge, SearchTreeStorage& tree) {
+    return followEdgeLinkIfNull(
+        edge, [this, &tree](const Action& a, float unsigned_parent_q) {
+          return tree.allocateNode(id_, a, unsigned_parent_q);
+        });
+  }
+
+  // Same, but the child is given by link(action, unsigned_parent_q), which
+  // may return an existing node (transposition).
+  template <typename LinkFunc>
+  NodeId followEdgeLinkIfNull(EdgeIdx edge, LinkFunc link) {
+    if (status_ != VISITED || !_validEdge(edge))
+      return InvalidNodeId;
 
-    EdgeInfo& edge = it->second;
+    std::atomic<NodeId>& child = stateActions_.pi.children()[edge];
 
-    if (edge.child_node == InvalidNodeId) {
+    NodeId id = child.load(std::memory_order_acquire);
+    if (id == InvalidNodeId) {
+      // Expansion is the only step that still takes the node lock.
       std::lock_guard<std::mutex> lockNode(lockNode_);
       // Need to check twice.
-      if (edge.child_node == InvalidNodeId) {
-        edge.child_node = tree.allocateNode(id_, action, unsignedMeanQ_);
+      id = child.load(std::memory_order_relaxed);
+      if (id == InvalidNodeId) {
+        id = link(stateActions_.pi.action(edge), unsignedMeanQ_.load());
+        child.store(id, std::memory_order_release);
       }
     }
-    return edge.child_node;
+    return id;
   }
 
-  void detachFromParent(SearchTreeStorage& tree) {
-    // Only call if no mcts thread has used the parent anymore. 
-    if (parent_ == InvalidNodeId) return;
-    Node *r = tree[parent_];
-    
-    auto &pi = r->stateActions_.pi;
-    auto it = pi.find(parent_a_);
-    assert(it != pi.end());
-    it->second.child_node = InvalidNodeId;
+  // Same, looking the edge up by action.
+  NodeId followActionCreateIfNull(
+      const Action& action,
+      SearchTreeStorage& tree) {
+    if (status_ != VISITED)
+      return InvalidNodeId;
+    return followEdgeCreateIfNull(stateActions_.pi.find(action), tree);
   }
 
  private:
   // for unit-test purpose only
   friend class NodeTest;
 
+  static constexpr uint64_t kRefMask = 0xffffffff;
+
+  // Generation (high 32 bits) and #references (low 32 bits).
+  std::atomic<uint64_t> refs_{0};
+
   std::atomic<VisitType> status_;
   mutable std::mutex lockNode_;
   NodeResponse stateActions_;
 
   std::atomic<int> numVisits_;
-  float unsignedMeanQ_ = 0.0;
+  std::atomic<float> unsignedMeanQ_{0.0};
+
+  // See addBackup() and syncLinkedEdges().
+  std::atomic<int> numBackups_{0};
+  std::atomic<float> unsignedBackupRewards_{0.0};
+  std::atomic<bool> hasLinkedChild_{false};
 
   // TODO Poor choice of variable name - fix later (ssengupta@fb)
   float unsignedParentQ_;
@@ -325,34 +463,24 @@ class NodeT : public NodeBaseT<State> {
   NodeId parent_ = InvalidNodeId;
   Action parent_a_;
 
+  bool _validEdge(EdgeIdx edge) const {
+    return edge >= 0 && edge < (EdgeIdx)stateActions_.pi.size();
+  }
+
   struct BestAction {
     Action action_with_max_score;
+    EdgeIdx edge_with_max_score;
     float max_score;
     float total_unsigned_q;
     int total_visits;
 
     BestAction()
         : action_with_max_score(ActionTrait<Action>::default_value()),
+          edge_with_max_score(InvalidEdgeIdx),
           max_score(std::numeric_limits<float>::lowest()),
           total_unsigned_q(0),
           total_visits(0) {}
 
-    void addAction(
-        const Action& action,
-        float score,
-        float unsigned_q,
-        bool first_visit) {
-      if (score > max_score) {
-        max_score = score;
-        action_with_max_score = action;
-      }
-
-      if (!first_visit) {
-        total_unsigned_q += unsigned_q;
-        total_visits++;
-      }
-    }
-
     std::string info() const {
       std::stringstream ss;
       ss << " max_score: " << max_score << ", best_action: "
@@ -365,34 +493,52 @@ class NodeT : public NodeBaseT<State> {
   };
 
   // Algorithms.
-  BestAction UCT(const SearchAlgoOptions& alg_opt, std::ostream* oo = nullptr)
-      const {
+  BestAction UCT(
+      const SearchAlgoOptions& alg_opt,
+      float unsigned_default_q,
+      std::ostream* oo = nullptr) const {
     BestAction best_action;
 
     if (oo) {
       *oo << "parent_cnt: " << (numVisits_.load() + 1) << std::endl;
     }
 
-    for (const auto& action_pair : stateActions_.pi) {
-      const Action& action = action_pair.first;
-      const EdgeInfo& edge = action_pair.second;
-
-      // num_visits_ + 1 is sum of all visits to all other actions from
-      // this node
-      const int all_visits = numVisits_.load() + 1;
-      auto prior_score =
-          edge.getScore(stateActions_.q_flip, all_visits, unsignedMeanQ_);
-
-      float score = alg_opt.c_puct > 0
-          ? (prior_score.prior_probability * alg_opt.c_puct + prior_score.q)
-          : prior_score.q;
-
-      best_action.addAction(
-          action, score, prior_score.unsigned_q, prior_score.first_visit);
+    const auto& pi = stateActions_.pi;
+    const float* priors = pi.priors();
+    const auto* rewards = pi.rewards();
+    const auto* num_visits = pi.numVisits();
+    const auto* virtual_losses = pi.virtualLosses();
+
+    // num_visits_ + 1 is sum of all visits to all other actions from
+    // this node
+    const int all_visits = numVisits_.load() + 1;
+
+    UCTKernel kernel(
+        alg_opt.c_puct, stateActions_.q_flip, all_visits, unsigned_default_q);
+    UCTSelection sel =
+        kernel.select(priors, rewards, num_visits, virtual_losses, pi.size());
+    if (sel.best_edge != InvalidEdgeIdx) {
+      best_action.action_with_max_score = pi.action(sel.best_edge);
+    }
+    best_action.edge_with_max_score = sel.best_edge;
+    best_action.max_score = sel.max_score;
+    best_action.total_unsigned_q = sel.total_unsigned_q;
+    best_action.total_visits = sel.total_visits;
 
-      if (oo) {
-        *oo << "UCT [a=" << ActionTrait<Action>::to_string(action)
-            << "][score=" << score << "] " << edge.info(true) << std::endl;
+    if (oo) {
+      for (size_t i = 0; i < pi.size(); ++i) {
+        float unsigned_q;
+        bool first_visit;
+        float score = kernel.score(
+            priors[i],
+            rewards[i].load(std::memory_order_relaxed),
+            num_visits[i].load(std::memory_order_relaxed),
+            virtual_losses[i].load(std::memory_order_relaxed),
+            &unsigned_q,
+            &first_visit);
+        *oo << "UCT [a=" << ActionTrait<Action>::to_string(pi.action(i))
+            << "][score=" << score << "] " << pi.edge(i).info(true)
+            << std::endl;
       }
     }
     if (oo) {
@@ -407,51 +553,114 @@ class SearchTreeStorageT {
  public:
   using Node = NodeT<State, Action, Info>;
   using SearchTreeStorage = SearchTreeStorageT<State, Action, Info>;
+  using NodeArena = NodeArenaT<Node>;
 
-  SearchTreeStorageT(size_t max_num_node) 
-    : numAllocated_(0), storage_(max_num_node)  {
-     for (size_t i = 0; i < max_num_node; ++i) {
-       storage_[i].setId(i);
-       freeTreeRoots_.push_back(i);
-     }
-  }
+  // Nodes come from the arena shared by all trees of this type.
+  SearchTreeStorageT() : arena_(NodeArena::get()) {}
 
   SearchTreeStorageT(const SearchTreeStorage&) = delete;
   SearchTreeStorage& operator=(const SearchTreeStorage&) = delete;
 
+  // Budget of the shared arena, in nodes.
+  static void setMaxNumNode(size_t max_num_node) {
+    NodeArena::get().setMaxNumNode(max_num_node);
+  }
+
+  // With transpositions, nodes reached as equivalent states (see
+  // StateTrait::transposes) are shared, and the tree becomes a DAG.
+  void setUseTransposition(bool use_transposition) {
+    useTransposition_ = use_transposition;
+  }
+
+  bool useTransposition() const {
+    return useTransposition_;
+  }
+
   // Low level functions.
   NodeId allocateNode(NodeId parent, const Action &parent_a, float unsigned_parent_q) {
-    NodeId i = _alloc();
+    return arena_.alloc(parent, parent_a, unsigned_parent_q);
+  }
+
+  // The node of a state equivalent to s if there is one, otherwise a new
+  // node holding s.
+  NodeId findOrAllocateNode(
+      NodeId parent,
+      const Action& parent_a,
+      float unsigned_parent_q,
+      std::unique_ptr<State> s) {
+    typename TranspositionTable::accessor acc;
+    if (!transTable_.insert(acc, StateTrait<State, Action>::hash(*s))) {
+      const TranspositionEntry entry = acc->second;
+      Node* n = (*this)[entry.id];
+      // Otherwise the entry is stale, and s takes it over.
+      if (n->tryAddRef(entry.generation)) {
+        if (StateTrait<State, Action>::transposes(*n->getStatePtr(), *s)) {
+          numTransposition_++;
+          // Both parents now read the statistics of their edge from n.
+          Node* first_parent = (*this)[n->getParent()];
+          if (first_parent != nullptr) {
+            first_parent->setHasLinkedChild();
+          }
+          (*this)[parent]->setHasLinkedChild();
+          return entry.id;
+        }
+        // Not safe to share (or a hash collision): s gets its own node.
+        acc.release();
+        arena_.release(entry.id);
+        return _allocateNodeWithState(
+            parent, parent_a, unsigned_parent_q, std::move(s));
+      }
+    }
 
-    Node *node = getNode(i);
-    
-    _free(node->Init(parent, parent_a, unsigned_parent_q));
-    return i;
+    try {
+      NodeId id = _allocateNodeWithState(
+          parent, parent_a, unsigned_parent_q, std::move(s));
+      acc->second = TranspositionEntry{id, (*this)[id]->generation()};
+    } catch (...) {
+      transTable_.erase(acc);
+      throw;
+    }
+    return acc->second.id;
   }
 
-  void releaseSubTree(NodeId id, NodeId except_node_id) {
-    if (id == InvalidNodeId || id == except_node_id) {
+  // Drop the reference of a tree root to id. The nodes that are no longer
+  // referenced are reclaimed in the background, see NodeArenaT.
+  //
+  // With transpositions, it also sweeps the stale entries of the table once
+  // the table has doubled since the last sweep, and must not run
+  // concurrently with findOrAllocateNode().
+  void releaseSubTree(NodeId id) {
+    if (id == InvalidNodeId) {
       return;
     }
+    arena_.release(id);
 
-    (*this)[except_node_id]->detachFromParent(*this);
-
-    std::lock_guard<std::mutex> lock(allocMutex_);
-    freeTreeRoots_.push_back(id);
+    if (useTransposition_ &&
+        transTable_.size() >= 2 * std::max(numSweepKept_, kMinSweep)) {
+      _sweepTranspositions();
+    }
   }
 
   std::string info() const {
     std::stringstream ss;
-    ss << "#Allocated: " << numAllocated_ << ", #Freed: " << numFreed_;
+    ss << arena_.info();
+    if (useTransposition_) {
+      ss << ", #Transposition entries: " << transTable_.size()
+         << ", #Transpositions: " << numTransposition_.load();
+    }
     return ss.str();
   }
 
+  uint64_t numTransposition() const {
+    return numTransposition_;
+  }
+
   Node* operator[](NodeId i) {
-    return getNode(i);
+    return arena_[i];
   }
 
   const Node* operator[](NodeId i) const {
-    return getNode(i);
+    return arena_[i];
   }
 
   std::string printTree(int indent, const Node* node) const {
@@ -463,18 +672,22 @@ class SearchTreeStorageT {
 
     int total_n = 0;
 
-    for (const auto& p : node->getStateActions().pi) {
+    const auto& pi = node->getStateActions().pi;
+    for (size_t i = 0; i < pi.size(); ++i) {
+      const std::pair<Action, EdgeInfo> p(pi.action(i), pi.edge(i));
       if (p.second.num_visits > 0) {
-        const Node* n = getNode(p.second.child_node);
+        const Node* n = arena_[p.second.child_node];
         if (n->isVisited()) {
           ss << indent_str << ActionTrait<Action>::to_string(p.first) << " "
              << p.second.info();
           ss << ", V: " << n->getValue();
-          assert(n->getStatePtr() != nullptr);
-          std::string state_info =
-              StateTrait<State, Action>::to_string(*n->getStatePtr());
-          if (!state_info.empty()) {
-            ss << ", " << state_info;
+          // Not kept if the state is materialized lazily.
+          if (n->getStatePtr() != nullptr) {
+            std::string state_info =
+                StateTrait<State, Action>::to_string(*n->getStatePtr());
+            if (!state_info.empty()) {
+              ss << ", " << state_info;
+            }
           }
           ss << ", unsigned_mean_q_: " << n->getMeanUnsignedQ() << std::endl;
           ss << printTree(indent + 2, n);
@@ -491,9 +704,8 @@ class SearchTreeStorageT {
       ss << indent_str << "- Total visit: " << total_n << std::endl;
       // Also print out entropy
       float entropy = 0.0;
-      for (const auto& p : node->getStateActions().pi) {
-        entropy -= p.second.prior_probability *
-            log(p.second.prior_probability + 1e-10);
+      for (size_t i = 0; i < pi.size(); ++i) {
+        entropy -= pi.priors()[i] * log(pi.priors()[i] + 1e-10);
       }
       ss << indent_str << "- Prior Entropy: " << entropy << std::endl;
     }
@@ -501,41 +713,46 @@ class SearchTreeStorageT {
   }
 
  private:
-  std::atomic<int> numAllocated_;
-  std::atomic<int> numFreed_;
-
-  mutable std::mutex allocMutex_;
-
-  // Preallocated storage. 
-  std::vector<Node> storage_;
-
-  // Free tree roots.
-  std::list<NodeId> freeTreeRoots_;
-
-  const Node* getNode(NodeId i) const {
-    if (i == InvalidNodeId) return nullptr;
-    else return &storage_[i];
-  }
-
-  Node* getNode(NodeId i) {
-    if (i == InvalidNodeId) return nullptr;
-    else return &storage_[i];
-  }
-
-  NodeId _alloc() {
-    std::lock_guard<std::mutex> lock(allocMutex_);
-    if (freeTreeRoots_.empty()) {
-      throw std::runtime_error("Out of memory!!");
+  // A node, as long as it is the same allocation of it.
+  struct TranspositionEntry {
+    NodeId id;
+    uint32_t generation;
+  };
+  using TranspositionTable =
+      tbb::concurrent_hash_map<uint64_t, TranspositionEntry>;
+
+  static constexpr size_t kMinSweep = 1024;
+
+  NodeArena& arena_;
+
+  bool useTransposition_ = false;
+  TranspositionTable transTable_;
+  std::atomic<uint64_t> numTransposition_{0};
+  // #Entries left by the last sweep.
+  size_t numSweepKept_ = 0;
+
+  NodeId _allocateNodeWithState(
+      NodeId parent,
+      const Action& parent_a,
+      float unsigned_parent_q,
+      std::unique_ptr<State> s) {
+    NodeId id = allocateNode(parent, parent_a, unsigned_parent_q);
+    (*this)[id]->setStateIfUnset([&s]() { return s.release(); });
+    return id;
+  }
+
+  // Erase the entries of the nodes that have been released.
+  void _sweepTranspositions() {
+    std::vector<uint64_t> stale;
+    for (const auto& p : transTable_) {
+      if (!(*this)[p.second.id]->isAlive(p.second.generation)) {
+        stale.push_back(p.first);
+      }
     }
-
-    NodeId i = freeTreeRoots_.back();
-    freeTreeRoots_.pop_back();
-    return i;
-  }
-
-  void _free(std::list<NodeId> &&ids) {
-    std::lock_guard<std::mutex> lock(allocMutex_);
-    freeTreeRoots_.splice(freeTreeRoots_.end(), std::move(ids));
+    for (uint64_t key : stale) {
+      transTable_.erase(key);
+    }
+    numSweepKept_ = transTable_.size();
   }
 };
 
@@ -547,11 +764,15 @@ class SearchTreeT {
   using SearchTreeStorage = SearchTreeStorageT<State, Action, Info>;
 
   SearchTreeT() : 
-    tree_(10000000),
-    oldRootId_(InvalidNodeId), 
     rootId_(InvalidNodeId) {
   }
 
+  ~SearchTreeT() {
+    // Hand the nodes back to the shared arena.
+    deleteOldRoot();
+    tree_.releaseSubTree(rootId_);
+  }
+
   SearchTreeT(const SearchTree&) = delete;
   SearchTree& operator=(const SearchTree&) = delete;
 
@@ -569,6 +790,9 @@ class SearchTreeT {
     // Here we assume that only one thread can change rootId_ (e.g., calling
     // setNewRoot).
     NodeId next_root = rootId_;
+    NodeId parent = InvalidNodeId;
+    // A new node comes with the reference of the root.
+    bool allocated = false;
 
     Node* r = tree_[rootId_];
     assert(r != nullptr);
@@ -577,10 +801,12 @@ class SearchTreeT {
       // It will allocate new node if that node is null.
       // std::cout << "applying action " <<
       // ActionTrait<Action>::to_string(action) << std::endl;
-      next_root = r->followEdgeCreateIfNull(action, tree_);
+      parent = r->getId();
+      next_root = r->followActionCreateIfNull(action, tree_);
       if (next_root == InvalidNodeId) {
 
           next_root = tree_.allocateNode(InvalidNodeId, Action(), 0.0);
+          allocated = true;
           r = tree_[next_root];
           break;
       }
@@ -597,6 +823,20 @@ class SearchTreeT {
           "TreeSearch::Root state is not the same as the input state");
     }
 
+    // A node linked by transposition keeps the state of the path that created
+    // it. Unless it can stand for s too (e.g. it forbids the same repetitions),
+    // the search goes on from a new root.
+    if (!allocated && tree_.useTransposition() && parent != InvalidNodeId &&
+        r->getParent() != parent &&
+        !StateTrait<State, Action>::transposes(s, *r->getStatePtr())) {
+      next_root = tree_.allocateNode(InvalidNodeId, Action(), 0.0);
+      allocated = true;
+      tree_[next_root]->setStateIfUnset([&]() { return new State(s); });
+    }
+
+    if (!allocated) {
+      r->addRef();
+    }
     setNewRoot(next_root);
   }
 
@@ -605,18 +845,21 @@ class SearchTreeT {
     return tree_[rootId_];
   }
 
+  // The tree takes over a reference to next_root.
   void setNewRoot(NodeId next_root) {
     std::lock_guard<std::mutex> lock(rootMutex_);
     // std::cout << "Setting new root proposal " << std::endl;
-    if (oldRootId_ == InvalidNodeId) oldRootId_ = rootId_;
+    if (rootId_ != InvalidNodeId) oldRootIds_.push_back(rootId_);
     rootId_ = next_root;
     // std::cout << "Setting new root proposal done " << std::endl;
   }
 
   void deleteOldRoot() {
     std::lock_guard<std::mutex> lock(rootMutex_);
-    tree_.releaseSubTree(oldRootId_, rootId_);
-    oldRootId_ = InvalidNodeId;
+    for (NodeId id : oldRootIds_) {
+      tree_.releaseSubTree(id);
+    }
+    oldRootIds_.clear();
   }
 
   std::string printTree() const {
@@ -628,7 +871,8 @@ class SearchTreeT {
   SearchTreeStorage tree_;
 
   mutable std::mutex rootMutex_;
-  NodeId oldRootId_;
+  // Roots replaced since the last deleteOldRoot(), still referenced.
+  std::vector<NodeId> oldRootIds_;
   NodeId rootId_;
 };
 
@@ -81,6 +81,12 @@ DEF_FIELD(
 DEF_FIELD(int, num_thread, 16, "#MCTS threads");
 DEF_FIELD(int, num_rollout_per_thread, 100, "#rollouts per thread");
 DEF_FIELD(int, num_rollout_per_batch, 8, "#rollouts per batch");
+DEF_FIELD(
+    int,
+    num_outstanding_batch,
+    1,
+    "#batches each thread keeps in flight (> 1 pipelines the search, if the "
+    "actor evaluates asynchronously)");
 DEF_FIELD(bool, verbose, false, "MCTS Verbose");
 DEF_FIELD(bool, verbose_time, false, "MCTS VerboseTime");
 DEF_FIELD(int, seed, 0, "MCTS seed");
@@ -108,6 +114,39 @@ DEF_FIELD_NODEFAULT(SearchAlgoOptions, alg_opt, "MCTS Algorithm Options");
 // Pre-added pseudo playout.
 DEF_FIELD(int, virtual_loss, 0, "Virtual loss");
 
+DEF_FIELD(
+    int,
+    max_num_node,
+    10000000,
+    "Max #tree nodes, shared by all searches in the process");
+
+DEF_FIELD(
+    bool,
+    use_transposition,
+    false,
+    "Share the node of transposed states (the tree becomes a DAG)");
+
+DEF_FIELD(
+    int,
+    state_materialize_depth,
+    1,
+    "Keep the state of the nodes at every k-th depth only, and rebuild the "
+    "others by replaying moves (1 = every node, ignored with transposition)");
+
+DEF_FIELD(
+    bool,
+    use_search_pool,
+    false,
+    "Run the num_thread searches as tasks of the process-wide work-stealing "
+    "pool, instead of on their own threads");
+
+DEF_FIELD(
+    int,
+    search_pool_size,
+    0,
+    "#Threads of the process-wide search pool (0 = #cores), set by the first "
+    "search that uses it");
+
 std::string info(bool verbose = false) const {
   std::stringstream ss;
 
@@ -117,13 +156,21 @@ std::string info(bool verbose = false) const {
     ss << "Log Prefix: " << log_prefix << std::endl;
     ss << "#Threads: " << num_thread << std::endl;
     ss << "#Rollout per thread: " << num_rollout_per_thread
-       << ", #rollouts per batch: " << num_rollout_per_batch << std::endl;
+       << ", #rollouts per batch: " << num_rollout_per_batch
+       << ", #batches in flight: " << num_outstanding_batch << std::endl;
     ss << "Verbose: " << elf_utils::print_bool(verbose)
        << ", Verbose_time: " << elf_utils::print_bool(verbose_time)
        << std::endl;
     ss << "Persistent tree: " << elf_utils::print_bool(persistent_tree)
        << std::endl;
     ss << "#Virtual loss: " << virtual_loss << std::endl;
+    ss << "Max #nodes: " << max_num_node << std::endl;
+    ss << "Transposition: " << elf_utils::print_bool(use_transposition)
+       << std::endl;
+    ss << "State materialized every " << state_materialize_depth << " depth"
+       << std::endl;
+    ss << "Search pool: " << elf_utils::print_bool(use_search_pool)
+       << ", size: " << search_pool_size << std::endl;
     ss << "Pick method: " << pick_method << std::endl;
 
     if (root_epsilon > 0) {
@@ -141,6 +188,15 @@ std::string info(bool verbose = false) const {
   return ss.str();
 }
 
+// max_num_node, use_search_pool and search_pool_size size the resources of
+// the host that runs the search. They are not compared nor sent, and the
+// receiver takes them from its own options.
+void setHostFields(const TSOptions& local) {
+  max_num_node = local.max_num_node;
+  use_search_pool = local.use_search_pool;
+  search_pool_size = local.search_pool_size;
+}
+
 friend bool operator==(const TSOptions& t1, const TSOptions& t2) {
   if (t1.max_num_move != t2.max_num_move) {
     return false;
@@ -154,6 +210,9 @@ friend bool operator==(const TSOptions& t1, const TSOptions& t2) {
   if (t1.num_rollout_per_batch != t2.num_rollout_per_batch) {
     return false;
   }
+  if (t1.num_outstanding_batch != t2.num_outstanding_batch) {
+    return false;
+  }
   if (t1.verbose != t2.verbose) {
     return false;
   }
@@ -184,6 +243,12 @@ friend bool operator==(const TSOptions& t1, const TSOptions& t2) {
   if (t1.virtual_loss != t2.virtual_loss) {
     return false;
   }
+  if (t1.use_transposition != t2.use_transposition) {
+    return false;
+  }
+  if (t1.state_materialize_depth != t2.state_materialize_depth) {
+    return false;
+  }
   return true;
 }
 
@@ -192,6 +257,7 @@ void setJsonFields(json& j) const {
   JSON_SAVE(j, num_thread);
   JSON_SAVE(j, num_rollout_per_thread);
   JSON_SAVE(j, num_rollout_per_batch);
+  JSON_SAVE(j, num_outstanding_batch);
   JSON_SAVE(j, verbose);
   JSON_SAVE(j, verbose_time);
   JSON_SAVE(j, seed);
@@ -201,15 +267,19 @@ void setJsonFields(json& j) const {
   JSON_SAVE(j, root_epsilon);
   JSON_SAVE(j, root_alpha);
   JSON_SAVE(j, virtual_loss);
+  JSON_SAVE(j, use_transposition);
+  JSON_SAVE(j, state_materialize_depth);
   JSON_SAVE_OBJ(j, alg_opt);
 }
 
+// Older peers do not send the fields added since, which keep their default.
 static TSOptions createFromJson(const json& j) {
   TSOptions opt;
   JSON_LOAD(opt, j, max_num_move);
   JSON_LOAD(opt, j, num_thread);
   JSON_LOAD(opt, j, num_rollout_per_thread);
   JSON_LOAD(opt, j, num_rollout_per_batch);
+  JSON_LOAD_OPTIONAL(opt, j, num_outstanding_batch);
   JSON_LOAD(opt, j, verbose);
   JSON_LOAD(opt, j, verbose_time);
   JSON_LOAD(opt, j, seed);
@@ -219,6 +289,8 @@ static TSOptions createFromJson(const json& j) {
   JSON_LOAD(opt, j, root_epsilon);
   JSON_LOAD(opt, j, root_alpha);
   JSON_LOAD(opt, j, virtual_loss);
+  JSON_LOAD_OPTIONAL(opt, j, use_transposition);
+  JSON_LOAD_OPTIONAL(opt, j, state_materialize_depth);
   JSON_LOAD_OBJ(opt, j, alg_opt);
   return opt;
 }
@@ -0,0 +1,379 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cmath>
+#include <limits>
+
+#if defined(__SANITIZE_THREAD__)
+// The vector loads of the edge statistics are not seen as atomic loads.
+#elif defined(__AVX512F__)
+#define ELF_UCT_AVX512
+#elif defined(__AVX2__) && defined(__FMA__)
+#define ELF_UCT_AVX2
+#endif
+
+#if defined(ELF_UCT_AVX512) || defined(ELF_UCT_AVX2)
+#include <immintrin.h>
+#endif
+
+#include "elf/ai/tree_search/tree_search_edges.h"
+
+namespace elf {
+namespace ai {
+namespace tree_search {
+
+struct UCTSelection {
+  EdgeIdx best_edge = InvalidEdgeIdx;
+  float max_score = std::numeric_limits<float>::lowest();
+  // Over the edges that are not at their first visit.
+  float total_unsigned_q = 0;
+  int total_visits = 0;
+};
+
+// PUCT scores of all edges of a node (see EdgeInfo::computeScore), and the
+// first edge with the highest one.
+//
+// select() works on the arrays of EdgeArrayT, 16 (AVX-512) or 8 (AVX2) edges
+// at a time, whichever the build targets (-march=native). selectScalar() is
+// the reference, and both give identical results: every edge goes through
+// the same operations in the same order, and the unsigned q's are summed in
+// kNumPartial interleaved partial sums either way.
+//
+// On x86, relaxed loads of lock-free atomics are plain loads, so the vector
+// code reads the statistics directly.
+class UCTKernel {
+ public:
+  static constexpr int kNumPartial = 8;
+
+  UCTKernel(
+      float c_puct,
+      bool flip_q_sign,
+      int total_parent_visits,
+      float unsigned_default_q)
+      : cPuct_(c_puct),
+        flipQSign_(flip_q_sign),
+        sqrtParentVisits_(std::sqrt(total_parent_visits)),
+        unsignedDefaultQ_(unsigned_default_q),
+        signedDefaultQ_(flip_q_sign ? -unsigned_default_q : unsigned_default_q) {}
+
+  // Same as EdgeInfo::computeScore(), followed by the c_puct weighting.
+  float score(
+      float prior,
+      float reward,
+      int num_visits,
+      float virtual_loss,
+      float* unsigned_q,
+      bool* first_visit) const {
+    float r = flipQSign_ ? -reward : reward;
+    r -= virtual_loss;
+    const int num_visits_with_loss = num_visits + virtual_loss;
+
+    const float q =
+        num_visits_with_loss > 0 ? r / num_visits_with_loss : signedDefaultQ_;
+    *unsigned_q = num_visits > 0 ? reward / num_visits : unsignedDefaultQ_;
+    *first_visit = num_visits_with_loss == 0;
+    if (cPuct_ <= 0) {
+      return q;
+    }
+    const float p = prior / (1 + num_visits) * sqrtParentVisits_;
+    return _madd(p, cPuct_, q);
+  }
+
+  UCTSelection select(
+      const float* priors,
+      const std::atomic<float>* rewards,
+      const std::atomic<int>* num_visits,
+      const std::atomic<float>* virtual_losses,
+      size_t n) const {
+#if defined(ELF_UCT_AVX512)
+    return _selectAVX512(priors, rewards, num_visits, virtual_losses, n);
+#elif defined(ELF_UCT_AVX2)
+    return _selectAVX2(priors, rewards, num_visits, virtual_losses, n);
+#else
+    return selectScalar(priors, rewards, num_visits, virtual_losses, n);
+#endif
+  }
+
+  UCTSelection selectScalar(
+      const float* priors,
+      const std::atomic<float>* rewards,
+      const std::atomic<int>* num_visits,
+      const std::atomic<float>* virtual_losses,
+      size_t n) const {
+    UCTSelection sel;
+    float partial[kNumPartial] = {0};
+    _selectTail(
+        0, priors, rewards, num_visits, virtual_losses, n, &sel, partial);
+    sel.total_unsigned_q = _sum(partial);
+    return sel;
+  }
+
+ private:
+  float cPuct_;
+  bool flipQSign_;
+  double sqrtParentVisits_;
+  float unsignedDefaultQ_;
+  float signedDefaultQ_;
+
+  static float _madd(float a, float b, float c) {
+#ifdef FP_FAST_FMAF
+    return std::fma(a, b, c);
+#else
+    return a * b + c;
+#endif
+  }
+
+  static float _sum(const float* partial) {
+    return ((partial[0] + partial[1]) + (partial[2] + partial[3])) +
+        ((partial[4] + partial[5]) + (partial[6] + partial[7]));
+  }
+
+  // Edges [begin, n), one at a time.
+  void _selectTail(
+      size_t begin,
+      const float* priors,
+      const std::atomic<float>* rewards,
+      const std::atomic<int>* num_visits,
+      const std::atomic<float>* virtual_losses,
+      size_t n,
+      UCTSelection* sel,
+      float* partial) const {
+    for (size_t i = begin; i < n; ++i) {
+      float unsigned_q;
+      bool first_visit;
+      const float s = score(
+          priors[i],
+          rewards[i].load(std::memory_order_relaxed),
+          num_visits[i].load(std::memory_order_relaxed),
+          virtual_losses[i].load(std::memory_order_relaxed),
+          &unsigned_q,
+          &first_visit);
+      if (s > sel->max_score) {
+        sel->max_score = s;
+        sel->best_edge = i;
+      }
+      if (!first_visit) {
+        partial[i % kNumPartial] += unsigned_q;
+        sel->total_visits++;
+      }
+    }
+  }
+
+  // Fold the per-lane maxima (each with the first edge that reached it) into
+  // sel: the highest score, and the first edge among the lanes that have it.
+  static void _reduceMax(
+      const float* scores,
+      const int* edges,
+      int num_lane,
+      UCTSelection* sel) {
+    for (int j = 0; j < num_lane; ++j) {
+      if (edges[j] < 0) {
+        continue;
+      }
+      if (sel->best_edge == InvalidEdgeIdx || scores[j] > sel->max_score ||
+          (scores[j] == sel->max_score && edges[j] < sel->best_edge)) {
+        sel->max_score = scores[j];
+        sel->best_edge = edges[j];
+      }
+    }
+  }
+
+#ifdef ELF_UCT_AVX512
+// GCC 12 warns about the undefined vectors in its own AVX-512 intrinsics.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+  UCTSelection _selectAVX512(
+      const float* priors,
+      const std::atomic<float>* rewards,
+      const std::atomic<int>* num_visits,
+      const std::atomic<float>* virtual_losses,
+      size_t n) const {
+    const __m512i sign = _mm512_castps_si512(_mm512_set1_ps(-0.0f));
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i one = _mm512_set1_epi32(1);
+    const __m512 signed_default_q = _mm512_set1_ps(signedDefaultQ_);
+    const __m512 unsigned_default_q = _mm512_set1_ps(unsignedDefaultQ_);
+    const __m512d sqrt_parent_visits = _mm512_set1_pd(sqrtParentVisits_);
+    const __m512 c_puct = _mm512_set1_ps(cPuct_);
+
+    __m512 best = _mm512_set1_ps(std::numeric_limits<float>::lowest());
+    __m512i best_edge = _mm512_set1_epi32(InvalidEdgeIdx);
+    __m512i edge = _mm512_setr_epi32(
+        0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    // Only the lower 8 lanes are used, see kNumPartial.
+    __m512 acc = _mm512_setzero_ps();
+    int total_visits = 0;
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+      const __m512 prior = _mm512_loadu_ps(priors + i);
+      const __m512 reward =
+          _mm512_loadu_ps(reinterpret_cast<const float*>(rewards + i));
+      const __m512i nv = _mm512_loadu_si512(num_visits + i);
+      const __m512 vl =
+          _mm512_loadu_ps(reinterpret_cast<const float*>(virtual_losses + i));
+      const __m512 nvf = _mm512_cvtepi32_ps(nv);
+
+      __m512 r = reward;
+      if (flipQSign_) {
+        r = _mm512_castsi512_ps(
+            _mm512_xor_si512(_mm512_castps_si512(r), sign));
+      }
+      r = _mm512_sub_ps(r, vl);
+      const __m512i nvl = _mm512_cvttps_epi32(_mm512_add_ps(nvf, vl));
+      const __mmask16 has_visit = _mm512_cmpgt_epi32_mask(nvl, zero);
+      const __m512 q = _mm512_mask_div_ps(
+          signed_default_q, has_visit, r, _mm512_cvtepi32_ps(nvl));
+      const __m512 unsigned_q = _mm512_mask_div_ps(
+          unsigned_default_q, _mm512_cmpgt_epi32_mask(nv, zero), reward, nvf);
+      const __mmask16 counted = _mm512_cmpneq_epi32_mask(nvl, zero);
+
+      __m512 s = q;
+      if (cPuct_ > 0) {
+        const __m512 x =
+            _mm512_div_ps(prior, _mm512_cvtepi32_ps(_mm512_add_epi32(nv, one)));
+        const __m256 lo = _mm512_cvtpd_ps(_mm512_mul_pd(
+            _mm512_cvtps_pd(_mm512_castps512_ps256(x)), sqrt_parent_visits));
+        const __m256 hi = _mm512_cvtpd_ps(_mm512_mul_pd(
+            _mm512_cvtps_pd(_mm256_castpd_ps(
+                _mm512_extractf64x4_pd(_mm512_castps_pd(x), 1))),
+            sqrt_parent_visits));
+        const __m512 p = _mm512_castpd_ps(_mm512_insertf64x4(
+            _mm512_castps_pd(_mm512_castps256_ps512(lo)),
+            _mm256_castps_pd(hi),
+            1));
+        s = _mm512_fmadd_ps(p, c_puct, q);
+      }
+
+      const __mmask16 gt = _mm512_cmp_ps_mask(s, best, _CMP_GT_OQ);
+      best = _mm512_mask_blend_ps(gt, best, s);
+      best_edge = _mm512_mask_blend_epi32(gt, best_edge, edge);
+      edge = _mm512_add_epi32(edge, _mm512_set1_epi32(16));
+
+      // Edges i..i+7, then i+8..i+15 (moved to the lower lanes).
+      acc = _mm512_mask_add_ps(acc, counted & 0xff, acc, unsigned_q);
+      acc = _mm512_mask_add_ps(
+          acc,
+          counted >> 8,
+          acc,
+          _mm512_shuffle_f32x4(unsigned_q, unsigned_q, 0x4E));
+      total_visits += __builtin_popcount(counted);
+    }
+
+    UCTSelection sel;
+    alignas(64) float scores[16];
+    alignas(64) int edges[16];
+    alignas(64) float partial[16];
+    _mm512_store_ps(scores, best);
+    _mm512_store_si512(edges, best_edge);
+    _mm512_store_ps(partial, acc);
+    _reduceMax(scores, edges, 16, &sel);
+    sel.total_visits = total_visits;
+
+    _selectTail(
+        i, priors, rewards, num_visits, virtual_losses, n, &sel, partial);
+    sel.total_unsigned_q = _sum(partial);
+    return sel;
+  }
+#pragma GCC diagnostic pop
+#endif
+
+#ifdef ELF_UCT_AVX2
+  UCTSelection _selectAVX2(
+      const float* priors,
+      const std::atomic<float>* rewards,
+      const std::atomic<int>* num_visits,
+      const std::atomic<float>* virtual_losses,
+      size_t n) const {
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256 signed_default_q = _mm256_set1_ps(signedDefaultQ_);
+    const __m256 unsigned_default_q = _mm256_set1_ps(unsignedDefaultQ_);
+    const __m256d sqrt_parent_visits = _mm256_set1_pd(sqrtParentVisits_);
+    const __m256 c_puct = _mm256_set1_ps(cPuct_);
+
+    __m256 best = _mm256_set1_ps(std::numeric_limits<float>::lowest());
+    __m256i best_edge = _mm256_set1_epi32(InvalidEdgeIdx);
+    __m256i edge = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256 acc = _mm256_setzero_ps();
+    int total_visits = 0;
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      const __m256 prior = _mm256_loadu_ps(priors + i);
+      const __m256 reward =
+          _mm256_loadu_ps(reinterpret_cast<const float*>(rewards + i));
+      const __m256i nv = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i*>(num_visits + i));
+      const __m256 vl =
+          _mm256_loadu_ps(reinterpret_cast<const float*>(virtual_losses + i));
+      const __m256 nvf = _mm256_cvtepi32_ps(nv);
+
+      __m256 r = flipQSign_ ? _mm256_xor_ps(reward, sign) : reward;
+      r = _mm256_sub_ps(r, vl);
+      const __m256i nvl = _mm256_cvttps_epi32(_mm256_add_ps(nvf, vl));
+      const __m256 has_visit =
+          _mm256_castsi256_ps(_mm256_cmpgt_epi32(nvl, zero));
+      const __m256 q = _mm256_blendv_ps(
+          signed_default_q,
+          _mm256_div_ps(r, _mm256_cvtepi32_ps(nvl)),
+          has_visit);
+      const __m256 unsigned_q = _mm256_blendv_ps(
+          unsigned_default_q,
+          _mm256_div_ps(reward, nvf),
+          _mm256_castsi256_ps(_mm256_cmpgt_epi32(nv, zero)));
+      // Not at the first visit: nvl != 0.
+      const __m256 counted = _mm256_castsi256_ps(_mm256_xor_si256(
+          _mm256_cmpeq_epi32(nvl, zero), _mm256_set1_epi32(-1)));
+
+      __m256 s = q;
+      if (cPuct_ > 0) {
+        const __m256 x =
+            _mm256_div_ps(prior, _mm256_cvtepi32_ps(_mm256_add_epi32(nv, one)));
+        const __m128 lo = _mm256_cvtpd_ps(_mm256_mul_pd(
+            _mm256_cvtps_pd(_mm256_castps256_ps128(x)), sqrt_parent_visits));
+        const __m128 hi = _mm256_cvtpd_ps(_mm256_mul_pd(
+            _mm256_cvtps_pd(_mm256_extractf128_ps(x, 1)), sqrt_parent_visits));
+        s = _mm256_fmadd_ps(_mm256_set_m128(hi, lo), c_puct, q);
+      }
+
+      const __m256 gt = _mm256_cmp_ps(s, best, _CMP_GT_OQ);
+      best = _mm256_blendv_ps(best, s, gt);
+      best_edge = _mm256_castps_si256(_mm256_blendv_ps(
+          _mm256_castsi256_ps(best_edge), _mm256_castsi256_ps(edge), gt));
+      edge = _mm256_add_epi32(edge, _mm256_set1_epi32(8));
+
+      acc = _mm256_blendv_ps(acc, _mm256_add_ps(acc, unsigned_q), counted);
+      total_visits += __builtin_popcount(_mm256_movemask_ps(counted));
+    }
+
+    UCTSelection sel;
+    alignas(32) float scores[8];
+    alignas(32) int edges[8];
+    alignas(32) float partial[8];
+    _mm256_store_ps(scores, best);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(edges), best_edge);
+    _mm256_store_ps(partial, acc);
+    _reduceMax(scores, edges, 8, &sel);
+    sel.total_visits = total_visits;
+
+    _selectTail(
+        i, priors, rewards, num_visits, virtual_losses, n, &sel, partial);
+    sel.total_unsigned_q = _sum(partial);
+    return sel;
+  }
+#endif
+};
+
+} // namespace tree_search
+} // namespace ai
+} // namespace elf
@@ -0,0 +1,173 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "elf/interface/sharedmem_data.h"
+
+namespace elf {
+
+// How long a collector waits for its batch (see
+// SharedMemLocal::waitBatchFillMem).
+struct BatchControl {
+  // Once it has a request, the collector waits up to timeout_usec for
+  // min_batchsize of them.
+  int min_batchsize = 1;
+  int timeout_usec = 1;
+};
+
+// Tunes the BatchControl of a collector from the rate at which requests come
+// in and the time the model takes to reply:
+//
+//   MAX_THROUGHPUT: wait for the requests that come in during one inference.
+//     A smaller batch wastes the model, and waiting longer idles it.
+//   LATENCY_SLO: same, but within what the latency SLO leaves after the
+//     inference, scaled down while the p99 latency of requests exceeds the
+//     SLO.
+//
+// The latency of a request is taken from when the collector picked it up to
+// when its reply came back.
+class BatchController {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit BatchController(const SharedMemOptions& opts)
+      : target_(opts.getBatchTarget()),
+        latencySLO_(opts.getLatencySLO()),
+        maxBatchSize_(opts.getBatchSize()) {}
+
+  BatchControl get() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return control_;
+  }
+
+  // A batch of batchsize requests has been filled (at now).
+  void onFilled(int batchsize, Clock::time_point now = Clock::now()) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    arrivals_.push_back(std::make_pair(now, batchsize));
+    sumArrival_ += batchsize;
+    if (arrivals_.size() > kWindow) {
+      sumArrival_ -= arrivals_.front().second;
+      arrivals_.pop_front();
+    }
+  }
+
+  // The reply of a batch came back infer_usec after the batch was filled,
+  // which took fill_usec.
+  void onReplied(int batchsize, int64_t fill_usec, int64_t infer_usec) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    numBatch_++;
+    numRequest_ += batchsize;
+    inferUsec_ = numBatch_ == 1
+        ? infer_usec
+        : (1 - kAlpha) * inferUsec_ + kAlpha * infer_usec;
+    _push(&inferSamples_, infer_usec);
+    _push(&latencySamples_, fill_usec + infer_usec);
+    _update();
+  }
+
+  std::string info() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::stringstream ss;
+    ss << "BatchController[" << (target_ == SharedMemOptions::LATENCY_SLO
+                                     ? "latency_slo"
+                                     : "max_throughput")
+       << "] #batch: " << numBatch_ << ", avg batchsize: "
+       << (numBatch_ > 0 ? static_cast<double>(numRequest_) / numBatch_ : 0)
+       << ", arrival/sec: " << rate_ * 1e6 << ", infer_usec: " << inferUsec_
+       << ", p99_latency_usec: " << p99Latency_;
+    if (target_ == SharedMemOptions::LATENCY_SLO) {
+      ss << ", latency_slo_usec: " << latencySLO_ << ", scale: " << scale_;
+    }
+    ss << ", min_batchsize: " << control_.min_batchsize
+       << ", timeout_usec: " << control_.timeout_usec;
+    return ss.str();
+  }
+
+ private:
+  static constexpr size_t kWindow = 256;
+  static constexpr double kAlpha = 0.1;
+
+  const SharedMemOptions::BatchTarget target_;
+  const int latencySLO_;
+  const int maxBatchSize_;
+
+  mutable std::mutex mutex_;
+  BatchControl control_;
+
+  // (time filled, batchsize) of the last batches.
+  std::deque<std::pair<Clock::time_point, int>> arrivals_;
+  int64_t sumArrival_ = 0;
+  std::deque<int64_t> inferSamples_;
+  std::deque<int64_t> latencySamples_;
+
+  int64_t numBatch_ = 0;
+  int64_t numRequest_ = 0;
+  // Requests per usec.
+  double rate_ = 0;
+  double inferUsec_ = 0;
+  double p99Latency_ = 0;
+  double scale_ = 1;
+
+  static void _push(std::deque<int64_t>* samples, int64_t v) {
+    samples->push_back(v);
+    if (samples->size() > kWindow) {
+      samples->pop_front();
+    }
+  }
+
+  static double _p99(const std::deque<int64_t>& samples) {
+    std::vector<int64_t> v(samples.begin(), samples.end());
+    auto it = v.begin() + (v.size() - 1) * 99 / 100;
+    std::nth_element(v.begin(), it, v.end());
+    return *it;
+  }
+
+  void _update() {
+    if (arrivals_.size() < 2) {
+      return;
+    }
+    double span = std::chrono::duration<double, std::micro>(
+                      arrivals_.back().first - arrivals_.front().first)
+                      .count();
+    if (span <= 0) {
+      return;
+    }
+    // The requests of the first batch came before the span.
+    rate_ = (sumArrival_ - arrivals_.front().second) / span;
+    p99Latency_ = _p99(latencySamples_);
+
+    double wait = inferUsec_;
+    if (target_ == SharedMemOptions::LATENCY_SLO) {
+      if (p99Latency_ > latencySLO_) {
+        scale_ = std::max(scale_ * 0.8, 0.01);
+      } else if (p99Latency_ < 0.8 * latencySLO_) {
+        scale_ = std::min(scale_ * 1.1, 1.0);
+      }
+      wait = std::min(wait, latencySLO_ - _p99(inferSamples_)) * scale_;
+    }
+
+    double batchsize = rate_ * wait;
+    control_.min_batchsize = std::max(
+        1, std::min(maxBatchSize_, static_cast<int>(std::lround(batchsize))));
+    control_.timeout_usec = std::max(1, static_cast<int>(std::lround(wait)));
+  }
+};
+
+} // namespace elf
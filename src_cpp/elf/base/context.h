@@ -15,15 +15,19 @@
 #include <functional>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <set>
+#include <sstream>
 #include <string>
 #include <thread>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include "elf/comm/comm.h"
 #include "elf/concurrency/ConcurrentQueue.h"
 #include "elf/concurrency/Counter.h"
+#include "elf/concurrency/Fiber.h"
 #include "sharedmem.h"
 #include "elf/interface/game_client_interface.h"
 
@@ -171,16 +175,39 @@ class GameStateCollector {
   GameStateCollector(
       std::unique_ptr<SharedMem>&& smem,
       BatchCollectFunc collect_func)
-      : smem_(std::move(smem)), collect_func_(collect_func) {
-    assert(smem_.get() != nullptr);
+      : collect_func_(collect_func) {
     assert(collect_func_ != nullptr);
+    assert(smem.get() != nullptr);
+    const SharedMemOptions& opts = smem->data().getSharedMemOptionsC();
+    if (opts.getBatchTarget() != SharedMemOptions::FIXED) {
+      controller_.reset(new BatchController(opts));
+    }
+    addSlot(std::move(smem));
+  }
+
+  // One more batch to fill while the others are in flight.
+  SharedMemData& addSlot(std::unique_ptr<SharedMem>&& smem) {
+    assert(smem.get() != nullptr);
+    smem->setBatchController(controller_.get());
+    slots_.emplace_back(new _Slot);
+    slots_.back()->smem = std::move(smem);
+    return slots_.back()->smem->data();
+  }
+
+  size_t numSlot() const {
+    return slots_.size();
   }
 
   SharedMemData& smemData() {
-    return smem_->data();
+    return slots_[0]->smem->data();
   }
   SharedMem& smem() {
-    return *smem_;
+    return *slots_[0]->smem;
+  }
+
+  // nullptr with SharedMemOptions::FIXED.
+  const BatchController* batchController() const {
+    return controller_.get();
   }
 
   void start() {
@@ -208,7 +235,15 @@ class GameStateCollector {
  private:
   enum _Msg { PREPARE_TO_STOP, STOP };
 
-  std::unique_ptr<SharedMem> smem_;
+  struct _Slot {
+    std::unique_ptr<SharedMem> smem;
+    // Filled batches to send (true), or the end of the collector (false).
+    concurrency::ConcurrentQueue<bool> filled;
+    std::thread th;
+  };
+
+  std::vector<std::unique_ptr<_Slot>> slots_;
+  std::unique_ptr<BatchController> controller_;
   std::unique_ptr<std::thread> th_;
 
   BatchCollectFunc collect_func_ = nullptr;
@@ -217,47 +252,103 @@ class GameStateCollector {
 
   concurrency::ConcurrentQueue<_Msg> msgQueue_;
 
+  // Slots that are neither filling nor in flight.
+  concurrency::ConcurrentQueue<int> freeSlots_;
+  std::mutex sessionMutex_;
+
+  // Returns false on STOP.
+  bool checkMsg() {
+    _Msg msg;
+    if (msgQueue_.pop(&msg, std::chrono::microseconds(0))) {
+      if (msg == PREPARE_TO_STOP) {
+        // std::cout << " get prepare to stop signal "
+        // << smem_opts.info() << std::endl;
+
+        for (auto& slot : slots_) {
+          slot->smem->data().setMinBatchSize(0);
+          slot->smem->data().setTimeout(2);
+        }
+        completedSwitch_.set(true);
+      } else if (msg == STOP) {
+        completedSwitch_.set(true);
+        return false;
+      }
+    }
+    return true;
+  }
+
   // Collect game states into batch
   // Send batch to batch_server (through batchClient_)
   void collectAndSendBatch() {
-    std::vector<Message> batch;
-
     // Initialize collector. For now just use 1.
     // Each collector has its own shared memory.
     // min_batchsize = 1 and wait indefinitely (timeout = 0).
-    smem_->start();
-    const std::string &label = smem_->data().getSharedMemOptions().getLabel();
-    (void)label;
+    for (auto& slot : slots_) {
+      slot->smem->start();
+    }
 
-    while (true) {
-      _Msg msg;
-      if (msgQueue_.pop(&msg, std::chrono::microseconds(0))) {
-        if (msg == PREPARE_TO_STOP) {
-          // std::cout << " get prepare to stop signal "
-          // << smem_opts.info() << std::endl;
-
-          smem_->data().setMinBatchSize(0);
-          smem_->data().setTimeout(2);
-          completedSwitch_.set(true);
-        } else if (msg == STOP) {
-          completedSwitch_.set(true);
-          break;
-        }
-      }
+    if (slots_.size() > 1) {
+      collectAndSendRing();
+      return;
+    }
 
-      C_PRINT("Receiver[" << label << "] Batch received. #batch = " << smem_->data().getEffectiveBatchSize());
-      smem_->waitBatchFillMem();
+    SharedMem& smem = *slots_[0]->smem;
+    const std::string &label = smem.data().getSharedMemOptions().getLabel();
+    (void)label;
 
-      C_PRINT("Receiver[" << label << "] Batch received. #batch = " << smem_->data().getEffectiveBatchSize());
-      comm::ReplyStatus batch_status = collect_func_(&smem_->data());
+    while (checkMsg()) {
+      C_PRINT("Receiver[" << label << "] Batch received. #batch = " << smem.data().getEffectiveBatchSize());
+      smem.waitBatchFillMem();
 
-      C_PRINT("Receiver[" << label << "] Batch releasing. #batch = " << smem_->data().getEffectiveBatchSize());
+      C_PRINT("Receiver[" << label << "] Batch received. #batch = " << smem.data().getEffectiveBatchSize());
+      comm::ReplyStatus batch_status = collect_func_(&smem.data());
+
+      C_PRINT("Receiver[" << label << "] Batch releasing. #batch = " << smem.data().getEffectiveBatchSize());
 
       // LOG(INFO) << "Receiver: Release batch" << std::endl;
-      smem_->waitReplyReleaseBatch(batch_status);
+      smem.waitReplyReleaseBatch(batch_status);
       C_PRINT("Receiver[" << label << "] Batch released. ");
     }
   }
+
+  // This thread fills the free slots in turn, and each slot has a thread that
+  // sends its batch, waits for the reply and releases the batch.
+  void collectAndSendRing() {
+    for (size_t i = 0; i < slots_.size(); ++i) {
+      slots_[i]->smem->setSessionMutex(&sessionMutex_);
+      freeSlots_.push(i);
+      slots_[i]->th = std::thread([this, i]() { sendSlot(i); });
+    }
+
+    while (checkMsg()) {
+      int i;
+      freeSlots_.pop(&i);
+      SharedMem& smem = *slots_[i]->smem;
+      smem.waitBatchFillMem();
+      C_PRINT("Receiver[" << smem.data().getSharedMemOptions().info() << "] Batch received. #batch = " << smem.data().getEffectiveBatchSize());
+      slots_[i]->filled.push(true);
+    }
+
+    // Wait until the batches in flight are released.
+    for (size_t n = 0; n < slots_.size(); ++n) {
+      int i;
+      freeSlots_.pop(&i);
+    }
+    for (auto& slot : slots_) {
+      slot->filled.push(false);
+      slot->th.join();
+    }
+  }
+
+  void sendSlot(int i) {
+    _Slot& slot = *slots_[i];
+    bool filled;
+    while (slot.filled.pop(&filled), filled) {
+      comm::ReplyStatus batch_status = collect_func_(&slot.smem->data());
+      slot.smem->waitReplyReleaseBatch(batch_status);
+      freeSlots_.push(i);
+    }
+  }
 };
 
 class Collectors {
@@ -301,10 +392,10 @@ class Collectors {
   std::pair<int, int> getNextIdx(const std::string& label) const {
     auto it = smem2keys_.find(label);
     if (it == smem2keys_.end())
-      return std::make_pair<int, int>(collectors_.size(), 0);
+      return std::make_pair<int, int>(smems_.size(), 0);
     else
       return std::make_pair<int, int>(
-          (int)collectors_.size(), (int)it->second.indices_in_collectors.size());
+          (int)smems_.size(), (int)it->second.indices_in_collectors.size());
   }
 
   SharedMemData& allocateSharedMem(
@@ -321,6 +412,17 @@ class Collectors {
     const std::string& label = options.getRecvOptions().label;
 
     std::pair<int, int> nextIdx = getNextIdx(label);
+
+    // The slots of a collector are allocated one after the other, so that
+    // each gets its own memory (and idx) on the python side.
+    GameStateCollector* last = nullptr;
+    auto it = smem2keys_.find(label);
+    if (it != smem2keys_.end() && it->second.last_collector >= 0) {
+      last = collectors_[it->second.last_collector].get();
+      if ((int)last->numSlot() >= options.getNumSlot()) {
+        last = nullptr;
+      }
+    }
     addKeys(label, keys);
 
     auto anyps = extractor_.getAnyP(keys);
@@ -328,9 +430,18 @@ class Collectors {
     SharedMemOptions options_dup = options;
     options_dup.setIdx(nextIdx.first);
     options_dup.setLabelIdx(nextIdx.second);
+    options_dup.setSlotIdx(last != nullptr ? last->numSlot() : 0);
+
+    std::unique_ptr<SharedMem> smem = smem_func(options_dup, anyps);
+    smems_.push_back(smem.get());
 
+    if (last != nullptr) {
+      return last->addSlot(std::move(smem));
+    }
+
+    smem2keys_[label].last_collector = collectors_.size();
     collectors_.emplace_back(
-        new GameStateCollector(smem_func(options_dup, anyps), collect_func));
+        new GameStateCollector(std::move(smem), collect_func));
 
     return collectors_.back()->smemData();
   }
@@ -347,7 +458,19 @@ class Collectors {
   }
 
   SharedMem& getSMem(int idx) {
-    return collectors_[idx]->smem();
+    return *smems_[idx];
+  }
+
+  // What the batch controllers of the collectors decided so far.
+  std::string batchStats() const {
+    std::stringstream ss;
+    for (const auto& c : collectors_) {
+      if (c->batchController() != nullptr) {
+        ss << c->smem().data().getSharedMemOptionsC().getLabel() << ": "
+           << c->batchController()->info() << std::endl;
+      }
+    }
+    return ss.str();
   }
 
   SharedMem& pickSMem(const std::string &label, std::mt19937 *rng) {
@@ -360,18 +483,22 @@ class Collectors {
 
  private:
   struct _KeyInfo {
+    // Indices in smems_.
     std::vector<int> indices_in_collectors;
     std::vector<std::string> keys;
+    int last_collector = -1;
   };
 
   Extractor extractor_;
   std::vector<std::unique_ptr<GameStateCollector>> collectors_;
+  // All the slots of collectors_, by SharedMemOptions::getIdx().
+  std::vector<SharedMem*> smems_;
   std::unordered_map<std::string, _KeyInfo> smem2keys_;
 
   void addKeys(const std::string& label, const std::vector<std::string>& keys) {
     _KeyInfo& info = smem2keys_[label];
     info.keys = keys;
-    info.indices_in_collectors.push_back(collectors_.size());
+    info.indices_in_collectors.push_back(smems_.size());
   }
 };
 
@@ -399,6 +526,17 @@ class CollectorContext {
     game_cb_ = cb;
   }
 
+  // With num_worker > 0, the games run as fibers on num_worker threads,
+  // instead of one thread each.
+  void setNumGameWorker(int num_worker) {
+    num_game_worker_ = num_worker;
+  }
+
+  // How games pick one of the collectors of a label.
+  void setRouting(comm::Routing routing) {
+    comm_.setRouting(routing);
+  }
+
   void setCBAfterGameStart(std::function<void()> cb) {
     cb_after_game_start_ = cb;
   }
@@ -409,13 +547,22 @@ class CollectorContext {
 
     game_threads_.clear();
     auto* client = getClient();
-    for (int i = 0; i < num_games_; ++i) {
-      game_threads_.emplace_back([i, client, this]() {
-        // assert(nice(19) == 19);
-        client->start();
-        game_cb_(i, client);
-        client->End();
-      });
+    auto run_game = [client, this](int i) {
+      // assert(nice(19) == 19);
+      client->start();
+      game_cb_(i, client);
+      client->End();
+    };
+
+    if (num_game_worker_ > 0) {
+      game_fibers_.reset(new concurrency::FiberPool(num_game_worker_));
+      for (int i = 0; i < num_games_; ++i) {
+        game_fibers_->spawn([i, run_game]() { run_game(i); });
+      }
+    } else {
+      for (int i = 0; i < num_games_; ++i) {
+        game_threads_.emplace_back([i, run_game]() { run_game(i); });
+      }
     }
 
     if (cb_after_game_start_ != nullptr) {
@@ -440,6 +587,9 @@ class CollectorContext {
     for (auto& p : game_threads_) {
       p.join();
     }
+    if (game_fibers_ != nullptr) {
+      game_fibers_->join();
+    }
 
     std::cout << "Stop all collectors ..." << std::endl;
     collectors_->stop();
@@ -465,9 +615,11 @@ class CollectorContext {
   std::unique_ptr<Collectors> collectors_;
 
   int num_games_ = 0;
+  int num_game_worker_ = 0;
   GameCallback game_cb_ = nullptr;
   std::function<void()> cb_after_game_start_ = nullptr;
   std::vector<std::thread> game_threads_;
+  std::unique_ptr<concurrency::FiberPool> game_fibers_;
 };
 
 class BatchContext {
@@ -46,6 +46,14 @@ class GameContext : public GCInterface {
     collectorContext_->setStartCallback(
         options_.num_game_thread,
         [this](int i, elf::GameClient*) { games_[i]->mainLoop(); });
+    collectorContext_->setNumGameWorker(options_.num_game_worker);
+
+    comm::Routing routing;
+    if (comm::parseRouting(options_.routing, &routing)) {
+      collectorContext_->setRouting(routing);
+    } else {
+      logger_->error("Unknown routing \"{}\", use random", options_.routing);
+    }
   }
 
   // Virtual functions for python.
@@ -83,6 +91,10 @@ class GameContext : public GCInterface {
     return collectorContext_->allocateSharedMem(options, keys, collect_func);
   }
 
+  std::string batchStats() const {
+    return collectorContext_->getCollectors()->batchStats();
+  }
+
   // Virtual functions for applications.
   Extractor& getExtractor() override {
     return collectorContext_->getCollectors()->getExtractor();
@@ -12,7 +12,9 @@
 #include <string>
 #include <unordered_map>
 #include <functional>
+#include <mutex>
 
+#include "batch_controller.h"
 #include "elf/interface/sharedmem_data.h"
 #include "elf/comm/comm.h"
 #include "elf/concurrency/ConcurrentQueue.h"
@@ -22,8 +24,8 @@ namespace elf {
 using Comm = typename comm::CommT<
     FuncsWithState*,
     true,
-    concurrency::ConcurrentQueue,
-    concurrency::ConcurrentQueue>;
+    concurrency::ConcurrentQueueHybrid,
+    concurrency::ConcurrentQueueHybrid>;
 // Message sent from client to server
 using Message = typename Comm::Message;
 using Server = typename Comm::Server;
@@ -66,10 +68,32 @@ class SharedMem {
     return smem_;
   }
 
+  // Slots of one collector fill and release their batches from different
+  // threads, but share a server, which runs one session at a time.
+  void setSessionMutex(std::mutex* mutex) {
+    sessionMutex_ = mutex;
+  }
+
+  // Shared by the slots of a collector.
+  void setBatchController(BatchController* controller) {
+    controller_ = controller;
+  }
+
   virtual ~SharedMem() = default;
 
  protected:
   SharedMemData smem_;
+  BatchController* controller_ = nullptr;
+
+  std::unique_lock<std::mutex> lockSession() {
+    if (sessionMutex_ == nullptr) {
+      return std::unique_lock<std::mutex>();
+    }
+    return std::unique_lock<std::mutex>(*sessionMutex_);
+  }
+
+ private:
+  std::mutex* sessionMutex_ = nullptr;
 };
 
 class SharedMemLocal : public SharedMem {
@@ -85,12 +109,20 @@ class SharedMemLocal : public SharedMem {
   }
 
   void start() override {
-    server_->RegServer(options().getRecvOptions().label);
+    // The slots of a collector share its server.
+    if (options().getSlotIdx() == 0) {
+      server_->RegServer(options().getRecvOptions().label);
+    }
   }
 
   void waitBatchFillMem() override {
     const auto& opt = options();
-    server_->waitBatch(opt.getRecvOptions(), &msgs_from_client_);
+    // Once stopping (min_batchsize = 0), the wait must not block.
+    if (controller_ != nullptr && opt.getMinBatchSize() > 0) {
+      controlled_waitBatch();
+    } else {
+      server_->waitBatch(opt.getRecvOptions(), &msgs_from_client_);
+    }
     size_t batchsize = 0;
     for (const Message& m : msgs_from_client_) {
       batchsize += m.data.size();
@@ -109,6 +141,7 @@ class SharedMemLocal : public SharedMem {
     // LOG(INFO) << "Receiver: Batch received. #batch = "
     //           << active_batch_size_ << std::endl;
 
+    auto lock = lockSession();
     if (opt.getTransferType() == SharedMemOptions::SERVER) {
       local_state2mem();
     } else {
@@ -117,6 +150,18 @@ class SharedMemLocal : public SharedMem {
   }
 
   void waitReplyReleaseBatch(comm::ReplyStatus batch_status) override {
+    if (controller_ != nullptr && smem_.getEffectiveBatchSize() > 0) {
+      controller_->onReplied(
+          smem_.getEffectiveBatchSize(),
+          std::chrono::duration_cast<std::chrono::microseconds>(
+              filled_ - firstPicked_)
+              .count(),
+          std::chrono::duration_cast<std::chrono::microseconds>(
+              BatchController::Clock::now() - filled_)
+              .count());
+    }
+
+    auto lock = lockSession();
     if (options().getTransferType() == SharedMemOptions::SERVER) {
       local_mem2state();
     } else {
@@ -138,6 +183,56 @@ class SharedMemLocal : public SharedMem {
   // Message could contain multiple states.
   std::vector<Message> msgs_from_client_;
 
+  BatchController::Clock::time_point firstPicked_;
+  BatchController::Clock::time_point filled_;
+
+  void controlled_waitBatch() {
+    using Clock = BatchController::Clock;
+    const BatchControl control = controller_->get();
+    comm::RecvOptions recv = options().getRecvOptions();
+
+    // Block for the first request, and take the ones already queued.
+    recv.wait_opt.min_batchsize = 1;
+    recv.wait_opt.timeout_usec = 1;
+    server_->waitBatch(recv, &msgs_from_client_);
+    firstPicked_ = Clock::now();
+
+    int batchsize = 0;
+    for (const Message& m : msgs_from_client_) {
+      batchsize += m.data.size();
+    }
+
+    // Then wait for more until the timeout.
+    std::vector<Message> more;
+    recv.wait_opt.min_batchsize = 0;
+    while (batchsize < control.min_batchsize &&
+           batchsize < options().getBatchSize()) {
+      int64_t remaining = control.timeout_usec -
+          std::chrono::duration_cast<std::chrono::microseconds>(
+              Clock::now() - firstPicked_)
+              .count();
+      if (remaining <= 0) {
+        break;
+      }
+      recv.wait_opt.batchsize = options().getBatchSize() - batchsize;
+      recv.wait_opt.timeout_usec = remaining;
+      server_->waitBatch(recv, &more);
+      if (more.empty()) {
+        break;
+      }
+      for (Message& m : more) {
+        m.base_idx += batchsize;
+        msgs_from_client_.push_back(m);
+      }
+      for (const Message& m : more) {
+        batchsize += m.data.size();
+      }
+    }
+
+    filled_ = Clock::now();
+    controller_->onFilled(batchsize);
+  }
+
   void local_state2mem() {
     // Send the state to shared memory.
     for (const Message& m : msgs_from_client_) {
@@ -189,6 +284,14 @@ class SharedMemLocal : public SharedMem {
 template <bool use_const>
 void FuncsWithStateT<use_const>::transfer(int msg_idx, SharedMemData_t smem)
     const {
+  for (size_t i = 0; i < numPlan_; ++i) {
+    const BoundPlan& b = _plan(i);
+    for (const auto& entry : b.plan->template entries<use_const>()) {
+      auto* anyp = smem[*entry.field];
+      assert(anyp != nullptr);
+      entry.call(entry.func, b.state, *anyp, msg_idx);
+    }
+  }
   for (const auto& p : funcs_) {
     auto* anyp = smem[p.first];
     assert(anyp != nullptr);
@@ -199,8 +302,8 @@ void FuncsWithStateT<use_const>::transfer(int msg_idx, SharedMemData_t smem)
 using BatchComm = comm::CommT<
     SharedMemData*,
     false,
-    concurrency::ConcurrentQueue,
-    concurrency::ConcurrentQueue>;
+    concurrency::ConcurrentQueueHybrid,
+    concurrency::ConcurrentQueueHybrid>;
 using BatchClient = typename BatchComm::Client;
 using BatchServer = typename BatchComm::Server;
 using BatchMessage = typename BatchComm::Message;
@@ -0,0 +1,114 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+
+#include "elf/base/batch_controller.h"
+
+using namespace elf;
+
+using Clock = BatchController::Clock;
+
+namespace {
+
+// Batches of 4 requests filled every 1000 usec: 0.004 requests per usec.
+void fill(BatchController* controller) {
+  Clock::time_point t = Clock::now();
+  for (int i = 0; i < 11; ++i) {
+    controller->onFilled(4, t + std::chrono::microseconds(1000 * i));
+  }
+}
+
+SharedMemOptions makeOptions(
+    int batchsize,
+    SharedMemOptions::BatchTarget target,
+    int latency_slo_usec = 0) {
+  SharedMemOptions opts("actor", batchsize);
+  opts.setBatchTarget(target, latency_slo_usec);
+  return opts;
+}
+
+} // namespace
+
+// Wait for the requests that come in during one inference.
+TEST(BatchControllerTest, testMaxThroughput) {
+  BatchController controller(
+      makeOptions(64, SharedMemOptions::MAX_THROUGHPUT));
+  EXPECT_EQ(controller.get().min_batchsize, 1);
+  EXPECT_EQ(controller.get().timeout_usec, 1);
+
+  // No rate yet.
+  controller.onReplied(4, 500, 2000);
+  EXPECT_EQ(controller.get().min_batchsize, 1);
+  EXPECT_EQ(controller.get().timeout_usec, 1);
+
+  fill(&controller);
+  controller.onReplied(4, 500, 2000);
+  EXPECT_EQ(controller.get().min_batchsize, 8);
+  EXPECT_EQ(controller.get().timeout_usec, 2000);
+
+  // The inference time is averaged: 0.9 * 2000 + 0.1 * 12000.
+  controller.onReplied(4, 500, 12000);
+  EXPECT_EQ(controller.get().min_batchsize, 12);
+  EXPECT_EQ(controller.get().timeout_usec, 3000);
+}
+
+TEST(BatchControllerTest, testBatchSizeClamped) {
+  BatchController controller(
+      makeOptions(16, SharedMemOptions::MAX_THROUGHPUT));
+  fill(&controller);
+  controller.onReplied(4, 0, 100000);
+  EXPECT_EQ(controller.get().min_batchsize, 16);
+  EXPECT_EQ(controller.get().timeout_usec, 100000);
+}
+
+// The wait is what the SLO leaves after the inference, and shrinks while the
+// p99 latency exceeds the SLO.
+TEST(BatchControllerTest, testLatencySLO) {
+  BatchController controller(
+      makeOptions(64, SharedMemOptions::LATENCY_SLO, 3000));
+  fill(&controller);
+  controller.onReplied(4, 500, 2000);
+  EXPECT_EQ(controller.get().min_batchsize, 4);
+  EXPECT_EQ(controller.get().timeout_usec, 1000);
+
+  BatchController slow(makeOptions(64, SharedMemOptions::LATENCY_SLO, 3000));
+  fill(&slow);
+  const int timeouts[] = {800, 640, 512};
+  for (int timeout : timeouts) {
+    // 5000 usec from pick up to reply.
+    slow.onReplied(4, 3000, 2000);
+    EXPECT_EQ(slow.get().timeout_usec, timeout);
+  }
+  EXPECT_EQ(slow.get().min_batchsize, 2);
+
+  // Back to the full wait once the slow requests are out of the window.
+  for (int i = 0; i < 300; ++i) {
+    slow.onReplied(4, 0, 2000);
+  }
+  EXPECT_EQ(slow.get().min_batchsize, 4);
+  EXPECT_EQ(slow.get().timeout_usec, 1000);
+}
+
+// An inference longer than the SLO leaves no time to wait.
+TEST(BatchControllerTest, testSLOBelowInference) {
+  BatchController controller(
+      makeOptions(64, SharedMemOptions::LATENCY_SLO, 1000));
+  fill(&controller);
+  controller.onReplied(4, 0, 2000);
+  EXPECT_EQ(controller.get().min_batchsize, 1);
+  EXPECT_EQ(controller.get().timeout_usec, 1);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
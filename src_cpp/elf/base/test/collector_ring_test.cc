@@ -0,0 +1,138 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "elf/base/context.h"
+
+using namespace elf;
+
+namespace {
+
+struct State {
+  int id = 0;
+  int reply = -1;
+};
+
+const int kNumGame = 48;
+const int kBatchSize = 16;
+const int kNumSlot = 3;
+const int kNumBatch = 300;
+// Requests per game stay below this, so that ids are unique.
+const int kMaxRequest = 1000000;
+
+// Games send their request id and expect twice of it back. The server replies
+// to kNumBatch batches from a collector with kNumSlot slots, then stops.
+// Every request it sees must reach its game exactly once.
+void runRing(SharedMemOptions::BatchTarget target) {
+  BatchContext batch;
+  CollectorContext context;
+  Extractor& e = context.getCollectors()->getExtractor();
+  e.addField<int32_t>("s").addExtent(kBatchSize).addFunction<State>(
+      [](const State& s, int32_t* p) { *p = s.id; });
+  e.addField<int32_t>("a").addExtent(kBatchSize).addFunction<State>(
+      [](State& s, const int32_t* p) { s.reply = *p; });
+
+  // Once the server stops replying, batches come back with stale replies.
+  std::atomic<bool> serving(true);
+  std::atomic<int> num_wrong(0);
+  std::vector<std::vector<int>> replied(kNumGame);
+  context.setStartCallback(kNumGame, [&](int g, GameClient* client) {
+    GameClientInterface* c = client;
+    for (int k = 0; !client->DoStopGames(); ++k) {
+      State s;
+      s.id = g * kMaxRequest + k;
+      if (!c->sendWait(std::string("act"), s)) {
+        continue;
+      }
+      if (s.reply == 2 * s.id) {
+        replied[g].push_back(s.id);
+      } else if (serving) {
+        num_wrong++;
+      }
+    }
+  });
+
+  SharedMemOptions opts("act", kBatchSize);
+  opts.setNumSlot(kNumSlot);
+  opts.setBatchTarget(target);
+  opts.setTransferType(SharedMemOptions::SERVER);
+  std::vector<std::vector<int32_t>> s(kNumSlot), a(kNumSlot);
+  BatchClient* client = batch.getClient();
+  for (int i = 0; i < kNumSlot; ++i) {
+    SharedMemData& smem = context.allocateSharedMem(
+        opts, {"s", "a"}, [client](SharedMemData* d) {
+          return client->sendWait(d, {""});
+        });
+    ASSERT_EQ(smem.getSharedMemOptionsC().getIdx(), i);
+    s[i].resize(kBatchSize);
+    a[i].resize(kBatchSize);
+    smem["s"]->setData(PointerInfo{
+        reinterpret_cast<uint64_t>(s[i].data()), "int32_t", {sizeof(int32_t)}});
+    smem["a"]->setData(PointerInfo{
+        reinterpret_cast<uint64_t>(a[i].data()), "int32_t", {sizeof(int32_t)}});
+  }
+  ASSERT_EQ(context.getCollectors()->size(), 1u);
+
+  Waiter* waiter = batch.getWaiter();
+  context.start();
+  batch.start();
+  std::vector<int> seen;
+  std::set<int> slots;
+  for (int n = 0; n < kNumBatch; ++n) {
+    SharedMemData* d = waiter->wait();
+    int idx = d->getSharedMemOptionsC().getIdx();
+    slots.insert(idx);
+    for (size_t j = 0; j < d->getEffectiveBatchSize(); ++j) {
+      seen.push_back(s[idx][j]);
+      a[idx][j] = 2 * s[idx][j];
+    }
+    // The other slots fill meanwhile.
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+    waiter->step();
+  }
+  serving = false;
+  // Hangs if a slot is never given back to the collector.
+  batch.stop(&context);
+
+  EXPECT_EQ(num_wrong.load(), 0);
+  EXPECT_EQ(slots.size(), (size_t)kNumSlot);
+
+  std::vector<int> all;
+  for (const auto& ids : replied) {
+    all.insert(all.end(), ids.begin(), ids.end());
+  }
+  std::sort(all.begin(), all.end());
+  std::sort(seen.begin(), seen.end());
+  EXPECT_TRUE(std::adjacent_find(seen.begin(), seen.end()) == seen.end());
+  EXPECT_EQ(all, seen);
+}
+
+} // namespace
+
+TEST(CollectorRingTest, testFixed) {
+  runRing(SharedMemOptions::FIXED);
+}
+
+TEST(CollectorRingTest, testMaxThroughput) {
+  runRing(SharedMemOptions::MAX_THROUGHPUT);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
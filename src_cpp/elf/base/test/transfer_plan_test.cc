@@ -0,0 +1,211 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "elf/interface/game_client_interface.h"
+#include "elf/base/sharedmem.h"
+
+using namespace elf;
+
+namespace {
+
+struct State {
+  float feature[3] = {0, 0, 0};
+  int move = 0;
+};
+
+struct Reply {
+  int action = -1;
+  float value = 0;
+};
+
+const int kBatchSize = 4;
+
+// Fields "s" (features) and "move" from State, "a" and "V" to Reply, and
+// "other" that no shared memory uses.
+class TransferPlanTest : public testing::Test {
+ protected:
+  Extractor extractor_;
+  std::unordered_map<std::string, std::vector<std::string>> smemKeys_{
+      {"actor", {"s", "move", "a", "V"}}};
+
+  std::vector<float> s_, V_, other_;
+  std::vector<int> move_, a_;
+
+  void SetUp() override {
+    extractor_.addField<float>("s")
+        .addExtents(kBatchSize, {kBatchSize, 3})
+        .addFunction<State>([](const State& s, float* p) {
+          for (int i = 0; i < 3; ++i) {
+            p[i] = s.feature[i];
+          }
+        });
+    extractor_.addField<int>("move").addExtent(kBatchSize).addFunction<State>(
+        [](const State& s, int* p) { *p = s.move; });
+    extractor_.addField<int>("a").addExtent(kBatchSize).addFunction<Reply>(
+        [](Reply& r, const int* p) { r.action = *p; });
+    extractor_.addField<float>("V").addExtent(kBatchSize).addFunction<Reply>(
+        [](Reply& r, const float* p) { r.value = *p; });
+    extractor_.addField<float>("other")
+        .addExtent(kBatchSize)
+        .addFunction<State>([](const State&, float* p) { *p = -1; });
+  }
+
+  Binder binder() {
+    return Binder(extractor_, [this](const std::string& name) {
+      auto it = smemKeys_.find(name);
+      return it == smemKeys_.end() ? nullptr : &it->second;
+    });
+  }
+
+  // Shared memory of the "actor" fields, with the replies filled in.
+  SharedMemData smem() {
+    s_.assign(kBatchSize * 3, 0);
+    move_.assign(kBatchSize, 0);
+    a_.clear();
+    V_.clear();
+    for (int i = 0; i < kBatchSize; ++i) {
+      a_.push_back(100 + i);
+      V_.push_back(0.5f * i);
+    }
+
+    std::unordered_map<std::string, AnyP> mem =
+        extractor_.getAnyP(smemKeys_["actor"]);
+    _setData(&mem, "s", s_.data(), {3 * sizeof(float), sizeof(float)});
+    _setData(&mem, "move", move_.data(), {sizeof(int)});
+    _setData(&mem, "a", a_.data(), {sizeof(int)});
+    _setData(&mem, "V", V_.data(), {sizeof(float)});
+    return SharedMemData(SharedMemOptions("actor", kBatchSize), mem);
+  }
+
+  // The functions of each field of the shared memory, bound to s one by one.
+  template <typename S>
+  FuncsWithState bindByKey(S* s) {
+    FuncsWithState funcs;
+    for (const auto& key : smemKeys_["actor"]) {
+      const FuncMapBase* f = extractor_.getFunctions(key);
+      funcs.state_to_mem_funcs.addFunction(key, f->BindStateToStateToMemFunc(*s));
+      funcs.mem_to_state_funcs.addFunction(key, f->BindStateToMemToStateFunc(*s));
+    }
+    return funcs;
+  }
+
+ private:
+  template <typename T>
+  static void _setData(
+      std::unordered_map<std::string, AnyP>* mem,
+      const std::string& key,
+      T* p,
+      const std::vector<int>& stride) {
+    PointerInfo info;
+    info.p = reinterpret_cast<uint64_t>(p);
+    info.type = TypeNameT<T>::name();
+    info.stride = stride;
+    mem->at(key).setData(info);
+  }
+};
+
+} // namespace
+
+TEST_F(TransferPlanTest, testStateToMem) {
+  std::vector<State> states(kBatchSize);
+  for (int i = 0; i < kBatchSize; ++i) {
+    states[i].feature[0] = i;
+    states[i].feature[1] = 10 * i;
+    states[i].feature[2] = -i;
+    states[i].move = 7 * i;
+  }
+
+  SharedMemData by_plan = smem();
+  Binder b = binder();
+  for (int i = 0; i < kBatchSize; ++i) {
+    b.BindStateToFunctions({"actor"}, &states[i])
+        .state_to_mem_funcs.transfer(i, by_plan);
+  }
+  std::vector<float> s = s_;
+  std::vector<int> move = move_;
+
+  SharedMemData by_key = smem();
+  for (int i = 0; i < kBatchSize; ++i) {
+    bindByKey(&states[i]).state_to_mem_funcs.transfer(i, by_key);
+  }
+
+  EXPECT_EQ(s, s_);
+  EXPECT_EQ(move, move_);
+  EXPECT_EQ(s[3 * 2 + 1], 20);
+  EXPECT_EQ(move[3], 21);
+}
+
+TEST_F(TransferPlanTest, testMemToState) {
+  SharedMemData mem = smem();
+  Binder b = binder();
+
+  std::vector<Reply> by_plan(kBatchSize), by_key(kBatchSize);
+  std::vector<Reply*> p_by_plan;
+  for (auto& r : by_plan) {
+    p_by_plan.push_back(&r);
+  }
+  std::vector<FuncsWithState> funcs =
+      b.BindStateToFunctions({"actor"}, p_by_plan);
+  for (int i = 0; i < kBatchSize; ++i) {
+    funcs[i].mem_to_state_funcs.transfer(i, mem);
+    bindByKey(&by_key[i]).mem_to_state_funcs.transfer(i, mem);
+  }
+
+  for (int i = 0; i < kBatchSize; ++i) {
+    EXPECT_EQ(by_plan[i].action, 100 + i);
+    EXPECT_EQ(by_plan[i].action, by_key[i].action);
+    EXPECT_EQ(by_plan[i].value, by_key[i].value);
+  }
+}
+
+TEST_F(TransferPlanTest, testCachedPlan) {
+  Binder b = binder();
+  CachedPlanT<const State> plan({"actor"});
+  const TransferPlan* p = plan.get(b);
+
+  EXPECT_EQ(p, b.getPlan<const State>({"actor"}));
+  EXPECT_EQ(p, plan.get(binder()));
+  EXPECT_NE(p, b.getPlan<Reply>({"actor"}));
+  // "other" is not in the shared memory.
+  EXPECT_EQ(p->state_to_mem.size(), 2U);
+  EXPECT_TRUE(p->mem_to_state.empty());
+}
+
+// A label whose keys change gets a new plan, and binders made before see it.
+TEST_F(TransferPlanTest, testKeysChanged) {
+  Binder b = binder();
+  const TransferPlan* p = b.getPlan<const State>({"actor"});
+  EXPECT_EQ(p->state_to_mem.size(), 2U);
+
+  smemKeys_["actor"] = {"s", "other"};
+  const TransferPlan* q = b.getPlan<const State>({"actor"});
+  EXPECT_NE(p, q);
+  ASSERT_EQ(q->state_to_mem.size(), 2U);
+  // The first plan is still valid.
+  EXPECT_EQ(p->state_to_mem.size(), 2U);
+
+  std::vector<std::string> names;
+  for (const auto& e : q->state_to_mem) {
+    names.push_back(e.field->getName());
+  }
+  std::sort(names.begin(), names.end());
+  EXPECT_EQ(names, std::vector<std::string>({"other", "s"}));
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
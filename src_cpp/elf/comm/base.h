@@ -9,6 +9,29 @@ namespace comm {
 enum ReplyStatus { DONE_ONE_JOB = 0, SUCCESS, FAILED, UNKNOWN };
 using SuccessCallback = std::function<void ()>;
 
+// How a client picks one of the servers that have a label.
+//   RANDOM: uniformly.
+//   TWO_CHOICES: the one with fewer pending requests out of two random ones.
+//   SHORTEST_QUEUE: the one with the fewest pending requests.
+//   STICKY: always the same one for a given thread (or fiber), so that a
+//     game sticks to a collector.
+enum Routing { RANDOM = 0, TWO_CHOICES, SHORTEST_QUEUE, STICKY };
+
+inline bool parseRouting(const std::string& s, Routing* routing) {
+  if (s == "random") {
+    *routing = RANDOM;
+  } else if (s == "two_choices") {
+    *routing = TWO_CHOICES;
+  } else if (s == "shortest_queue") {
+    *routing = SHORTEST_QUEUE;
+  } else if (s == "sticky") {
+    *routing = STICKY;
+  } else {
+    return false;
+  }
+  return true;
+}
+
 struct WaitOptions {
   int batchsize = 1;
 
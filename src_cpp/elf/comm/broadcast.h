@@ -8,12 +8,14 @@
 
 #pragma once
 
+#include <atomic>
 #include <chrono>
 #include <iostream>
 #include <sstream>
 #include <vector>
 
 #include "elf/concurrency/Counter.h"
+#include "elf/utils/member_check.h"
 
 #include "base.h"
 
@@ -106,7 +108,7 @@ class NodeT {
         break;
 
       if ((int)(message.data.size() + data_count) > opt.batchsize) {
-        unpop_msg(message);
+        unpop_msg(std::move(message));
         break;
       }
 
@@ -114,8 +116,9 @@ class NodeT {
       assert(!message.data.empty());
 
       message.base_idx = data_count;
-      messages->push_back(message);
       data_count += message.data.size();
+      pending_ -= message.data.size();
+      messages->push_back(std::move(message));
 
       // LOG(INFO) << "Get a message, #m: "
       //           << data_count << std::endl;
@@ -131,44 +134,78 @@ class NodeT {
   }
 
   void EnqueueMessage(RecvMsg&& msg) {
+    pending_ += msg.data.size();
     q_.push(msg);
   }
 
+  // #Data sent to this node and not taken into a batch yet.
+  int numPending() const {
+    return pending_.load(std::memory_order_relaxed);
+  }
+
  private:
   int n_ = 0;
+  std::atomic<int> pending_{0};
 
-  RecvMsg unprocessed_msg_;
+  // Messages taken from q_ and not handed out yet: received_[nextReceived_:].
+  std::vector<RecvMsg> received_;
+  size_t nextReceived_ = 0;
   // Concurrent Queue.
   MyQueue<RecvMsg> q_;
 
   elf::concurrency::Counter<int> replyCount_;
 
-  void unpop_msg(const RecvMsg& msg) {
-    assert(unprocessed_msg_.data.empty());
-    unprocessed_msg_ = msg;
+  // Puts back the last message handed out by get_msg().
+  void unpop_msg(RecvMsg&& msg) {
+    assert(nextReceived_ > 0);
+    received_[--nextReceived_] = std::move(msg);
   }
 
   bool get_msg(const WaitOptions& opt, bool use_timeout, RecvMsg* msg) {
-    if (!unprocessed_msg_.data.empty()) {
-      *msg = unprocessed_msg_;
-      unprocessed_msg_.data.clear();
+    if (nextReceived_ == received_.size()) {
+      received_.clear();
+      nextReceived_ = 0;
+      if (!receive(opt, use_timeout)) {
+        return false;
+      }
+    }
+    *msg = std::move(received_[nextReceived_++]);
+    return true;
+  }
+
+  // Take at least one message from q_: all the waiting ones at once if the
+  // queue can, else one (which may block).
+  bool receive(const WaitOptions& opt, bool use_timeout) {
+    if (pop_bulk(q_, opt.batchsize) > 0) {
       return true;
     }
+    RecvMsg msg;
     if (use_timeout) {
-      // use timeout.
-      // LOG(INFO) << "Timeout. " << hex << this
-      //           << dec
-      //           << ", opt.timeout_usec = "
-      //           << opt.timeout_usec
-      //           << ", messages->size() = "
-      //           << messages->size()
-      //           << std::endl;
-      return q_.pop(msg, std::chrono::microseconds(opt.timeout_usec));
+      if (!q_.pop(&msg, std::chrono::microseconds(opt.timeout_usec))) {
+        return false;
+      }
     } else {
       // This will block.
-      q_.pop(msg);
-      return true;
+      q_.pop(&msg);
     }
+    received_.push_back(std::move(msg));
+    return true;
+  }
+
+  MEMBER_FUNC_CHECK(pop_bulk)
+  template <
+      typename Q,
+      typename std::enable_if<has_func_pop_bulk<Q>::value>::type* U = nullptr>
+  size_t pop_bulk(Q& q, size_t max_count) {
+    return q.pop_bulk(&received_, max_count);
+  }
+
+  template <
+      typename Q,
+      typename std::enable_if<!has_func_pop_bulk<Q>::value>::type* U =
+          nullptr>
+  size_t pop_bulk(Q&, size_t) {
+    return 0;
   }
 };
 
@@ -8,9 +8,12 @@
 
 #pragma once
 
+#include <atomic>
 #include <cassert>
+#include <functional>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <random>
 #include <string>
 #include <thread>
@@ -19,6 +22,7 @@
 
 #include <tbb/concurrent_hash_map.h>
 
+#include "elf/concurrency/Fiber.h"
 #include "elf/concurrency/TBBHashers.h"
 
 #include "base.h"
@@ -267,7 +271,7 @@ class CommInternalT {
     CommInternal* p_;
   };
 
- private:
+ protected:
   ServerNode* server(Id id) {
     typename ServerMap::accessor elem;
     bool uninitialized = servers_.insert(elem, id);
@@ -290,7 +294,8 @@ class CommInternalT {
 ///     `RegServer`
 ///  3. When the Client call `sendWait`. it also needs to specify a set of
 ///     server labels. If there are multiple servers with the same label,
-///     a server is chosen by uniform random sampling.
+///     a server is chosen according to `setRouting` (by default, by uniform
+///     random sampling).
 template <
     typename Data,
     bool kExpectReply,
@@ -314,10 +319,22 @@ class CommT : public CommInternalT<
   using Message = typename CommInternal::ClientToServerMsg;
   using Function = typename CommInternal::ReplyFunction;
 
+ private:
+  // The servers of a label. Nodes are kept along with the ids, so that
+  // routing reads their load without a lookup in the server map.
+  struct _Servers {
+    std::vector<Id> ids;
+    std::vector<typename CommInternal::ServerNode*> nodes;
+
+    int numPending(size_t i) const {
+      return nodes[i]->numPending();
+    }
+  };
+
+ public:
   class Client : public CommInternal::Client {
    public:
-    explicit Client(Comm* pp)
-        : CommInternal::Client(pp), pp_(pp), rng_(time(NULL)) {}
+    explicit Client(Comm* pp) : CommInternal::Client(pp), pp_(pp) {}
 
     ReplyStatus sendWait(Data data, const std::vector<std::string>& labels) {
       return CommInternal::Client::sendWait(
@@ -348,7 +365,61 @@ class CommT : public CommInternalT<
 
    private:
     Comm* pp_;
-    std::mt19937 rng_;
+
+    // A client is shared by the game threads.
+    static std::mt19937& rng() {
+      static thread_local std::mt19937 rng(
+          time(NULL) + std::hash<Id>()(std::this_thread::get_id()));
+      return rng;
+    }
+
+    Id pick(const _Servers& servers) {
+      const std::vector<Id>& ids = servers.ids;
+      if (ids.size() == 1) {
+        return ids[0];
+      }
+      switch (pp_->routing_.load(std::memory_order_relaxed)) {
+        case TWO_CHOICES: {
+          size_t i = rng()() % ids.size();
+          size_t j = rng()() % (ids.size() - 1);
+          j += j >= i;
+          return servers.numPending(j) < servers.numPending(i) ? ids[j]
+                                                               : ids[i];
+        }
+        case SHORTEST_QUEUE: {
+          // Start anywhere, so that ties do not all go to the first one.
+          size_t start = rng()() % ids.size();
+          size_t best = start;
+          int best_pending = servers.numPending(start);
+          for (size_t k = 1; k < ids.size(); ++k) {
+            size_t i = (start + k) % ids.size();
+            int pending = servers.numPending(i);
+            if (pending < best_pending) {
+              best = i;
+              best_pending = pending;
+            }
+          }
+          return ids[best];
+        }
+        case STICKY:
+          return ids[stickyKey() % ids.size()];
+        case RANDOM:
+        default:
+          return ids[rng()() % ids.size()];
+      }
+    }
+
+    // Threads (and fibers) are numbered in the order they first send, so
+    // that they spread evenly over the servers.
+    static size_t stickyKey() {
+      const elf::concurrency::Fiber* fiber = elf::concurrency::Fiber::current();
+      if (fiber != nullptr) {
+        return fiber->id();
+      }
+      static std::atomic<size_t> next_key{0};
+      static thread_local size_t key = next_key++;
+      return key;
+    }
 
     std::vector<Id> label2server(const std::vector<std::string>& labels) {
       assert(!labels.empty());
@@ -363,12 +434,9 @@ class CommT : public CommInternalT<
           std::cout << "WARNING! no servers has the label: \"" << label << "\""
                     << std::endl;
         } else {
-          const std::vector<Id>& ids = elem->second;
-          // Randomly pick one of the label.
           // Note that there is no lock needed since only
           // read access is requested.
-          const int idx = rng_() % ids.size();
-          server_ids.push_back(ids.at(idx));
+          server_ids.push_back(pick(elem->second));
         }
       }
 
@@ -383,9 +451,10 @@ class CommT : public CommInternalT<
     // TODO: Put these logic to a separate place.
     void RegServer(const std::string& label) {
       std::lock_guard<std::mutex> lock(pp_->register_mutex_);
-      ServerLabelMap::accessor elem;
+      typename ServerLabelMap::accessor elem;
       pp_->serverLabels_.insert(elem, label);
-      elem->second.push_back(std::this_thread::get_id());
+      elem->second.ids.push_back(std::this_thread::get_id());
+      elem->second.nodes.push_back(pp_->server(std::this_thread::get_id()));
       counter_.increment();
     }
 
@@ -404,6 +473,22 @@ class CommT : public CommInternalT<
     elf::concurrency::Counter<int> counter_;
   };
 
+  void setRouting(Routing routing) {
+    routing_ = routing;
+  }
+
+  // #Requests waiting for each server of a label, in registration order.
+  std::vector<int> numPending(const std::string& label) const {
+    std::vector<int> pending;
+    typename ServerLabelMap::const_accessor elem;
+    if (serverLabels_.find(elem, label)) {
+      for (size_t i = 0; i < elem->second.ids.size(); ++i) {
+        pending.push_back(elem->second.numPending(i));
+      }
+    }
+    return pending;
+  }
+
   // Create and return a client object
   std::unique_ptr<Client> getClient() {
     return std::unique_ptr<Client>(new Client(this));
@@ -415,11 +500,11 @@ class CommT : public CommInternalT<
   }
 
  private:
-  using ServerLabelMap =
-      tbb::concurrent_hash_map<std::string, std::vector<Id>>;
+  using ServerLabelMap = tbb::concurrent_hash_map<std::string, _Servers>;
 
   ServerLabelMap serverLabels_;
   std::mutex register_mutex_;
+  std::atomic<Routing> routing_{RANDOM};
 };
 
 } // namespace comm
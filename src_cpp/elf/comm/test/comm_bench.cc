@@ -0,0 +1,243 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Batch throughput of CommT with each queue. Games (threads) send one
+// request at a time and wait for the reply; servers take batches of them,
+// hold each batch for infer_usec (the inference), then release it. Prints
+// one line per queue, configuration and repetition, as JSON (default) or
+// CSV:
+//
+//   bench_cpp_elf_comm --queue=moody,hybrid --num_game=64 --infer_usec=0,500
+//
+// Run with --help for the flags and their defaults.
+
+#include <stdlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "elf/comm/comm.h"
+#include "elf/concurrency/ConcurrentQueue.h"
+
+using json = nlohmann::json;
+
+struct Flag {
+  std::string value;
+  std::string help;
+};
+
+static std::map<std::string, Flag> defaultFlags() {
+  return {
+      {"queue", {"moody,hybrid", "Queues of the comm: moody, hybrid, tbb"}},
+      {"num_game", {"64", "Games, each on its own thread (list)"}},
+      {"num_server", {"1", "Servers, each on its own thread (list)"}},
+      {"batchsize", {"16", "Requests per batch"}},
+      {"timeout_usec", {"1000", "Wait for an incomplete batch"}},
+      {"infer_usec", {"0,500", "Time a server holds a batch (list)"}},
+      {"num_batch", {"5000", "Batches per run"}},
+      {"num_repeat", {"3", "Runs per configuration"}},
+      {"format", {"json", "json or csv"}},
+  };
+}
+
+static std::vector<double> parseList(const std::string& s) {
+  std::vector<double> values;
+  std::stringstream ss(s);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    values.push_back(atof(item.c_str()));
+  }
+  return values;
+}
+
+struct Config {
+  int num_game = 0;
+  int num_server = 0;
+  int batchsize = 0;
+  int timeout_usec = 0;
+  int infer_usec = 0;
+  int num_batch = 0;
+};
+
+struct Result {
+  double sec = 0;
+  int num_batch = 0;
+  int num_request = 0;
+};
+
+template <template <typename> class Queue>
+static Result run(const Config& cfg) {
+  using Comm = comm::CommT<int, false, Queue, Queue>;
+  Comm comm;
+  std::atomic<int> num_registered(0);
+  std::atomic<int> num_batch(0);
+  std::atomic<int> num_request(0);
+  std::atomic<int> num_game_left(cfg.num_game);
+  std::atomic<bool> done(false);
+
+  std::vector<std::thread> servers;
+  for (int i = 0; i < cfg.num_server; ++i) {
+    servers.emplace_back([&]() {
+      auto server = comm.getServer();
+      server->RegServer("s");
+      num_registered++;
+
+      comm::RecvOptions options("s", cfg.batchsize, cfg.timeout_usec);
+      std::vector<typename Comm::Message> batch;
+      // Serves until every game has stopped, so that none is left waiting.
+      while (num_game_left > 0) {
+        server->waitBatch(options, &batch);
+        if (batch.empty()) {
+          continue;
+        }
+        if (cfg.infer_usec > 0) {
+          std::this_thread::sleep_for(
+              std::chrono::microseconds(cfg.infer_usec));
+        }
+        if (!done) {
+          num_request += batch.size();
+          if (++num_batch >= cfg.num_batch) {
+            done = true;
+          }
+        }
+        server->ReleaseBatch(batch, comm::SUCCESS);
+      }
+    });
+  }
+  while (num_registered < cfg.num_server) {
+    std::this_thread::yield();
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  auto client = comm.getClient();
+  std::vector<std::thread> games;
+  for (int g = 0; g < cfg.num_game; ++g) {
+    games.emplace_back([&, g]() {
+      while (!done) {
+        client->sendWait(g, {"s"});
+      }
+      num_game_left--;
+    });
+  }
+  for (auto& t : games) {
+    t.join();
+  }
+  std::chrono::duration<double> dur = std::chrono::steady_clock::now() - start;
+  for (auto& t : servers) {
+    t.join();
+  }
+
+  Result r;
+  r.sec = dur.count();
+  r.num_batch = num_batch;
+  r.num_request = num_request;
+  return r;
+}
+
+static Result run(const std::string& queue, const Config& cfg) {
+  if (queue == "moody") {
+    return run<elf::concurrency::ConcurrentQueueMoodyCamel>(cfg);
+  } else if (queue == "hybrid") {
+    return run<elf::concurrency::ConcurrentQueueHybrid>(cfg);
+  } else if (queue == "tbb") {
+    return run<elf::concurrency::ConcurrentQueueTBB>(cfg);
+  }
+  std::cout << "Unknown queue " << queue << std::endl;
+  exit(1);
+}
+
+int main(int argc, char** argv) {
+  std::map<std::string, Flag> flags = defaultFlags();
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    size_t eq = arg.find('=');
+    if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos ||
+        flags.find(arg.substr(2, eq - 2)) == flags.end()) {
+      std::cout << "Usage: " << argv[0] << " [--flag=value ...]" << std::endl;
+      for (const auto& f : flags) {
+        std::cout << "  --" << f.first << " (" << f.second.value
+                  << "): " << f.second.help << std::endl;
+      }
+      return arg == "--help" ? 0 : 1;
+    }
+    flags[arg.substr(2, eq - 2)].value = arg.substr(eq + 1);
+  }
+
+  auto flag = [&flags](const std::string& key) {
+    return atof(flags[key].value.c_str());
+  };
+  const bool csv = flags["format"].value == "csv";
+  const int num_repeat = flag("num_repeat");
+
+  std::vector<std::string> queues;
+  {
+    std::stringstream ss(flags["queue"].value);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+      queues.push_back(item);
+    }
+  }
+
+  if (csv) {
+    std::cout << "queue,num_game,num_server,infer_usec,repeat,num_batch,"
+              << "sec,batches_per_sec,avg_batchsize" << std::endl;
+  }
+
+  for (const std::string& queue : queues) {
+    for (double num_game : parseList(flags["num_game"].value)) {
+      for (double num_server : parseList(flags["num_server"].value)) {
+        for (double infer_usec : parseList(flags["infer_usec"].value)) {
+          Config cfg;
+          cfg.num_game = num_game;
+          cfg.num_server = num_server;
+          cfg.batchsize = flag("batchsize");
+          cfg.timeout_usec = flag("timeout_usec");
+          cfg.infer_usec = infer_usec;
+          cfg.num_batch = flag("num_batch");
+
+          for (int repeat = 0; repeat < num_repeat; ++repeat) {
+            Result r = run(queue, cfg);
+            double per_sec = r.num_batch / r.sec;
+            double avg_batchsize =
+                static_cast<double>(r.num_request) / r.num_batch;
+
+            if (csv) {
+              std::cout << queue << "," << num_game << "," << num_server
+                        << "," << infer_usec << "," << repeat << ","
+                        << r.num_batch << "," << r.sec << "," << per_sec
+                        << "," << avg_batchsize << std::endl;
+            } else {
+              json j;
+              j["queue"] = queue;
+              j["num_game"] = cfg.num_game;
+              j["num_server"] = cfg.num_server;
+              j["batchsize"] = cfg.batchsize;
+              j["timeout_usec"] = cfg.timeout_usec;
+              j["infer_usec"] = cfg.infer_usec;
+              j["repeat"] = repeat;
+              j["num_batch"] = r.num_batch;
+              j["sec"] = r.sec;
+              j["batches_per_sec"] = per_sec;
+              j["avg_batchsize"] = avg_batchsize;
+              std::cout << j.dump() << std::endl;
+            }
+          }
+        }
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,239 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "elf/comm/comm.h"
+#include "elf/concurrency/ConcurrentQueue.h"
+#include "elf/concurrency/Counter.h"
+#include "elf/concurrency/Fiber.h"
+
+using elf::concurrency::ConcurrentQueueHybrid;
+using elf::concurrency::Counter;
+using elf::concurrency::FiberPool;
+using elf::concurrency::Switch;
+
+// Requests carry the index of the game that sends them.
+using Comm = comm::CommT<int, false, ConcurrentQueueHybrid, ConcurrentQueueHybrid>;
+
+// n servers of label "s", each on its own thread, registered in order (so
+// that server i is Comm::numPending("s")[i]). They take requests once
+// serve() is called, and release them right away.
+class Servers {
+ public:
+  Servers(Comm* comm, int n) : comm_(comm), received_(n) {
+    for (int i = 0; i < n; ++i) {
+      threads_.emplace_back([this, i]() { _run(i); });
+    }
+    registered_.waitUntilCount(n);
+  }
+
+  ~Servers() {
+    stop();
+  }
+
+  void serve() {
+    serving_.set(true);
+  }
+
+  void stop() {
+    serve();
+    done_ = true;
+    for (auto& t : threads_) {
+      t.join();
+    }
+    threads_.clear();
+  }
+
+  // #Requests taken by each server.
+  const std::vector<int>& received() const {
+    return received_;
+  }
+
+  // Servers that took requests from each game.
+  std::map<int, std::set<int>> routes() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return routes_;
+  }
+
+ private:
+  Comm* comm_;
+  std::vector<std::thread> threads_;
+  Counter<int> registered_;
+  Switch serving_;
+  std::atomic<bool> done_{false};
+
+  std::vector<int> received_;
+  std::mutex mutex_;
+  std::map<int, std::set<int>> routes_;
+
+  void _run(int i) {
+    auto server = comm_->getServer();
+    registered_.waitUntilCount(i);
+    server->RegServer("s");
+    registered_.increment();
+
+    serving_.waitUntilTrue();
+    comm::RecvOptions options("s", 1, 1000);
+    std::vector<Comm::Message> batch;
+    while (!done_) {
+      server->waitBatch(options, &batch);
+      for (const auto& msg : batch) {
+        received_[i] += msg.data.size();
+        std::lock_guard<std::mutex> lock(mutex_);
+        routes_[msg.data[0]].insert(i);
+      }
+      server->ReleaseBatch(batch, comm::SUCCESS);
+    }
+  }
+};
+
+static int sum(const std::vector<int>& v) {
+  return std::accumulate(v.begin(), v.end(), 0);
+}
+
+// Games send one request each, one after the other, while the servers are
+// not serving yet. Returns how the requests queued up.
+static std::vector<int> queueUp(Comm* comm, Servers* servers, int num_game) {
+  auto client = comm->getClient();
+  std::vector<std::thread> games;
+  for (int g = 0; g < num_game; ++g) {
+    games.emplace_back([&client, g]() { client->sendWait(g, {"s"}); });
+    while (sum(comm->numPending("s")) < g + 1) {
+      std::this_thread::yield();
+    }
+  }
+  std::vector<int> pending = comm->numPending("s");
+  servers->serve();
+  for (auto& t : games) {
+    t.join();
+  }
+  return pending;
+}
+
+TEST(CommRoutingTest, testRandom) {
+  const int kNumGame = 4;
+  const int kNumRequest = 100;
+  Comm comm;
+  Servers servers(&comm, 4);
+  servers.serve();
+
+  auto client = comm.getClient();
+  std::vector<std::thread> games;
+  for (int g = 0; g < kNumGame; ++g) {
+    games.emplace_back([&client, g]() {
+      for (int i = 0; i < kNumRequest; ++i) {
+        EXPECT_EQ(client->sendWait(g, {"s"}), comm::SUCCESS);
+      }
+    });
+  }
+  for (auto& t : games) {
+    t.join();
+  }
+  servers.stop();
+
+  EXPECT_EQ(sum(servers.received()), kNumGame * kNumRequest);
+  for (int n : servers.received()) {
+    EXPECT_GT(n, 0);
+  }
+}
+
+TEST(CommRoutingTest, testShortestQueue) {
+  Comm comm;
+  comm.setRouting(comm::SHORTEST_QUEUE);
+  Servers servers(&comm, 4);
+
+  EXPECT_EQ(queueUp(&comm, &servers, 8), std::vector<int>({2, 2, 2, 2}));
+  servers.stop();
+  EXPECT_EQ(servers.received(), std::vector<int>({2, 2, 2, 2}));
+}
+
+TEST(CommRoutingTest, testTwoChoices) {
+  // Out of two servers, the two choices are always both of them.
+  Comm comm;
+  comm.setRouting(comm::TWO_CHOICES);
+  Servers servers(&comm, 2);
+
+  EXPECT_EQ(queueUp(&comm, &servers, 6), std::vector<int>({3, 3}));
+  servers.stop();
+  EXPECT_EQ(servers.received(), std::vector<int>({3, 3}));
+}
+
+TEST(CommRoutingTest, testStickyThreads) {
+  const int kNumGame = 4;
+  Comm comm;
+  comm.setRouting(comm::STICKY);
+  Servers servers(&comm, 4);
+  servers.serve();
+
+  auto client = comm.getClient();
+  std::vector<std::thread> games;
+  for (int g = 0; g < kNumGame; ++g) {
+    games.emplace_back([&client, g]() {
+      for (int i = 0; i < 20; ++i) {
+        client->sendWait(g, {"s"});
+      }
+    });
+  }
+  for (auto& t : games) {
+    t.join();
+  }
+  servers.stop();
+
+  // Each game sticks to a server, and they do not all stick to the same.
+  std::set<int> used;
+  for (const auto& route : servers.routes()) {
+    ASSERT_EQ(route.second.size(), 1U);
+    used.insert(*route.second.begin());
+  }
+  EXPECT_EQ(used.size(), 4U);
+}
+
+TEST(CommRoutingTest, testStickyFibers) {
+  const int kNumGame = 8;
+  Comm comm;
+  comm.setRouting(comm::STICKY);
+  Servers servers(&comm, 4);
+  servers.serve();
+
+  auto client = comm.getClient();
+  {
+    FiberPool pool(1);
+    for (int g = 0; g < kNumGame; ++g) {
+      pool.spawn([&client, g]() {
+        for (int i = 0; i < 20; ++i) {
+          client->sendWait(g, {"s"});
+        }
+      });
+    }
+  }
+  servers.stop();
+
+  // The games of one thread spread evenly.
+  std::map<int, int> num_game;
+  for (const auto& route : servers.routes()) {
+    ASSERT_EQ(route.second.size(), 1U);
+    num_game[*route.second.begin()]++;
+  }
+  EXPECT_EQ(num_game, (std::map<int, int>{{0, 2}, {1, 2}, {2, 2}, {3, 2}}));
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
@@ -20,6 +20,9 @@
  *   If the timeout duration is reached, then we return false and do not
  *   store anything in the given pointer.
  *
+ * In a fiber (see Fiber.h), the blocking pops only suspend the fiber, and
+ * push() requeues it.
+ *
  * We define the following classes:
  *
  * ConcurrentQueueMoodyCamel<T> (aliased to ConcurrentQueue<T>)
@@ -27,22 +30,48 @@
  *
  * ConcurrentQueueTBB<T>
  *   An alternative implementation, backed by tbb::concurrent_queue.
+ *
+ * ConcurrentQueueHybrid<T>
+ *   A consumer spins for a while (adapted to how long values took to come
+ *   lately), then sleeps on a futex until a push. It takes all the pushed
+ *   values at once, and pops the next ones without synchronizing with the
+ *   producers. It also has
+ *
+ *   void push(T&& value)
+ *   size_t pop_bulk(std::vector<T>* values, size_t max_count)
+ *     Moves up to max_count values into values without blocking, and
+ *     returns how many.
  */
 
 #pragma once
 
+#include <assert.h>
+#include <limits.h>
+#include <time.h>
+
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <deque>
 #include <functional>
 #include <mutex>
+#include <thread>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 #include <blockingconcurrentqueue.h>
 #include <tbb/concurrent_queue.h>
 
+#include "Fiber.h"
+
 namespace elf {
 namespace concurrency {
 
@@ -57,6 +86,7 @@ class ConcurrentQueueMoodyCamel {
 
   void push(const T& value) {
     q_.enqueue(value);
+    fibers_.notifyOne();
   }
 
   void pop(T* value) {
@@ -67,6 +97,11 @@ class ConcurrentQueueMoodyCamel {
   void pop_no_thread_check(T* value) {
     if (_prefetch(value))
       return;
+    if (Fiber::inFiber()) {
+      Fiber::await(
+          [&]() { return q_.wait_dequeue_timed(*value, 0); }, fibers_);
+      return;
+    }
     q_.wait_dequeue(*value);
   }
 
@@ -75,12 +110,19 @@ class ConcurrentQueueMoodyCamel {
     _check_consumer();
     if (_prefetch(value))
       return true;
+    if (Fiber::inFiber()) {
+      return Fiber::await(
+          [&]() { return q_.wait_dequeue_timed(*value, 0); },
+          fibers_,
+          timeout);
+    }
     return q_.wait_dequeue_timed(*value, timeout);
   }
 
  private:
   using QueueT = moodycamel::BlockingConcurrentQueue<T>;
   QueueT q_;
+  FiberWaitList fibers_;
   std::deque<T> buffer_;
 
   std::thread::id single_consumer_;
@@ -117,20 +159,33 @@ class ConcurrentQueueMoodyCamelNoCheck {
 
   void push(const T& value) {
     q_.enqueue(value);
+    fibers_.notifyOne();
   }
 
   void pop(T* value) {
+    if (Fiber::inFiber()) {
+      Fiber::await(
+          [&]() { return q_.wait_dequeue_timed(*value, 0); }, fibers_);
+      return;
+    }
     q_.wait_dequeue(*value);
   }
 
   template <typename Rep, typename Period>
   bool pop(T* value, std::chrono::duration<Rep, Period> timeout) {
+    if (Fiber::inFiber()) {
+      return Fiber::await(
+          [&]() { return q_.wait_dequeue_timed(*value, 0); },
+          fibers_,
+          timeout);
+    }
     return q_.wait_dequeue_timed(*value, timeout);
   }
 
  private:
   using QueueT = moodycamel::BlockingConcurrentQueue<T>;
   QueueT q_;
+  FiberWaitList fibers_;
 };
 
 template <typename T>
@@ -140,9 +195,14 @@ class ConcurrentQueueTBB {
 
   void push(const T& value) {
     q_.push(value);
+    fibers_.notifyOne();
   }
 
   void pop(T* value) {
+    if (Fiber::inFiber()) {
+      Fiber::await([&]() { return q_.try_pop(*value); }, fibers_);
+      return;
+    }
     while (true) {
       if (q_.try_pop(*value)) {
         return;
@@ -152,6 +212,10 @@ class ConcurrentQueueTBB {
 
   template <typename Rep, typename Period>
   bool pop(T* value, std::chrono::duration<Rep, Period> timeout) {
+    if (Fiber::inFiber()) {
+      return Fiber::await(
+          [&]() { return q_.try_pop(*value); }, fibers_, timeout);
+    }
     if (!q_.try_pop(*value)) {
       // Sleep would not efficiently return the element.
       std::this_thread::sleep_for(timeout);
@@ -165,6 +229,206 @@ class ConcurrentQueueTBB {
  private:
   using QueueT = tbb::concurrent_queue<T>;
   QueueT q_;
+  FiberWaitList fibers_;
+};
+
+template <typename T>
+class ConcurrentQueueHybrid {
+ public:
+  using value_type = T;
+
+  void push(const T& value) {
+    push(T(value));
+  }
+
+  void push(T&& value) {
+    {
+      std::lock_guard<std::mutex> lock(inMutex_);
+      in_.push_back(std::move(value));
+      size_.fetch_add(1);
+    }
+    // Pairs with _park(): either the consumer sees the value, or we see it
+    // waiting.
+    if (numWaiter_.load() > 0) {
+      seq_.fetch_add(1);
+      _wake(&seq_);
+    }
+    fibers_.notifyOne();
+  }
+
+  void pop(T* value) {
+    if (_try_pop(value)) {
+      return;
+    }
+    if (Fiber::inFiber()) {
+      Fiber::await([&]() { return _try_pop(value); }, fibers_);
+      return;
+    }
+    while (!_spin_pop(value)) {
+      _park(nullptr);
+    }
+  }
+
+  template <typename Rep, typename Period>
+  bool pop(T* value, std::chrono::duration<Rep, Period> timeout) {
+    if (_try_pop(value)) {
+      return true;
+    }
+    if (Fiber::inFiber()) {
+      return Fiber::await(
+          [&]() { return _try_pop(value); }, fibers_, timeout);
+    }
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!_spin_pop(value)) {
+      auto remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(
+          deadline - std::chrono::steady_clock::now());
+      if (remaining.count() <= 0) {
+        return false;
+      }
+      _park(&remaining);
+    }
+    return true;
+  }
+
+  size_t pop_bulk(std::vector<T>* values, size_t max_count) {
+    std::lock_guard<std::mutex> lock(outMutex_);
+    if (out_.empty()) {
+      _refill();
+    }
+    size_t n = std::min(max_count, out_.size());
+    for (size_t i = 0; i < n; ++i) {
+      values->push_back(std::move(out_.front()));
+      out_.pop_front();
+    }
+    size_.fetch_sub(n);
+    return n;
+  }
+
+ private:
+  static constexpr int kMinSpin = 16;
+  static constexpr int kMaxSpin = 4096;
+
+  // Pushed values, taken all at once by the consumer.
+  std::mutex inMutex_;
+  std::deque<T> in_;
+  // Values not popped yet, in in_ or out_.
+  std::atomic<int> size_{0};
+
+  // Values taken by the consumer. Uncontended with a single consumer.
+  std::mutex outMutex_;
+  std::deque<T> out_;
+
+  // Futex word, bumped by pushes that see a waiter.
+  std::atomic<int> seq_{0};
+  std::atomic<int> numWaiter_{0};
+  // Consumers that wait in a fiber.
+  FiberWaitList fibers_;
+
+  // Iterations a consumer spins before it parks.
+  std::atomic<int> spin_{kMinSpin};
+
+  // Takes in_ (requires outMutex_ and out_ empty).
+  void _refill() {
+    if (size_.load(std::memory_order_relaxed) == 0) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(inMutex_);
+    out_.swap(in_);
+  }
+
+  bool _try_pop(T* value) {
+    std::lock_guard<std::mutex> lock(outMutex_);
+    if (out_.empty()) {
+      _refill();
+      if (out_.empty()) {
+        return false;
+      }
+    }
+    *value = std::move(out_.front());
+    out_.pop_front();
+    size_.fetch_sub(1);
+    return true;
+  }
+
+  // Spins up to twice as long as values took lately, and adapts to it.
+  bool _spin_pop(T* value) {
+    int spin = spin_.load(std::memory_order_relaxed);
+    int limit = std::min(2 * spin, kMaxSpin);
+    for (int i = 0; i < limit; ++i) {
+      if (size_.load(std::memory_order_relaxed) > 0 && _try_pop(value)) {
+        spin_.store(
+            std::max(kMinSpin, spin + (i - spin) / 8),
+            std::memory_order_relaxed);
+        return true;
+      }
+      _cpu_relax();
+    }
+    spin_.store(
+        std::max(kMinSpin, spin + (limit - spin) / 8),
+        std::memory_order_relaxed);
+    return _try_pop(value);
+  }
+
+  void _park(const std::chrono::nanoseconds* timeout) {
+    numWaiter_.fetch_add(1);
+    int seq = seq_.load();
+    if (size_.load() == 0) {
+      _wait(&seq_, seq, timeout);
+    }
+    numWaiter_.fetch_sub(1);
+  }
+
+  static void _cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#else
+    std::this_thread::yield();
+#endif
+  }
+
+  // Sleeps while *word == expected, at most timeout (if not nullptr).
+  static void _wait(
+      std::atomic<int>* word,
+      int expected,
+      const std::chrono::nanoseconds* timeout) {
+#if defined(__linux__)
+    static_assert(sizeof(std::atomic<int>) == sizeof(int), "futex word");
+    struct timespec ts;
+    if (timeout != nullptr) {
+      auto nsec = timeout->count();
+      ts.tv_sec = nsec / 1000000000;
+      ts.tv_nsec = nsec % 1000000000;
+    }
+    syscall(
+        SYS_futex,
+        reinterpret_cast<int*>(word),
+        FUTEX_WAIT_PRIVATE,
+        expected,
+        timeout != nullptr ? &ts : nullptr,
+        nullptr,
+        0);
+#else
+    (void)timeout;
+    if (word->load() == expected) {
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+#endif
+  }
+
+  static void _wake(std::atomic<int>* word) {
+#if defined(__linux__)
+    syscall(
+        SYS_futex,
+        reinterpret_cast<int*>(word),
+        FUTEX_WAKE_PRIVATE,
+        INT_MAX,
+        nullptr,
+        nullptr,
+        0);
+#else
+    (void)word;
+#endif
+  }
 };
 
 // Define the moodycamel queue to be the default implementation
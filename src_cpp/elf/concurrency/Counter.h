@@ -19,6 +19,8 @@
 #include <mutex>
 #include <thread>
 
+#include "Fiber.h"
+
 namespace elf {
 namespace concurrency {
 
@@ -38,14 +40,22 @@ class Counter {
     std::unique_lock<std::mutex> lock(mutex_);
     count_ = predicate(count_);
     cv_.notify_all();
+    // Under the mutex: a waiter may destroy the counter once it sees count_.
+    fibers_.notifyAll();
     return count_;
   }
 
   /**
    * This method blocks until predicate(count) is true, then returns the count.
+   * In a fiber, only the fiber waits.
    */
   template <typename PredicateT>
   T wait(PredicateT predicate) {
+    if (Fiber::inFiber()) {
+      T count;
+      Fiber::await([&]() { return _check(predicate, &count); }, fibers_);
+      return count;
+    }
     std::unique_lock<std::mutex> lock(mutex_);
     cv_.wait(lock, [this, &predicate]() { return predicate(this->count_); });
     return count_;
@@ -57,6 +67,15 @@ class Counter {
    */
   template <typename PredicateT, typename Rep, typename Period>
   T wait(PredicateT predicate, std::chrono::duration<Rep, Period> timeout) {
+    if (Fiber::inFiber()) {
+      T count;
+      if (!Fiber::await(
+              [&]() { return _check(predicate, &count); }, fibers_, timeout)) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        count = count_;
+      }
+      return count;
+    }
     std::unique_lock<std::mutex> lock(mutex_);
     cv_.wait_for(lock, timeout, [this, &predicate]() {
       return predicate(this->count_);
@@ -109,6 +128,14 @@ class Counter {
   T count_;
   std::mutex mutex_;
   std::condition_variable cv_;
+  FiberWaitList fibers_;
+
+  template <typename PredicateT>
+  bool _check(PredicateT& predicate, T* count) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    *count = count_;
+    return predicate(count_);
+  }
 };
 
 // Exempt the explicit instantiations in Counter.cc from compilation.
@@ -0,0 +1,550 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * Fiber is a function that runs on its own stack, and can suspend itself to
+ * let the other fibers of its thread run. FiberPool multiplexes many fibers
+ * on a few worker threads.
+ *
+ * static bool inFiber()
+ *   Whether the calling code runs in a fiber.
+ *
+ * static const Fiber* current()
+ *   The fiber the calling code runs in, or nullptr.
+ *
+ * size_t id() const
+ *   Fibers are numbered 0, 1, ... in the order they are created.
+ *
+ * static void await(Pred ready, FiberWaitList& waiters)
+ *   Suspends the calling fiber until ready() is true. The fiber waits on
+ *   waiters, and is only resumed to check ready() again when whoever makes
+ *   it true calls waiters.notifyOne() or notifyAll() afterwards. ready() is
+ *   not called again once it returned true (so it may pop what it waits for).
+ *
+ * static bool await(Pred ready, FiberWaitList& waiters, duration timeout)
+ *   Same as above, but gives up after the timeout. Returns whether ready()
+ *   became true.
+ *
+ * static void yield()
+ *   Lets the other fibers of the thread run.
+ *
+ * FiberWaitList
+ *   void notifyOne() / notifyAll()
+ *     Requeue one (resp. every) waiting fiber on its worker. Cheap when no
+ *     fiber waits.
+ *
+ * FiberPool(size_t num_thread, size_t stack_size)
+ *   Starts num_thread workers. A fiber stays on the worker it is given, which
+ *   resumes its fibers as they are requeued, and sleeps when none is.
+ *
+ * static FiberPool& get(size_t num_thread = 0)
+ *   The pool shared by the process. The first call creates it with
+ *   num_thread workers (0 = one per core); later calls ignore num_thread.
+ *
+ * void spawn(std::function<void()> func)
+ *   Runs func in a new fiber.
+ *
+ * void join()
+ *   Waits until all fibers are done, then joins the workers.
+ *
+ * Blocking waits (Counter, ConcurrentQueue, ParkingLot) call await() in a
+ * fiber, so code written for a thread of its own runs unchanged. Code that
+ * blocks by other means (e.g. a condition variable) blocks the whole worker.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#if defined(__SANITIZE_ADDRESS__)
+#include <sanitizer/common_interface_defs.h>
+#endif
+#if defined(__SANITIZE_THREAD__)
+#include <sanitizer/tsan_interface.h>
+#endif
+
+namespace elf {
+namespace concurrency {
+
+class Fiber;
+class FiberPool;
+
+class FiberWaitList {
+ public:
+  FiberWaitList() = default;
+  FiberWaitList(const FiberWaitList&) = delete;
+  FiberWaitList& operator=(const FiberWaitList&) = delete;
+
+  void notifyOne() {
+    _notify(1);
+  }
+
+  void notifyAll() {
+    _notify(SIZE_MAX);
+  }
+
+ private:
+  friend class Fiber;
+
+  std::mutex mutex_;
+  std::vector<Fiber*> fibers_;
+  std::atomic<size_t> size_{0};
+
+  // Called in the fiber. A fiber is added at most once.
+  void _add(Fiber* f);
+  // Called in the fiber. Does nothing if f has been notified.
+  void _remove(Fiber* f);
+  void _notify(size_t n);
+};
+
+class Fiber {
+ public:
+  using Func = std::function<void()>;
+
+  Fiber(Func func, size_t stack_size)
+      : func_(std::move(func)), id_(_nextId()++) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    stackSize_ = (stack_size + page - 1) / page * page;
+    // One more page below the stack traps overflows.
+    mapSize_ = stackSize_ + page;
+    map_ = mmap(
+        nullptr,
+        mapSize_,
+        PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK,
+        -1,
+        0);
+    if (map_ == MAP_FAILED) {
+      throw std::runtime_error("Fiber: cannot allocate the stack");
+    }
+    mprotect(map_, page, PROT_NONE);
+    stack_ = static_cast<char*>(map_) + page;
+
+    getcontext(&context_);
+    context_.uc_stack.ss_sp = stack_;
+    context_.uc_stack.ss_size = stackSize_;
+    context_.uc_link = nullptr;
+    makecontext(&context_, &Fiber::_entry, 0);
+#if defined(__SANITIZE_THREAD__)
+    tsanFiber_ = __tsan_create_fiber(0);
+#endif
+  }
+
+  Fiber(const Fiber&) = delete;
+  Fiber& operator=(const Fiber&) = delete;
+
+  ~Fiber() {
+#if defined(__SANITIZE_THREAD__)
+    __tsan_destroy_fiber(tsanFiber_);
+#endif
+    munmap(map_, mapSize_);
+  }
+
+  static bool inFiber() {
+    return _current() != nullptr;
+  }
+
+  static const Fiber* current() {
+    return _current();
+  }
+
+  template <typename PredicateT>
+  static void await(PredicateT ready, FiberWaitList& waiters) {
+    if (ready()) {
+      return;
+    }
+    Fiber* f = _current();
+    while (true) {
+      // Announce ourselves before the last check, so that a notifier either
+      // sees us or made ready() true before it is read.
+      waiters._add(f);
+      if (ready()) {
+        break;
+      }
+      f->_suspend();
+    }
+    waiters._remove(f);
+  }
+
+  template <typename PredicateT, typename Rep, typename Period>
+  static bool await(
+      PredicateT ready,
+      FiberWaitList& waiters,
+      std::chrono::duration<Rep, Period> timeout) {
+    if (ready()) {
+      return true;
+    }
+    Fiber* f = _current();
+    f->_setTimer(std::chrono::steady_clock::now() + timeout);
+    bool ok = false;
+    while (true) {
+      waiters._add(f);
+      if ((ok = ready()) || !f->_hasTimer()) {
+        break;
+      }
+      f->_suspend();
+    }
+    waiters._remove(f);
+    f->_cancelTimer();
+    return ok;
+  }
+
+  static void yield() {
+    Fiber* f = _current();
+    if (f == nullptr) {
+      std::this_thread::yield();
+      return;
+    }
+    f->_wake();
+    f->_suspend();
+  }
+
+  bool done() const {
+    return done_;
+  }
+
+  size_t id() const {
+    return id_;
+  }
+
+ private:
+  friend class FiberPool;
+  friend class FiberWaitList;
+
+  using Timers = std::multimap<std::chrono::steady_clock::time_point, Fiber*>;
+
+  Func func_;
+  const size_t id_;
+  bool done_ = false;
+
+  // Set by the pool when the fiber is spawned.
+  FiberPool* pool_ = nullptr;
+  size_t worker_ = 0;
+  Timers* timers_ = nullptr;
+
+  // Whether the fiber is in its worker's ready queue (guarded by the worker's
+  // mutex). A fiber may be requeued while it runs, e.g. if it gave up
+  // waiting just as it was notified; it then checks again what it waits for.
+  bool queued_ = false;
+  // The list the fiber waits on (guarded by the list's mutex).
+  FiberWaitList* waitingOn_ = nullptr;
+  // The deadline of a timed wait, if any (touched by its worker only).
+  Timers::iterator timer_;
+  bool hasTimer_ = false;
+
+  void* map_ = nullptr;
+  size_t mapSize_ = 0;
+  char* stack_ = nullptr;
+  size_t stackSize_ = 0;
+
+  ucontext_t context_;
+  ucontext_t caller_;
+
+#if defined(__SANITIZE_ADDRESS__)
+  void* fakeStack_ = nullptr;
+  const void* callerStack_ = nullptr;
+  size_t callerStackSize_ = 0;
+#endif
+#if defined(__SANITIZE_THREAD__)
+  void* tsanFiber_ = nullptr;
+  void* tsanCaller_ = nullptr;
+#endif
+
+  static std::atomic<size_t>& _nextId() {
+    static std::atomic<size_t> next_id{0};
+    return next_id;
+  }
+
+  static Fiber*& _current() {
+    static thread_local Fiber* current = nullptr;
+    return current;
+  }
+
+  // Puts the fiber in its worker's ready queue.
+  void _wake();
+
+  void _setTimer(std::chrono::steady_clock::time_point deadline) {
+    timer_ = timers_->emplace(deadline, this);
+    hasTimer_ = true;
+  }
+
+  // False once the deadline has passed.
+  bool _hasTimer() const {
+    return hasTimer_;
+  }
+
+  void _cancelTimer() {
+    if (hasTimer_) {
+      timers_->erase(timer_);
+      hasTimer_ = false;
+    }
+  }
+
+  // Called by the worker: runs the fiber until it suspends or ends.
+  void _resume() {
+    _current() = this;
+#if defined(__SANITIZE_ADDRESS__)
+    void* fake_stack = nullptr;
+    __sanitizer_start_switch_fiber(&fake_stack, stack_, stackSize_);
+#endif
+#if defined(__SANITIZE_THREAD__)
+    tsanCaller_ = __tsan_get_current_fiber();
+    __tsan_switch_to_fiber(tsanFiber_, 0);
+#endif
+    swapcontext(&caller_, &context_);
+#if defined(__SANITIZE_ADDRESS__)
+    __sanitizer_finish_switch_fiber(fake_stack, nullptr, nullptr);
+#endif
+    _current() = nullptr;
+  }
+
+  // Called in the fiber: goes back to the worker.
+  void _suspend() {
+#if defined(__SANITIZE_ADDRESS__)
+    __sanitizer_start_switch_fiber(
+        done_ ? nullptr : &fakeStack_, callerStack_, callerStackSize_);
+#endif
+#if defined(__SANITIZE_THREAD__)
+    __tsan_switch_to_fiber(tsanCaller_, 0);
+#endif
+    swapcontext(&context_, &caller_);
+    _enter();
+  }
+
+  void _enter() {
+#if defined(__SANITIZE_ADDRESS__)
+    __sanitizer_finish_switch_fiber(
+        fakeStack_, &callerStack_, &callerStackSize_);
+#endif
+  }
+
+  static void _entry() {
+    Fiber* f = _current();
+    f->_enter();
+    f->func_();
+    f->func_ = nullptr;
+    f->done_ = true;
+    // Never resumed again.
+    f->_suspend();
+  }
+};
+
+class FiberPool {
+ public:
+  static constexpr size_t kDefaultStackSize = 1 << 20;
+
+  static FiberPool& get(size_t num_thread = 0) {
+    static FiberPool* pool = new FiberPool(
+        num_thread > 0 ? num_thread
+                       : std::max(1u, std::thread::hardware_concurrency()));
+    return *pool;
+  }
+
+  explicit FiberPool(size_t num_thread, size_t stack_size = kDefaultStackSize)
+      : stackSize_(stack_size) {
+    if (num_thread == 0) {
+      num_thread = 1;
+    }
+    for (size_t i = 0; i < num_thread; ++i) {
+      workers_.emplace_back(new Worker);
+    }
+    for (size_t i = 0; i < num_thread; ++i) {
+      threads_.emplace_back([this, i]() { _run(*workers_[i]); });
+    }
+  }
+
+  FiberPool(const FiberPool&) = delete;
+  FiberPool& operator=(const FiberPool&) = delete;
+
+  ~FiberPool() {
+    join();
+  }
+
+  void spawn(Fiber::Func func) {
+    std::unique_ptr<Fiber> f(new Fiber(std::move(func), stackSize_));
+    f->pool_ = this;
+    f->worker_ = next_++ % workers_.size();
+    Worker& w = *workers_[f->worker_];
+    f->timers_ = &w.timers;
+    {
+      std::lock_guard<std::mutex> lock(w.mutex);
+      w.numFiber++;
+      f->queued_ = true;
+      w.ready.push_back(f.release());
+    }
+    w.cv.notify_one();
+  }
+
+  void join() {
+    for (auto& w : workers_) {
+      {
+        std::lock_guard<std::mutex> lock(w->mutex);
+        w->closing = true;
+      }
+      w->cv.notify_one();
+    }
+    for (auto& t : threads_) {
+      t.join();
+    }
+    threads_.clear();
+  }
+
+  size_t numThread() const {
+    return workers_.size();
+  }
+
+ private:
+  friend class Fiber;
+
+  struct Worker {
+    std::mutex mutex;
+    std::condition_variable cv;
+    // Fibers to resume, in order. A fiber that is done stays until it is
+    // out of this queue, then is deleted.
+    std::deque<Fiber*> ready;
+    size_t numFiber = 0;
+    bool closing = false;
+    // Touched by the worker thread only.
+    Fiber::Timers timers;
+  };
+
+  size_t stackSize_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::vector<std::thread> threads_;
+  std::atomic<size_t> next_{0};
+
+  static void _push(Worker& w, Fiber* f) {
+    if (!f->queued_) {
+      f->queued_ = true;
+      w.ready.push_back(f);
+    }
+  }
+
+  void _wake(Fiber* f) {
+    Worker& w = *workers_[f->worker_];
+    {
+      std::lock_guard<std::mutex> lock(w.mutex);
+      _push(w, f);
+    }
+    w.cv.notify_one();
+  }
+
+  // Requeues the fibers whose deadline has passed (requires w.mutex).
+  static void _expire(Worker& w) {
+    auto now = std::chrono::steady_clock::now();
+    while (!w.timers.empty() && w.timers.begin()->first <= now) {
+      Fiber* f = w.timers.begin()->second;
+      w.timers.erase(w.timers.begin());
+      f->hasTimer_ = false;
+      _push(w, f);
+    }
+  }
+
+  void _run(Worker& w) {
+    while (true) {
+      Fiber* f = nullptr;
+      {
+        std::unique_lock<std::mutex> lock(w.mutex);
+        while (true) {
+          _expire(w);
+          if (!w.ready.empty()) {
+            break;
+          }
+          if (w.closing && w.numFiber == 0) {
+            return;
+          }
+          if (w.timers.empty()) {
+            w.cv.wait(lock);
+          } else {
+            w.cv.wait_until(lock, w.timers.begin()->first);
+          }
+        }
+        f = w.ready.front();
+        w.ready.pop_front();
+        f->queued_ = false;
+      }
+
+      if (!f->done()) {
+        f->_resume();
+      }
+      if (f->done()) {
+        std::lock_guard<std::mutex> lock(w.mutex);
+        if (!f->queued_) {
+          delete f;
+          w.numFiber--;
+        }
+      }
+    }
+  }
+};
+
+inline void Fiber::_wake() {
+  pool_->_wake(this);
+}
+
+inline void FiberWaitList::_add(Fiber* f) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (f->waitingOn_ == this) {
+      return;
+    }
+    f->waitingOn_ = this;
+    fibers_.push_back(f);
+    // Pairs with _notify().
+    size_.fetch_add(1, std::memory_order_acq_rel);
+  }
+}
+
+inline void FiberWaitList::_remove(Fiber* f) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (f->waitingOn_ != this) {
+    return;
+  }
+  f->waitingOn_ = nullptr;
+  fibers_.erase(std::find(fibers_.begin(), fibers_.end(), f));
+  size_.fetch_sub(1);
+}
+
+inline void FiberWaitList::_notify(size_t n) {
+  // A read-modify-write reads the latest size: either it sees a fiber added
+  // by _add(), or that fiber reads what made it ready after adding itself.
+  if (size_.fetch_add(0, std::memory_order_acq_rel) == 0) {
+    return;
+  }
+  // Requeue under the mutex, so that a fiber that leaves the list in
+  // _remove() is either still in it or already requeued.
+  std::lock_guard<std::mutex> lock(mutex_);
+  n = std::min(n, fibers_.size());
+  for (size_t i = 0; i < n; ++i) {
+    Fiber* f = fibers_[i];
+    f->waitingOn_ = nullptr;
+    f->_wake();
+  }
+  fibers_.erase(fibers_.begin(), fibers_.begin() + n);
+  size_.fetch_sub(n);
+}
+
+} // namespace concurrency
+} // namespace elf
@@ -0,0 +1,160 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * ParkingLot lets threads block on an arbitrary address without giving every
+ * object its own mutex and condition variable (in the spirit of a futex).
+ *
+ * void park(const void* key, Pred ready)
+ *   Blocks until ready() is true. ready() must read a sequentially
+ *   consistent atomic that is set before unpark(key) is called.
+ *
+ * void parkAsync(const void* key, Pred ready, std::function<void()> wake)
+ *   Never blocks: calls wake() once ready() is true, either right away or
+ *   from the unpark(key) that follows, on the thread of the caller.
+ *
+ * void unpark(const void* key)
+ *   Wakes the threads parked on key, and only those, and runs the wake() of
+ *   the asynchronous parks. Cheap when nobody is parked.
+ *
+ * Keys are hashed into a fixed number of buckets; each parked thread waits
+ * on its own condition variable. A fiber (see Fiber.h) waits on its bucket
+ * instead, and only suspends itself; it may be requeued by the unpark() of
+ * another key of the bucket, and then parks again.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "Fiber.h"
+
+namespace elf {
+namespace concurrency {
+
+class ParkingLot {
+ public:
+  template <typename PredicateT>
+  static void park(const void* key, PredicateT ready) {
+    Bucket& b = _bucket(key);
+    if (Fiber::inFiber()) {
+      Fiber::await(ready, b.fibers);
+      return;
+    }
+    Waiter& w = _self();
+
+    std::unique_lock<std::mutex> lock(b.mutex);
+    // Announce ourselves before the last check, so that unpark() either sees
+    // us or happens before ready() is read.
+    b.num_waiters++;
+    if (ready()) {
+      b.num_waiters--;
+      return;
+    }
+    w.key = key;
+    w.woken = false;
+    b.waiters.push_back(&w);
+    w.cv.wait(lock, [&w]() { return w.woken; });
+  }
+
+  template <typename PredicateT>
+  static void
+  parkAsync(const void* key, PredicateT ready, std::function<void()> wake) {
+    Bucket& b = _bucket(key);
+    {
+      std::lock_guard<std::mutex> lock(b.mutex);
+      // Same as park().
+      b.num_waiters++;
+      if (!ready()) {
+        b.callbacks.push_back(std::make_pair(key, std::move(wake)));
+        return;
+      }
+      b.num_waiters--;
+    }
+    wake();
+  }
+
+  static void unpark(const void* key) {
+    Bucket& b = _bucket(key);
+    b.fibers.notifyAll();
+    if (b.num_waiters == 0) {
+      return;
+    }
+
+    std::vector<std::function<void()>> wakes;
+    {
+      std::lock_guard<std::mutex> lock(b.mutex);
+      auto it = std::remove_if(
+          b.waiters.begin(), b.waiters.end(), [key, &b](Waiter* w) {
+            if (w->key != key) {
+              return false;
+            }
+            w->woken = true;
+            w->cv.notify_one();
+            b.num_waiters--;
+            return true;
+          });
+      b.waiters.erase(it, b.waiters.end());
+
+      for (size_t i = 0; i < b.callbacks.size();) {
+        if (b.callbacks[i].first != key) {
+          ++i;
+          continue;
+        }
+        wakes.push_back(std::move(b.callbacks[i].second));
+        b.callbacks[i] = std::move(b.callbacks.back());
+        b.callbacks.pop_back();
+        b.num_waiters--;
+      }
+    }
+    // Outside of the lock: a wake() may park again.
+    for (auto& wake : wakes) {
+      wake();
+    }
+  }
+
+ private:
+  static constexpr size_t kNumBucket = 256;
+
+  struct Waiter {
+    const void* key = nullptr;
+    bool woken = false;
+    std::condition_variable cv;
+  };
+
+  struct alignas(64) Bucket {
+    std::mutex mutex;
+    std::atomic<int> num_waiters{0};
+    std::vector<Waiter*> waiters;
+    std::vector<std::pair<const void*, std::function<void()>>> callbacks;
+    FiberWaitList fibers;
+  };
+
+  static Bucket& _bucket(const void* key) {
+    static Bucket buckets[kNumBucket];
+    uint64_t h = reinterpret_cast<uintptr_t>(key) * 0x9E3779B97F4A7C15ULL;
+    return buckets[(h >> 32) % kNumBucket];
+  }
+
+  static Waiter& _self() {
+    static thread_local Waiter w;
+    return w;
+  }
+};
+
+} // namespace concurrency
+} // namespace elf
@@ -0,0 +1,199 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * WorkStealingPool runs short tasks on a fixed set of worker threads.
+ *
+ * static WorkStealingPool& get(size_t num_thread = 0)
+ *   The pool shared by the process. The first call creates it with
+ *   num_thread workers (0 = one per core); later calls ignore num_thread.
+ *
+ * void submit(std::function<void()> task)
+ *   Queues the task. From a worker of this pool, it goes to the back of that
+ *   worker's own queue, otherwise to the queues in turn.
+ *
+ * Every worker runs its own queue in FIFO order, so a task that resubmits
+ * itself lets the others queued behind it run first. A worker whose queue is
+ * empty steals from the back of the other queues, and sleeps only when there
+ * is no task left anywhere.
+ *
+ * The destructor runs the queued tasks, then joins the workers.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace elf {
+namespace concurrency {
+
+class WorkStealingPool {
+ public:
+  using Task = std::function<void()>;
+
+  static WorkStealingPool& get(size_t num_thread = 0) {
+    static WorkStealingPool* pool = new WorkStealingPool(num_thread);
+    return *pool;
+  }
+
+  explicit WorkStealingPool(size_t num_thread = 0) {
+    if (num_thread == 0) {
+      num_thread = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < num_thread; ++i) {
+      workers_.emplace_back(new Worker);
+    }
+    for (size_t i = 0; i < num_thread; ++i) {
+      threads_.emplace_back([this, i]() { _run(i); });
+    }
+  }
+
+  WorkStealingPool(const WorkStealingPool&) = delete;
+  WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+  ~WorkStealingPool() {
+    {
+      std::lock_guard<std::mutex> lock(idleMutex_);
+      done_ = true;
+    }
+    idleCv_.notify_all();
+    for (auto& t : threads_) {
+      t.join();
+    }
+  }
+
+  void submit(Task task) {
+    const Self& self = _self();
+    size_t i = self.pool == this
+        ? self.idx
+        : next_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+    {
+      std::lock_guard<std::mutex> lock(workers_[i]->mutex);
+      workers_[i]->tasks.push_back(std::move(task));
+    }
+
+    // Pairs with the idle check of _run(): either the worker sees the task,
+    // or we see the worker idle.
+    numPending_.fetch_add(1);
+    if (numIdle_.load() > 0) {
+      { std::lock_guard<std::mutex> lock(idleMutex_); }
+      idleCv_.notify_one();
+    }
+  }
+
+  size_t numThread() const {
+    return workers_.size();
+  }
+
+  uint64_t numSteal() const {
+    return numSteal_.load(std::memory_order_relaxed);
+  }
+
+  std::string info() const {
+    std::stringstream ss;
+    ss << "#Threads: " << workers_.size()
+       << ", #Pending: " << numPending_.load()
+       << ", #Idle: " << numIdle_.load() << ", #Run: " << numRun_.load()
+       << ", #Steal: " << numSteal();
+    return ss.str();
+  }
+
+ private:
+  struct alignas(64) Worker {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  struct Self {
+    const WorkStealingPool* pool = nullptr;
+    size_t idx = 0;
+  };
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::vector<std::thread> threads_;
+  std::atomic<size_t> next_{0};
+
+  std::mutex idleMutex_;
+  std::condition_variable idleCv_;
+  // May go below 0 for a moment, if a task runs before it is counted.
+  std::atomic<int64_t> numPending_{0};
+  std::atomic<int> numIdle_{0};
+  bool done_ = false;
+
+  std::atomic<uint64_t> numRun_{0};
+  std::atomic<uint64_t> numSteal_{0};
+
+  static Self& _self() {
+    static thread_local Self self;
+    return self;
+  }
+
+  bool _pop(size_t i, Task* task) {
+    Worker& w = *workers_[i];
+    std::lock_guard<std::mutex> lock(w.mutex);
+    if (w.tasks.empty()) {
+      return false;
+    }
+    *task = std::move(w.tasks.front());
+    w.tasks.pop_front();
+    return true;
+  }
+
+  bool _steal(size_t i, Task* task) {
+    for (size_t k = 1; k < workers_.size(); ++k) {
+      Worker& w = *workers_[(i + k) % workers_.size()];
+      std::lock_guard<std::mutex> lock(w.mutex);
+      if (!w.tasks.empty()) {
+        *task = std::move(w.tasks.back());
+        w.tasks.pop_back();
+        numSteal_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void _run(size_t i) {
+    _self().pool = this;
+    _self().idx = i;
+
+    while (true) {
+      Task task;
+      if (_pop(i, &task) || _steal(i, &task)) {
+        numPending_.fetch_sub(1);
+        numRun_.fetch_add(1, std::memory_order_relaxed);
+        task();
+        continue;
+      }
+
+      std::unique_lock<std::mutex> lock(idleMutex_);
+      numIdle_.fetch_add(1);
+      idleCv_.wait(lock, [this]() { return numPending_.load() > 0 || done_; });
+      numIdle_.fetch_sub(1);
+      if (done_ && numPending_.load() <= 0) {
+        return;
+      }
+    }
+  }
+};
+
+} // namespace concurrency
+} // namespace elf
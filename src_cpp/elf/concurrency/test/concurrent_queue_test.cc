@@ -0,0 +1,186 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "elf/concurrency/ConcurrentQueue.h"
+#include "elf/concurrency/Fiber.h"
+
+using elf::concurrency::ConcurrentQueueHybrid;
+using elf::concurrency::ConcurrentQueueMoodyCamel;
+using elf::concurrency::ConcurrentQueueTBB;
+using elf::concurrency::Fiber;
+using elf::concurrency::FiberPool;
+
+using Clock = std::chrono::steady_clock;
+
+// The contract of all the queues (see ConcurrentQueue.h).
+template <typename Q>
+class ConcurrentQueueTest : public testing::Test {};
+
+using Queues = testing::Types<
+    ConcurrentQueueMoodyCamel<int>,
+    ConcurrentQueueTBB<int>,
+    ConcurrentQueueHybrid<int>>;
+TYPED_TEST_CASE(ConcurrentQueueTest, Queues);
+
+// Values of each producer come out in the order it pushed them.
+TYPED_TEST(ConcurrentQueueTest, testFifoPerProducer) {
+  const int kNumProducer = 4;
+  const int kNumValue = 5000;
+  TypeParam q;
+  std::vector<std::thread> producers;
+  for (int p = 0; p < kNumProducer; ++p) {
+    producers.emplace_back([&q, p]() {
+      for (int i = 0; i < kNumValue; ++i) {
+        q.push(p * kNumValue + i);
+        if (i % 64 == 0) {
+          // Let the consumer run dry now and then.
+          std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+      }
+    });
+  }
+
+  std::vector<int> last(kNumProducer, -1);
+  for (int n = 0; n < kNumProducer * kNumValue; ++n) {
+    int v;
+    q.pop(&v);
+    int p = v / kNumValue;
+    ASSERT_GT(v % kNumValue, last[p]);
+    last[p] = v % kNumValue;
+  }
+  for (auto& t : producers) {
+    t.join();
+  }
+  for (int i : last) {
+    EXPECT_EQ(i, kNumValue - 1);
+  }
+}
+
+TYPED_TEST(ConcurrentQueueTest, testTimeout) {
+  TypeParam q;
+  int v = -1;
+  auto start = Clock::now();
+  EXPECT_FALSE(q.pop(&v, std::chrono::milliseconds(10)));
+  auto waited = Clock::now() - start;
+  EXPECT_EQ(v, -1);
+  EXPECT_GE(waited, std::chrono::milliseconds(10));
+  EXPECT_LT(waited, std::chrono::milliseconds(500));
+
+  q.push(3);
+  EXPECT_TRUE(q.pop(&v, std::chrono::milliseconds(10)));
+  EXPECT_EQ(v, 3);
+}
+
+// A consumer that has given up spinning is woken by the next push.
+TYPED_TEST(ConcurrentQueueTest, testWake) {
+  TypeParam q;
+  std::thread producer([&q]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    q.push(1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    q.push(2);
+  });
+
+  int v;
+  auto start = Clock::now();
+  q.pop(&v);
+  EXPECT_EQ(v, 1);
+  EXPECT_TRUE(q.pop(&v, std::chrono::milliseconds(200)));
+  EXPECT_EQ(v, 2);
+  EXPECT_LT(Clock::now() - start, std::chrono::seconds(1));
+  producer.join();
+}
+
+// A consumer fiber only suspends itself: the producer fiber of the same
+// thread runs meanwhile, and its pushes wake the consumer.
+TYPED_TEST(ConcurrentQueueTest, testFiber) {
+  const int kNumValue = 1000;
+  TypeParam q;
+  int sum = 0;
+  {
+    FiberPool pool(1);
+    pool.spawn([&]() {
+      for (int i = 0; i < kNumValue; ++i) {
+        int v;
+        if (i % 2 == 0) {
+          q.pop(&v);
+        } else {
+          while (!q.pop(&v, std::chrono::microseconds(10))) {
+          }
+        }
+        sum += v;
+      }
+      int v;
+      EXPECT_FALSE(q.pop(&v, std::chrono::milliseconds(1)));
+    });
+    pool.spawn([&]() {
+      for (int i = 0; i < kNumValue; ++i) {
+        q.push(1);
+        Fiber::yield();
+      }
+    });
+  }
+  EXPECT_EQ(sum, kNumValue);
+}
+
+TEST(ConcurrentQueueHybridTest, testPopBulk) {
+  ConcurrentQueueHybrid<std::unique_ptr<int>> q;
+  std::vector<std::unique_ptr<int>> values;
+  EXPECT_EQ(q.pop_bulk(&values, 10), 0U);
+
+  for (int i = 0; i < 5; ++i) {
+    q.push(std::unique_ptr<int>(new int(i)));
+  }
+  EXPECT_EQ(q.pop_bulk(&values, 3), 3U);
+  EXPECT_EQ(q.pop_bulk(&values, 3), 2U);
+  ASSERT_EQ(values.size(), 5U);
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_EQ(*values[i], i);
+  }
+  EXPECT_FALSE(q.pop(&values[0], std::chrono::microseconds(10)));
+}
+
+// Several consumers share the values, each exactly once.
+TEST(ConcurrentQueueHybridTest, testConsumers) {
+  const int kNumValue = 100000;
+  ConcurrentQueueHybrid<int> q;
+  std::atomic<long> sum(0);
+  std::atomic<int> count(0);
+  std::vector<std::thread> consumers;
+  for (int c = 0; c < 3; ++c) {
+    consumers.emplace_back([&]() {
+      int v;
+      while (q.pop(&v, std::chrono::milliseconds(50))) {
+        sum += v;
+        count++;
+      }
+    });
+  }
+  for (int i = 1; i <= kNumValue; ++i) {
+    q.push(i);
+  }
+  for (auto& t : consumers) {
+    t.join();
+  }
+  EXPECT_EQ(count.load(), kNumValue);
+  EXPECT_EQ(sum.load(), static_cast<long>(kNumValue) * (kNumValue + 1) / 2);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,152 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "elf/concurrency/ConcurrentQueue.h"
+#include "elf/concurrency/Counter.h"
+#include "elf/concurrency/Fiber.h"
+#include "elf/concurrency/ParkingLot.h"
+
+using elf::concurrency::ConcurrentQueue;
+using elf::concurrency::Counter;
+using elf::concurrency::Fiber;
+using elf::concurrency::FiberPool;
+using elf::concurrency::ParkingLot;
+
+// Two fibers on one thread wait for each other; a blocking wait would hang.
+TEST(FiberTest, testPingPong) {
+  const int kNumRound = 1000;
+  Counter<int> pings;
+  ConcurrentQueue<int> pongs;
+  int num_timeout = 0;
+  {
+    FiberPool pool(1);
+    pool.spawn([&]() {
+      EXPECT_TRUE(Fiber::inFiber());
+      for (int i = 0; i < kNumRound; ++i) {
+        pings.increment();
+        int v;
+        pongs.pop(&v);
+        EXPECT_EQ(v, i);
+      }
+    });
+    pool.spawn([&]() {
+      for (int i = 0; i < kNumRound; ++i) {
+        pings.waitUntilCount(i + 1);
+        int v;
+        if (!pongs.pop(&v, std::chrono::microseconds(10))) {
+          num_timeout++;
+        }
+        pongs.push(i);
+      }
+    });
+  }
+  EXPECT_FALSE(Fiber::inFiber());
+  EXPECT_EQ(pings.waitUntilCount(kNumRound), kNumRound);
+  EXPECT_EQ(num_timeout, kNumRound);
+}
+
+// Fibers that yield take turns. They are spawned from a fiber of the same
+// thread, so that none runs before all are spawned.
+TEST(FiberTest, testYield) {
+  std::vector<int> order;
+  {
+    FiberPool pool(1);
+    pool.spawn([&pool, &order]() {
+      for (int f = 0; f < 3; ++f) {
+        pool.spawn([&order, f]() {
+          for (int i = 0; i < 3; ++i) {
+            order.push_back(f);
+            Fiber::yield();
+          }
+        });
+      }
+    });
+  }
+  EXPECT_EQ(order, std::vector<int>({0, 1, 2, 0, 1, 2, 0, 1, 2}));
+}
+
+// A timed wait gives up on time, even though nothing notifies it, and does
+// not hold up the other fibers of its thread meanwhile.
+TEST(FiberTest, testTimeout) {
+  Counter<int> never;
+  std::atomic<int> num_yield(0);
+  std::atomic<bool> done(false);
+  std::chrono::steady_clock::duration waited;
+  {
+    FiberPool pool(1);
+    pool.spawn([&]() {
+      auto start = std::chrono::steady_clock::now();
+      EXPECT_EQ(never.waitUntilCount(1, std::chrono::milliseconds(20)), 0);
+      waited = std::chrono::steady_clock::now() - start;
+      done = true;
+    });
+    pool.spawn([&]() {
+      while (!done) {
+        num_yield++;
+        Fiber::yield();
+      }
+    });
+  }
+  EXPECT_GE(waited, std::chrono::milliseconds(20));
+  EXPECT_LT(waited, std::chrono::seconds(1));
+  EXPECT_GT(num_yield.load(), 1);
+}
+
+// Waiting fibers are only resumed when a thread outside the pool wakes them.
+TEST(FiberTest, testWakeFromThread) {
+  const int kNumFiber = 64;
+  Counter<int> go;
+  ConcurrentQueue<int> q;
+  std::atomic<int> num_awake(0);
+  std::atomic<int> sum(0);
+  std::vector<int> flags(kNumFiber, 0);
+  {
+    FiberPool pool(2);
+    for (int f = 0; f < kNumFiber; ++f) {
+      pool.spawn([&, f]() {
+        go.waitUntilCount(1);
+        num_awake++;
+        ParkingLot::park(&flags[f], [&flags, f]() {
+          return __atomic_load_n(&flags[f], __ATOMIC_SEQ_CST) != 0;
+        });
+        sum += f;
+      });
+    }
+    pool.spawn([&]() {
+      int v;
+      q.pop(&v);
+      sum += v;
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    EXPECT_EQ(num_awake.load(), 0);
+    go.increment();
+    while (num_awake.load() < kNumFiber) {
+      std::this_thread::yield();
+    }
+    for (int f = 0; f < kNumFiber; ++f) {
+      __atomic_store_n(&flags[f], 1, __ATOMIC_SEQ_CST);
+      ParkingLot::unpark(&flags[f]);
+    }
+    q.push(1000);
+  }
+  EXPECT_EQ(sum.load(), kNumFiber * (kNumFiber - 1) / 2 + 1000);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
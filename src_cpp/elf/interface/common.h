@@ -40,6 +40,7 @@ struct Size {
   Size(std::initializer_list<int> l) : sz_(l) {}
   Size(const std::vector<int>& l) : sz_(l) {}
   Size(const Size& s) : sz_(s.sz_) {}
+  Size& operator=(const Size& s) = default;
   Size(int s) {
     sz_.push_back(s);
   }
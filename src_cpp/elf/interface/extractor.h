@@ -8,9 +8,11 @@
 
 #pragma once
 
+#include <atomic>
 #include <functional>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <sstream>
 #include <type_traits>
@@ -78,6 +80,13 @@ struct FuncStateMemT {
         p->func, std::ref(s), std::placeholders::_1, std::placeholders::_2);
   }
 
+  // The function for S, or nullptr. Valid as long as this object.
+  template <typename S>
+  const FuncAnyPType<S>* get() const {
+    auto* p = dynamic_cast<_Func<S>*>(func_.get());
+    return p != nullptr ? &p->func : nullptr;
+  }
+
  private:
   class _FuncBase {
    public:
@@ -102,12 +111,17 @@ class FuncMapT;
 
 struct FuncMapBase {
  public:
-  FuncMapBase(const std::string& name) : name_(name) {}
+  FuncMapBase(const std::string& name) : name_(name), id_(_nextId()++) {}
 
   const std::string& getName() const {
     return name_;
   }
 
+  // Unique in the process (see SharedMemData::operator[]).
+  int getId() const {
+    return id_;
+  }
+
   int getBatchSize() const {
     return batchsize_;
   }
@@ -171,6 +185,25 @@ struct FuncMapBase {
     return it->second.Bind<S>(s);
   }
 
+  // Unbound versions of the two above, used by TransferPlan.
+  template <typename S>
+  const FuncStateToMem::FuncAnyPType<S>* getStateToMemFunc() const {
+    auto it = state_to_mem_funcs_.find(typeid(S).name());
+    if (it == state_to_mem_funcs_.end()) {
+      return nullptr;
+    }
+    return it->second.get<S>();
+  }
+
+  template <typename S>
+  const FuncMemToState::FuncAnyPType<S>* getMemToStateFunc() const {
+    auto it = mem_to_state_funcs_.find(typeid(S).name());
+    if (it == mem_to_state_funcs_.end()) {
+      return nullptr;
+    }
+    return it->second.get<S>();
+  }
+
   size_t state2memCount() const { return state_to_mem_funcs_.size(); }
   size_t mem2stateCount() const { return mem_to_state_funcs_.size(); }
 
@@ -178,12 +211,19 @@ struct FuncMapBase {
 
  protected:
   std::string name_;
+  int id_;
   int batchsize_ = 0;
   Size extents_;
 
   // For each class, bind to a function.
   std::unordered_map<std::string, FuncStateToMem> state_to_mem_funcs_;
   std::unordered_map<std::string, FuncMemToState> mem_to_state_funcs_;
+
+ private:
+  static std::atomic<int>& _nextId() {
+    static std::atomic<int> next_id(0);
+    return next_id;
+  }
 };
 
 template <typename T>
@@ -427,6 +467,52 @@ class AnyP {
 
 class SharedMemData;
 
+// A field and the function of some state type for it, callable on any state
+// of that type.
+template <bool use_const>
+struct TransferEntryT {
+  using AnyP_t = typename std::conditional<use_const, AnyP, const AnyP>::type&;
+  template <typename S>
+  using Func = typename FuncStateMemT<use_const>::template FuncAnyPType<S>;
+
+  const FuncMapBase* field = nullptr;
+  const void* func = nullptr;
+  void (*call)(const void* func, void* s, AnyP_t anyp, int batch_idx) =
+      nullptr;
+
+  template <typename S>
+  static TransferEntryT create(const FuncMapBase* field, const Func<S>* func) {
+    TransferEntryT entry;
+    entry.field = field;
+    entry.func = func;
+    entry.call = &_call<S>;
+    return entry;
+  }
+
+ private:
+  template <typename S>
+  static void _call(const void* func, void* s, AnyP_t anyp, int batch_idx) {
+    (*static_cast<const Func<S>*>(func))(
+        *static_cast<S*>(s), anyp, batch_idx);
+  }
+};
+
+// The functions of one state type for the fields of some shared memories,
+// looked up once (see Binder::getPlan) rather than for every state.
+struct TransferPlan {
+  std::vector<TransferEntryT<true>> state_to_mem;
+  std::vector<TransferEntryT<false>> mem_to_state;
+
+  template <bool use_const>
+  const std::vector<TransferEntryT<use_const>>& entries() const {
+    if constexpr (use_const) {
+      return state_to_mem;
+    } else {
+      return mem_to_state;
+    }
+  }
+};
+
 template <bool use_const>
 class FuncsWithStateT {
  public:
@@ -451,6 +537,20 @@ class FuncsWithStateT {
     return false;
   }
 
+  // Apply the entries of plan to s.
+  void addPlan(const TransferPlan* plan, const void* s) {
+    if (plan->entries<use_const>().empty()) {
+      return;
+    }
+    BoundPlan b{plan, const_cast<void*>(s)};
+    if (numPlan_ < kNumInlinePlan) {
+      plans_[numPlan_] = b;
+    } else {
+      morePlans_.push_back(b);
+    }
+    numPlan_++;
+  }
+
 #if 0
     template <typename T>
     bool add(const std::string &key, PointerFunc<T> func) {
@@ -497,10 +597,29 @@ class FuncsWithStateT {
     for (const auto& p : funcs.funcs_) {
       funcs_.insert(p);
     }
+    for (size_t i = 0; i < funcs.numPlan_; ++i) {
+      const BoundPlan& b = funcs._plan(i);
+      addPlan(b.plan, b.state);
+    }
   }
 
  private:
+  struct BoundPlan {
+    const TransferPlan* plan;
+    void* state;
+  };
+
+  // A state and its action make two, which we keep without allocating.
+  static constexpr size_t kNumInlinePlan = 2;
+
   std::unordered_map<std::string, Func> funcs_;
+  BoundPlan plans_[kNumInlinePlan] = {};
+  std::vector<BoundPlan> morePlans_;
+  size_t numPlan_ = 0;
+
+  const BoundPlan& _plan(size_t i) const {
+    return i < kNumInlinePlan ? plans_[i] : morePlans_[i - kNumInlinePlan];
+  }
 };
 
 using FuncStateToMemWithState = FuncsWithStateT<true>;
@@ -536,8 +655,11 @@ class ClassFieldT;
 //
 class Extractor {
  public:
+  Extractor() : plans_(new _Plans) {}
+
   template <typename T>
   FuncMapT<T>& addField(const std::string& key) {
+    _clearPlans();
     auto& f = fields_[key];
     auto* p = new FuncMapT<T>(key);
     f.reset(p);
@@ -630,7 +752,23 @@ class Extractor {
     return pointers;
   }
 
+  // The plan cached under key, compiled by compile() if there is none. Plans
+  // live as long as the extractor, but adding fields drops them, so all the
+  // fields must be added before states are bound.
+  const TransferPlan* getPlan(
+      const std::string& key,
+      std::function<void(TransferPlan*)> compile) const {
+    std::lock_guard<std::mutex> lock(plans_->mutex);
+    auto& plan = plans_->plans[key];
+    if (plan == nullptr) {
+      plan.reset(new TransferPlan);
+      compile(plan.get());
+    }
+    return plan.get();
+  }
+
   void merge(Extractor &&e) {
+    _clearPlans();
     for (auto &&p : e.fields_) {
       fields_[p.first] = std::move(p.second);
     }
@@ -659,6 +797,21 @@ class Extractor {
  private:
   // A bunch of pointer to Field.
   std::unordered_map<std::string, std::unique_ptr<FuncMapBase>> fields_;
+
+  struct _Plans {
+    std::mutex mutex;
+    std::unordered_map<std::string, std::unique_ptr<TransferPlan>> plans;
+  };
+  std::unique_ptr<_Plans> plans_;
+
+  void _clearPlans() {
+    if (plans_ == nullptr) {
+      // Moved from.
+      plans_.reset(new _Plans);
+    }
+    std::lock_guard<std::mutex> lock(plans_->mutex);
+    plans_->plans.clear();
+  }
 };
 
 template <typename S>
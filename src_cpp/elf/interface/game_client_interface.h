@@ -8,6 +8,8 @@
 
 #pragma once
 
+#include <atomic>
+
 #include "extractor.h"
 #include "elf/comm/base.h"
 
@@ -22,54 +24,70 @@ class Binder {
     assert(retriever_ != nullptr);
   }
 
+  // Binding a state to the plan of its type costs two pointers, whereas the
+  // functions are looked up by key only when the plan is compiled. The plan
+  // is cached under the keys the shared memories have now, so that a label
+  // given other keys later gets a plan of its own.
   template <typename S>
-  FuncsWithState BindStateToFunctions(
-      const std::vector<std::string>& smem_names,
-      S* s) {
-    FuncsWithState funcsWithState;
-
-    std::set<std::string> dup;
-
+  const TransferPlan* getPlan(
+      const std::vector<std::string>& smem_names) const {
+    std::string key = typeid(S).name();
+    key += std::is_const<S>::value ? "[const]" : "";
     for (const auto& name : smem_names) {
+      key += "," + name + "[";
       const std::vector<std::string>* keys = retriever_(name);
-
-      if (keys == nullptr) {
-        continue;
-      }
-
-      for (const auto& key : *keys) {
-        if (dup.find(key) != dup.end()) {
-          continue;
+      if (keys != nullptr) {
+        for (const auto& k : *keys) {
+          key += k + ";";
         }
+      }
+      key += "]";
+    }
+    return extractor_.getPlan(
+        key, [&](TransferPlan* plan) { _compile<S>(smem_names, plan); });
+  }
 
-        const FuncMapBase* funcs = extractor_.getFunctions(key);
-
-        if (funcs == nullptr) {
-          continue;
-        }
+  template <typename S>
+  static FuncsWithState BindStateToPlan(const TransferPlan* plan, S* s) {
+    FuncsWithState funcsWithState;
+    funcsWithState.state_to_mem_funcs.addPlan(plan, s);
+    funcsWithState.mem_to_state_funcs.addPlan(plan, s);
+    return funcsWithState;
+  }
 
-        if (funcsWithState.state_to_mem_funcs.addFunction(
-              key, funcs->BindStateToStateToMemFunc(*s))) {
-          // LOG(INFO) << "GetPackage: key: " << key << "Add s2m "
-          //           << std:: endl;
-        }
+  template <typename S>
+  FuncsWithState BindStateToFunctions(
+      const std::vector<std::string>& smem_names,
+      S* s) {
+    return BindStateToPlan(getPlan<S>(smem_names), s);
+  }
 
-        if (funcsWithState.mem_to_state_funcs.addFunction(
-              key, funcs->BindStateToMemToStateFunc(*s))) {
-          // LOG(INFO) << "GetPackage: key: " << key << "Add m2s "
-          //           << std::endl;
-        }
-        dup.insert(key);
-      }
+  template <typename S>
+  static std::vector<FuncsWithState> BindStateToPlan(
+      const TransferPlan* plan,
+      const std::vector<S*>& batch_s) {
+    std::vector<FuncsWithState> batchFuncsWithState(batch_s.size());
+    for (size_t i = 0; i < batch_s.size(); ++i) {
+      batchFuncsWithState[i] = BindStateToPlan(plan, batch_s[i]);
     }
-    return funcsWithState;
+    return batchFuncsWithState;
   }
 
   template <typename S>
   std::vector<FuncsWithState> BindStateToFunctions(
       const std::vector<std::string>& smem_names,
       const std::vector<S*>& batch_s) {
-    std::vector<FuncsWithState> batchFuncsWithState(batch_s.size());
+    return BindStateToPlan(getPlan<S>(smem_names), batch_s);
+  }
+
+ private:
+  template <typename S>
+  void _compile(
+      const std::vector<std::string>& smem_names,
+      TransferPlan* plan) const {
+    // As BindStateToStateToMemFunc and BindStateToMemToStateFunc deduce it
+    // from a state S.
+    using SNonConst = typename std::remove_const<S>::type;
 
     std::set<std::string> dup;
 
@@ -91,33 +109,48 @@ class Binder {
           continue;
         }
 
-        for (size_t i = 0; i < batch_s.size(); ++i) {
-          auto& funcsWithState = batchFuncsWithState[i];
-          S* s = batch_s[i];
-
-          if (funcsWithState.state_to_mem_funcs.addFunction(
-                key, funcs->BindStateToStateToMemFunc(*s))) {
-            // LOG(INFO) << "GetPackage: key: " << key << "Add s2m "
-            //           << std:: endl;
-          }
-
-          if (funcsWithState.mem_to_state_funcs.addFunction(
-                key, funcs->BindStateToMemToStateFunc(*s))) {
-            // LOG(INFO) << "GetPackage: key: " << key << "Add m2s "
-            //           << std::endl;
-          }
+        if (auto* f = funcs->getStateToMemFunc<SNonConst>()) {
+          plan->state_to_mem.push_back(
+              TransferEntryT<true>::create<SNonConst>(funcs, f));
+        }
+
+        if (auto* f = funcs->getMemToStateFunc<S>()) {
+          plan->mem_to_state.push_back(
+              TransferEntryT<false>::create<S>(funcs, f));
         }
         dup.insert(key);
       }
     }
-    return batchFuncsWithState;
   }
 
- private:
   const Extractor &extractor_;
   RetrieverFunc retriever_ = nullptr;
 };
 
+// The plan of S for fixed shared memories, for a client that sends many
+// states of the same type: it is looked up on first use only, so binding a
+// state neither builds the key nor locks the extractor.
+template <typename S>
+class CachedPlanT {
+ public:
+  explicit CachedPlanT(const std::vector<std::string>& smem_names)
+      : smem_names_(smem_names) {}
+
+  const TransferPlan* get(const Binder& binder) {
+    const TransferPlan* plan = plan_.load(std::memory_order_acquire);
+    if (plan == nullptr) {
+      // Racing threads get the same plan.
+      plan = binder.getPlan<S>(smem_names_);
+      plan_.store(plan, std::memory_order_release);
+    }
+    return plan;
+  }
+
+ private:
+  const std::vector<std::string> smem_names_;
+  std::atomic<const TransferPlan*> plan_{nullptr};
+};
+
 class GameClientInterface {
  public:
   // For Game side.
@@ -7,6 +7,8 @@ namespace elf {
 
 DEF_STRUCT(Options)
 DEF_FIELD(int, num_game_thread, 1, "#Num of game threads");
+DEF_FIELD(int, num_game_worker, 0, "#Threads running games as fibers (0: off)");
+DEF_FIELD(std::string, routing, "random", "How games pick a collector of a label: random, two_choices, shortest_queue or sticky");
 DEF_FIELD(int, batchsize, 1, "Batchsize");
 DEF_FIELD(bool, verbose, false, "Verbose");
 DEF_FIELD(int64_t, seed, 0L, "Seed");
@@ -8,18 +8,24 @@
 
 #pragma once
 
+#include <algorithm>
 #include <sstream>
 #include <string>
 #include <unordered_map>
 #include <functional>
+#include <vector>
 
 #include "extractor.h"
+#include "elf/comm/base.h"
 
 namespace elf {
 
 class SharedMemOptions {
  public:
   enum TransferType { SERVER = 0, CLIENT };
+  // FIXED: wait as the options say. Otherwise a BatchController tunes the
+  // wait (see base/batch_controller.h).
+  enum BatchTarget { FIXED = 0, MAX_THROUGHPUT, LATENCY_SLO };
 
   SharedMemOptions(const std::string& label, int batchsize)
       : options_(label, batchsize, 0, 1) {}
@@ -48,6 +54,21 @@ class SharedMemOptions {
     type_ = type;
   }
 
+  // With num_slot > 1, a collector fills the next batch while the previous
+  // ones are in flight. Each slot is allocated as a shared memory of its own.
+  void setNumSlot(int num_slot) {
+    num_slot_ = num_slot;
+  }
+
+  void setSlotIdx(int slot_idx) {
+    slot_idx_ = slot_idx;
+  }
+
+  void setBatchTarget(BatchTarget target, int latency_slo_usec = 0) {
+    batch_target_ = target;
+    latency_slo_usec_ = latency_slo_usec;
+  }
+
   int getIdx() const {
     return idx_;
   }
@@ -84,6 +105,22 @@ class SharedMemOptions {
     return type_;
   }
 
+  int getNumSlot() const {
+    return num_slot_;
+  }
+
+  int getSlotIdx() const {
+    return slot_idx_;
+  }
+
+  BatchTarget getBatchTarget() const {
+    return batch_target_;
+  }
+
+  int getLatencySLO() const {
+    return latency_slo_usec_;
+  }
+
   std::string info() const {
     std::stringstream ss;
     ss << "SMem[" << options_.label << "], idx: " << idx_
@@ -98,12 +135,26 @@ class SharedMemOptions {
       ss << ", transfer_type: " << type_;
     }
 
+    if (num_slot_ > 1) {
+      ss << ", slot: " << slot_idx_ << "/" << num_slot_;
+    }
+
+    if (batch_target_ != FIXED) {
+      ss << ", batch_target: " << batch_target_;
+      if (batch_target_ == LATENCY_SLO) {
+        ss << ", latency_slo_usec: " << latency_slo_usec_;
+      }
+    }
+
     return ss.str();
   }
 
   friend bool operator==(const SharedMemOptions &op1, const SharedMemOptions &op2) {
     return op1.idx_ == op2.idx_ && op1.label_idx_ == op2.label_idx_ &&
-      op1.type_ == op2.type_ && op1.options_ == op2.options_;
+      op1.type_ == op2.type_ && op1.options_ == op2.options_ &&
+      op1.num_slot_ == op2.num_slot_ && op1.slot_idx_ == op2.slot_idx_ &&
+      op1.batch_target_ == op2.batch_target_ &&
+      op1.latency_slo_usec_ == op2.latency_slo_usec_;
   }
 
  private:
@@ -111,6 +162,10 @@ class SharedMemOptions {
   int label_idx_ = -1;
   comm::RecvOptions options_;
   TransferType type_ = CLIENT;
+  int num_slot_ = 1;
+  int slot_idx_ = 0;
+  BatchTarget batch_target_ = FIXED;
+  int latency_slo_usec_ = 0;
 };
 
 class SharedMemData {
@@ -118,7 +173,24 @@ class SharedMemData {
   SharedMemData(
       const SharedMemOptions& opts,
       const std::unordered_map<std::string, AnyP>& mem)
-      : opts_(opts), mem_(mem) {}
+      : opts_(opts), mem_(mem) {
+    _buildSlots();
+  }
+
+  SharedMemData(const SharedMemData& other)
+      : active_batch_size_(other.active_batch_size_),
+        opts_(other.opts_),
+        mem_(other.mem_) {
+    _buildSlots();
+  }
+
+  SharedMemData& operator=(const SharedMemData& other) {
+    active_batch_size_ = other.active_batch_size_;
+    opts_ = other.opts_;
+    mem_ = other.mem_;
+    _buildSlots();
+    return *this;
+  }
 
   std::string info() const {
     std::stringstream ss;
@@ -144,6 +216,17 @@ class SharedMemData {
     }
   }
 
+  // Same as operator[](field.getName()), without hashing the name.
+  AnyP* operator[](const FuncMapBase& field) {
+    AnyP* anyp = _slot(field);
+    return anyp != nullptr ? anyp : (*this)[field.getName()];
+  }
+
+  const AnyP* operator[](const FuncMapBase& field) const {
+    const AnyP* anyp = _slot(field);
+    return anyp != nullptr ? anyp : (*this)[field.getName()];
+  }
+
   // [TODO] For python to use.
   AnyP* get(const std::string& key) {
     return (*this)[key];
@@ -201,6 +284,39 @@ class SharedMemData {
   size_t active_batch_size_ = 0;
   SharedMemOptions opts_;
   std::unordered_map<std::string, AnyP> mem_;
+
+  // mem_ indexed by FuncMapBase::getId() - minFieldId_.
+  int minFieldId_ = 0;
+  std::vector<AnyP*> slots_;
+
+  void _buildSlots() {
+    slots_.clear();
+    if (mem_.empty()) {
+      return;
+    }
+    minFieldId_ = mem_.begin()->second.field().getId();
+    int max_id = minFieldId_;
+    for (const auto& p : mem_) {
+      minFieldId_ = std::min(minFieldId_, p.second.field().getId());
+      max_id = std::max(max_id, p.second.field().getId());
+    }
+    slots_.resize(max_id - minFieldId_ + 1, nullptr);
+    for (auto& p : mem_) {
+      // Keys are field names, but a field may be stored under another key.
+      if (p.first == p.second.field().getName()) {
+        slots_[p.second.field().getId() - minFieldId_] = &p.second;
+      }
+    }
+  }
+
+  AnyP* _slot(const FuncMapBase& field) const {
+    size_t i = field.getId() - minFieldId_;
+    if (field.getId() < minFieldId_ || i >= slots_.size() ||
+        slots_[i] == nullptr || &slots_[i]->field() != &field) {
+      return nullptr;
+    }
+    return slots_[i];
+  }
 };
 
 } // namespace elf
@@ -0,0 +1,132 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+// Packed point sets for the Go board.
+//
+// Bits are indexed by Coord, i.e. the expanded (BOARD_EXPAND_SIZE)^2 layout
+// that includes the one-point border. Moving to a neighbor is then a shift by
+// 1 or BOARD_EXPAND_SIZE over the whole bit vector, and anything that wraps
+// around a row lands on a border point, which never belongs to a stone or an
+// empty set. So no per-row masking is needed as long as results are and-ed
+// with such a set.
+//
+// All loops run over a fixed number of words so the compiler can unroll and
+// vectorize them (the build uses -march=native).
+
+#include <stdint.h>
+
+#include "common.h"
+
+// Must be included after BOUND_COORD is defined (see board.h).
+constexpr int BB_NUM_WORDS = (BOUND_COORD + 63) / 64;
+
+typedef struct {
+  uint64_t w[BB_NUM_WORDS];
+} BitBoard;
+
+inline void bbClear(BitBoard* bb) {
+  for (int i = 0; i < BB_NUM_WORDS; ++i)
+    bb->w[i] = 0;
+}
+
+inline void bbSet(BitBoard* bb, Coord c) {
+  bb->w[c >> 6] |= (1ULL << (c & 63));
+}
+
+inline void bbReset(BitBoard* bb, Coord c) {
+  bb->w[c >> 6] &= ~(1ULL << (c & 63));
+}
+
+inline bool bbTest(const BitBoard* bb, Coord c) {
+  return (bb->w[c >> 6] >> (c & 63)) & 1;
+}
+
+inline bool bbIsEmpty(const BitBoard* bb) {
+  uint64_t acc = 0;
+  for (int i = 0; i < BB_NUM_WORDS; ++i)
+    acc |= bb->w[i];
+  return acc == 0;
+}
+
+inline bool bbEqual(const BitBoard* a, const BitBoard* b) {
+  uint64_t acc = 0;
+  for (int i = 0; i < BB_NUM_WORDS; ++i)
+    acc |= a->w[i] ^ b->w[i];
+  return acc == 0;
+}
+
+inline int bbPopCount(const BitBoard* bb) {
+  int n = 0;
+  for (int i = 0; i < BB_NUM_WORDS; ++i)
+    n += __builtin_popcountll(bb->w[i]);
+  return n;
+}
+
+// dst = a & b
+inline void bbAnd(const BitBoard* a, const BitBoard* b, BitBoard* dst) {
+  for (int i = 0; i < BB_NUM_WORDS; ++i)
+    dst->w[i] = a->w[i] & b->w[i];
+}
+
+// dst = a & ~b
+inline void bbAndNot(const BitBoard* a, const BitBoard* b, BitBoard* dst) {
+  for (int i = 0; i < BB_NUM_WORDS; ++i)
+    dst->w[i] = a->w[i] & ~b->w[i];
+}
+
+// dst = a | b
+inline void bbOr(const BitBoard* a, const BitBoard* b, BitBoard* dst) {
+  for (int i = 0; i < BB_NUM_WORDS; ++i)
+    dst->w[i] = a->w[i] | b->w[i];
+}
+
+// All points that are 4-neighbors of at least one point in src (src itself is
+// not included unless a point is a neighbor of another point of src).
+inline void bbNeighbors(const BitBoard* src, BitBoard* dst) {
+  constexpr int kRow = BOARD_EXPAND_SIZE;
+  uint64_t out[BB_NUM_WORDS];
+  for (int i = 0; i < BB_NUM_WORDS; ++i) {
+    const uint64_t cur = src->w[i];
+    const uint64_t prev = i > 0 ? src->w[i - 1] : 0;
+    const uint64_t next = i + 1 < BB_NUM_WORDS ? src->w[i + 1] : 0;
+    // Toward higher coords (c + 1, c + row), then toward lower coords.
+    out[i] = (cur << 1) | (prev >> 63) | (cur << kRow) |
+        (prev >> (64 - kRow)) | (cur >> 1) | (next << 63) | (cur >> kRow) |
+        (next << (64 - kRow));
+  }
+  for (int i = 0; i < BB_NUM_WORDS; ++i)
+    dst->w[i] = out[i];
+}
+
+// src plus its 4-neighbors.
+inline void bbDilate(const BitBoard* src, BitBoard* dst) {
+  BitBoard n;
+  bbNeighbors(src, &n);
+  bbOr(src, &n, dst);
+}
+
+// Grow seed inside mask until it stops changing. The result is the union of
+// the connected components of mask that intersect seed.
+inline void
+bbFloodFill(const BitBoard* seed, const BitBoard* mask, BitBoard* dst) {
+  BitBoard cur, next;
+  bbAnd(seed, mask, &cur);
+  while (true) {
+    bbDilate(&cur, &next);
+    bbAnd(&next, mask, &next);
+    if (bbEqual(&next, &cur))
+      break;
+    cur = next;
+  }
+  *dst = cur;
+}
+
+// Set of all on-board points (border excluded).
+const BitBoard* bbOnBoard();
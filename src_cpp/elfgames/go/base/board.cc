@@ -35,7 +35,34 @@ uint64_t transform_hash(uint64_t h, Stone s) {
   }
 }
 
+// Journal of the PlayJournaled call running on this thread, if any.
+static thread_local BoardJournal* _journal = nullptr;
+
+// Record the value of an entry before Play changes it.
+static inline void journalInfo(const Board* board, Coord c) {
+  if (_journal == nullptr)
+    return;
+  BoardUndo* u = &_journal->moves.back();
+  if (bbTest(&u->info_saved, c))
+    return;
+  bbSet(&u->info_saved, c);
+  _journal->infos.push_back(InfoRecord{c, board->_infos[c]});
+}
+
+static inline void journalGroup(const Board* board, unsigned short id) {
+  if (_journal == nullptr)
+    return;
+  BoardUndo* u = &_journal->moves.back();
+  const uint64_t bit = 1ULL << (id & 63);
+  if (u->group_saved[id >> 6] & bit)
+    return;
+  u->group_saved[id >> 6] |= bit;
+  _journal->groups.push_back(
+      GroupRecord{(unsigned char)id, board->_groups[id]});
+}
+
 inline void set_color(Board* board, Coord c, Stone s) {
+  journalInfo(board, c);
   Stone old_s = board->_infos[c].color;
   board->_infos[c].color = s;
 
@@ -46,8 +73,118 @@ inline void set_color(Board* board, Coord c, Stone s) {
 
   uint64_t h = _board_hash[c];
 
-  board->_hash ^= transform_hash(h, old_s);
-  board->_hash ^= transform_hash(h, s);
+  board->_hash ^= transform_hash(h, old_s) ^ transform_hash(h, s);
+
+#ifdef GO_BITBOARD
+  // A point only goes from empty to a stone or back (or to S_OFF_BOARD on a
+  // cleared board), so at most one stone set flips.
+  Stone flipped = old_s ^ s;
+  if (HAS_STONE(flipped))
+    board->_stones[flipped - 1].w[c >> 6] ^= 1ULL << (c & 63);
+#endif
+}
+
+const BitBoard* bbOnBoard() {
+  static const BitBoard on_board = []() {
+    BitBoard bb;
+    bbClear(&bb);
+    for (int x = 0; x < BOARD_SIZE; ++x) {
+      for (int y = 0; y < BOARD_SIZE; ++y) {
+        bbSet(&bb, OFFSETXY(x, y));
+      }
+    }
+    return bb;
+  }();
+  return &on_board;
+}
+
+#ifdef GO_BITBOARD
+// Number of empty points next to stones, i.e. their liberties if they form a
+// group. The empty set is not built, its words are and-ed in on the fly.
+static inline int countLiberties(const Board* board, const BitBoard* stones) {
+  BitBoard n;
+  bbNeighbors(stones, &n);
+  const BitBoard* on_board = bbOnBoard();
+  int liberties = 0;
+  for (int i = 0; i < BB_NUM_WORDS; ++i) {
+    uint64_t occupied = board->_stones[0].w[i] | board->_stones[1].w[i];
+    liberties += __builtin_popcountll(n.w[i] & on_board->w[i] & ~occupied);
+  }
+  return liberties;
+}
+#endif
+
+void getEmptyBits(const Board* board, BitBoard* empty) {
+#ifdef GO_BITBOARD
+  BitBoard stones;
+  bbOr(&board->_stones[0], &board->_stones[1], &stones);
+  bbAndNot(bbOnBoard(), &stones, empty);
+#else
+  bbClear(empty);
+  for (int x = 0; x < BOARD_SIZE; ++x) {
+    for (int y = 0; y < BOARD_SIZE; ++y) {
+      Coord c = OFFSETXY(x, y);
+      if (board->_infos[c].color == S_EMPTY)
+        bbSet(empty, c);
+    }
+  }
+#endif
+}
+
+void getStoneBits(const Board* board, BitBoard* black, BitBoard* white) {
+#ifdef GO_BITBOARD
+  *black = board->_stones[S_BLACK - 1];
+  *white = board->_stones[S_WHITE - 1];
+#else
+  bbClear(black);
+  bbClear(white);
+  for (int x = 0; x < BOARD_SIZE; ++x) {
+    for (int y = 0; y < BOARD_SIZE; ++y) {
+      Coord c = OFFSETXY(x, y);
+      Stone s = board->_infos[c].color;
+      if (s == S_BLACK)
+        bbSet(black, c);
+      else if (s == S_WHITE)
+        bbSet(white, c);
+    }
+  }
+#endif
+}
+
+int ttScore(const Board* board, int* black_area, int* white_area) {
+  BitBoard black, white, empty;
+  getStoneBits(board, &black, &white);
+  bbOr(&black, &white, &empty);
+  bbAndNot(bbOnBoard(), &empty, &empty);
+
+  // Stones of a player plus the empty regions that touch them.
+  BitBoard black_reach, white_reach, mask;
+  bbOr(&black, &empty, &mask);
+  bbFloodFill(&black, &mask, &black_reach);
+  bbOr(&white, &empty, &mask);
+  bbFloodFill(&white, &mask, &white_reach);
+
+  // Empty regions that touch both colors are neutral.
+  BitBoard area;
+  bbAndNot(&black_reach, &white_reach, &area);
+  const int b = bbPopCount(&area);
+  bbAndNot(&white_reach, &black_reach, &area);
+  const int w = bbPopCount(&area);
+
+  if (black_area != nullptr)
+    *black_area = b;
+  if (white_area != nullptr)
+    *white_area = w;
+  return b - w;
+}
+
+void ttScoreBatch(const Board* const* boards, int n, int* scores) {
+  for (int i = 0; i < n; ++i) {
+    // Pull the next board in while this one is being filled.
+    if (i + 1 < n)
+      __builtin_prefetch(boards[i + 1]->_infos);
+    scores[i] = ttScore(boards[i], nullptr, nullptr);
+  }
 }
 
 bool isBitsEqual(const Board::Bits bits1, const Board::Bits bits2) {
@@ -270,8 +407,6 @@ bool isSelfAtari(
   if (ids->liberty >= 2)
     return false;
 
-  // Self-Atari is too complicated, it is just better to mimic the move and
-  // check the liberties.
   // If one of the self group has > 2 liberty, it is definitely not self-atari.
   for (int i = 0; i < 4; ++i) {
     if (ids->ids[i] != 0 && ids->colors[i] == player) {
@@ -280,16 +415,37 @@ bool isSelfAtari(
     }
   }
 
-  // Then we duplicate a board and check.
-  Board b2;
-  copyBoard(&b2, board);
-  Play(&b2, ids);
-  // showBoard(&b2, SHOW_LAST_MOVE);
+  // Compute the liberties of the group formed by the move without playing it:
+  // the stone plus the friendly groups it connects, whose liberties are the
+  // empty points around them once c is filled and the enemy groups in atari
+  // are removed.
+  BitBoard stones, empty, libs;
+  bbClear(&stones);
+  bbSet(&stones, c);
+  getEmptyBits(board, &empty);
+  bbReset(&empty, c);
+  for (int i = 0; i < 4; ++i) {
+    unsigned char id = ids->ids[i];
+    if (id == 0)
+      continue;
+    if (ids->colors[i] == player) {
+      TRAVERSE(board, id, cc) {
+        bbSet(&stones, cc);
+      }
+      ENDTRAVERSE
+    } else if (ids->group_liberties[i] == 1) {
+      TRAVERSE(board, id, cc) {
+        bbSet(&empty, cc);
+      }
+      ENDTRAVERSE
+    }
+  }
+  bbNeighbors(&stones, &libs);
+  bbAnd(&libs, &empty, &libs);
 
-  short id = b2._infos[c].id;
-  if (b2._groups[id].liberties == 1) {
+  if (bbPopCount(&libs) == 1) {
     if (num_stones != nullptr)
-      *num_stones = b2._groups[id].stones;
+      *num_stones = bbPopCount(&stones);
     return true;
   } else {
     return false;
@@ -297,7 +453,14 @@ bool isSelfAtari(
 }
 
 #define MAX_LADDER_SEARCH 1024
-int checkLadderUseSearch(Board* board, Stone victim, int* num_call, int depth) {
+// Moves are played on board with journal and taken back before returning, so
+// board is left unchanged.
+int checkLadderUseSearch(
+    Board* board,
+    Stone victim,
+    int* num_call,
+    int depth,
+    BoardJournal* journal) {
   (*num_call)++;
   Coord c = board->_last_move;
   Coord c2 = board->_last_move2;
@@ -356,9 +519,10 @@ int checkLadderUseSearch(Board* board, Stone victim, int* num_call, int depth) {
     if (must_block != M_PASS) {
       // It suffices to only play must_block.
       if (TryPlay2(board, must_block, &ids)) {
-        Play(board, &ids);
+        PlayJournaled(board, &ids, journal);
         int final_depth =
-            checkLadderUseSearch(board, victim, num_call, depth + 1);
+            checkLadderUseSearch(board, victim, num_call, depth + 1, journal);
+        Undo(board, journal);
         if (final_depth > 0)
           return final_depth;
       }
@@ -371,22 +535,15 @@ int checkLadderUseSearch(Board* board, Stone victim, int* num_call, int depth) {
       // showBoard(board, SHOW_ALL);
 
       // We need to play both. This should seldomly happen.
-      Board b_next;
-      copyBoard(&b_next, board);
-      if (TryPlay2(&b_next, escape[0], &ids)) {
-        Play(&b_next, &ids);
-        int final_depth =
-            checkLadderUseSearch(&b_next, victim, num_call, depth + 1);
-        if (final_depth > 0)
-          return final_depth;
-      }
-
-      if (TryPlay2(board, escape[1], &ids)) {
-        Play(board, &ids);
-        int final_depth =
-            checkLadderUseSearch(board, victim, num_call, depth + 1);
-        if (final_depth > 0)
-          return final_depth;
+      for (int i = 0; i < 2; ++i) {
+        if (TryPlay2(board, escape[i], &ids)) {
+          PlayJournaled(board, &ids, journal);
+          int final_depth = checkLadderUseSearch(
+              board, victim, num_call, depth + 1, journal);
+          Undo(board, journal);
+          if (final_depth > 0)
+            return final_depth;
+        }
       }
     }
   } else {
@@ -411,10 +568,9 @@ int checkLadderUseSearch(Board* board, Stone victim, int* num_call, int depth) {
       return 0;
     }
     if (TryPlay2(board, flee_loc, &ids)) {
-      Play(board, &ids);
+      PlayJournaled(board, &ids, journal);
       unsigned char id = board->_infos[flee_loc].id;
-      if (board->_groups[id].liberties >= 3)
-        return 0;
+      bool escaped = board->_groups[id].liberties >= 3;
       if (board->_groups[id].liberties == 2) {
         // Check if the neighboring enemy stone has only one liberty, if so,
         // then it is not a ladder.
@@ -425,12 +581,14 @@ int checkLadderUseSearch(Board* board, Stone victim, int* num_call, int depth) {
           // If the enemy group is in atari but our group has 2 liberties, then
           // it is not a ladder.
           if (board->_groups[id2].liberties == 1)
-            return 0;
+            escaped = true;
         }
         ENDFOR4
       }
-      int final_depth =
-          checkLadderUseSearch(board, victim, num_call, depth + 1);
+      int final_depth = escaped
+          ? 0
+          : checkLadderUseSearch(board, victim, num_call, depth + 1, journal);
+      Undo(board, journal);
       if (final_depth > 0)
         return final_depth;
     }
@@ -515,10 +673,13 @@ int checkLadder(const Board* board, const GroupId4* ids, Stone player) {
 
     // Play victim's move.
     Play(&b_next, ids);
-    // Check whether it will lead to ladder.
+    // Check whether it will lead to ladder. The search reads on b_next and
+    // takes its moves back, the journal is per thread so its buffers are
+    // reused.
+    static thread_local BoardJournal journal;
     int num_call = 0;
     int depth = 1;
-    return checkLadderUseSearch(&b_next, player, &num_call, depth);
+    return checkLadderUseSearch(&b_next, player, &num_call, depth, &journal);
   }
   return 0;
 }
@@ -534,6 +695,7 @@ void RemoveStoneAndAddLiberty(Board* board, Coord c) {
     unsigned short id = ids.ids[i];
     if (id == 0 || id == board->_infos[c].id)
       continue;
+    journalGroup(board, id);
     board->_groups[id].liberties++;
   }
 
@@ -548,6 +710,10 @@ void RemoveStoneAndAddLiberty(Board* board, Coord c) {
 bool EmptyGroup(Board* board, unsigned short group_id) {
   if (group_id == 0)
     return false;
+  // Stone by stone with either engine: each stone needs its point entries,
+  // hash and journal updated anyway, and a bitboard pass over the neighbors
+  // of the group measured slower (bench_cpp_elfgames_go_board) at the sizes
+  // that get captured.
   Coord c = board->_groups[group_id].start;
   while (c != 0) {
     // printf("Remove stone (%d, %d)\n", X(c), Y(c));
@@ -595,8 +761,10 @@ void RemoveAllEmptyGroups(Board* board) {
     if (id != last_id) {
       // Swap with the last entry.
       // Copy the structure.
+      journalGroup(board, id);
       memcpy(&board->_groups[id], &board->_groups[last_id], sizeof(Group));
       TRAVERSE(board, id, c) {
+        journalInfo(board, c);
         board->_infos[c].id = id;
       }
       ENDTRAVERSE
@@ -660,6 +828,7 @@ bool EmptyGroupAt(Board *board, Coord c) {
 
 unsigned short createNewGroup(Board* board, Coord c, int liberty) {
   unsigned short id = board->_num_groups++;
+  journalGroup(board, id);
   board->_groups[id].color = board->_infos[c].color;
   board->_groups[id].start = c;
   board->_groups[id].liberties = liberty;
@@ -681,6 +850,7 @@ bool MergeToGroup(Board* board, Coord c, unsigned short id) {
 
   board->_infos[c].id = id;
   // Put the new stone to the beginning of the group.
+  journalGroup(board, id);
   board->_infos[c].next = board->_groups[id].start;
   board->_groups[id].start = c;
   board->_groups[id].stones++;
@@ -724,7 +894,10 @@ MergeGroups(Board* board, unsigned short id1, unsigned short id2) {
   // Merge
   // Find the last stone in id2.
   Coord last_c_in_id2 = 0;
+  journalGroup(board, id1);
+  journalGroup(board, id2);
   TRAVERSE(board, id2, c) {
+    journalInfo(board, c);
     board->_infos[c].id = id1;
     last_c_in_id2 = c;
   }
@@ -756,6 +929,20 @@ bool RecomputeGroupLiberties(Board* board, unsigned short id) {
   // Borrowing _info.next for counting. No extra space needed.
   if (id == 0)
     return false;
+  // The .next fields borrowed below are reset before returning, so only the
+  // group entry needs to be journaled.
+  journalGroup(board, id);
+#ifdef GO_BITBOARD
+  // Liberties = (neighbors of the group) & empty, counted with popcount.
+  BitBoard group;
+  bbClear(&group);
+  TRAVERSE(board, id, c) {
+    bbSet(&group, c);
+  }
+  ENDTRAVERSE
+  board->_groups[id].liberties = countLiberties(board, &group);
+  return true;
+#else
   short liberty = 0;
   TRAVERSE(board, id, c){FOR4(c, _, c4){Info* info = &board->_infos[c4];
   if (G_EMPTY(info->id) && info->next == 0) {
@@ -779,6 +966,7 @@ ENDTRAVERSE
 
 board->_groups[id].liberties = liberty;
 return true;
+#endif
 }
 
 bool TryPlay2(const Board* board, Coord m, GroupId4* ids) {
@@ -946,14 +1134,62 @@ void FindAllCandidateMovesInRegion(
   }
 }
 
+#ifdef GO_BITBOARD
+// Empty points with at least one empty neighbor. Such a point can never be a
+// suicide, so only the ko check is needed for it.
+static inline void getFreePoints(const Board* board, BitBoard* free_points) {
+  BitBoard empty;
+  getEmptyBits(board, &empty);
+  bbNeighbors(&empty, free_points);
+  bbAnd(free_points, &empty, free_points);
+}
+#endif
+
+void getLegalMoveBits(const Board* board, Stone player, BitBoard* legal) {
+  BitBoard empty, free_points;
+  getEmptyBits(board, &empty);
+  bbNeighbors(&empty, &free_points);
+  bbAnd(&free_points, &empty, &free_points);
+  *legal = free_points;
+
+  // Empty points without an empty neighbor: suicide unless they connect to a
+  // friendly group with another liberty or capture. There are few of them.
+  BitBoard enclosed;
+  bbAndNot(&empty, &free_points, &enclosed);
+  GroupId4 ids;
+  for (int i = 0; i < BB_NUM_WORDS; ++i) {
+    for (uint64_t w = enclosed.w[i]; w != 0; w &= w - 1) {
+      Coord c = i * 64 + __builtin_ctzll(w);
+      StoneLibertyAnalysis(board, player, c, &ids);
+      if (!isSuicideMove(&ids))
+        bbSet(legal, c);
+    }
+  }
+
+  if (board->_simple_ko != M_PASS &&
+      isSimpleKoViolation(board, board->_simple_ko, player))
+    bbReset(legal, board->_simple_ko);
+}
+
 void FindAllValidMoves(const Board* board, Stone player, AllMoves* all_moves) {
   GroupId4 ids;
   Coord c;
   all_moves->board = board;
   all_moves->num_moves = 0;
+#ifdef GO_BITBOARD
+  BitBoard free_points;
+  getFreePoints(board, &free_points);
+#endif
   for (int x = 0; x < BOARD_SIZE; ++x) {
     for (int y = 0; y < BOARD_SIZE; ++y) {
       c = OFFSETXY(x, y);
+#ifdef GO_BITBOARD
+      if (bbTest(&free_points, c)) {
+        if (!isSimpleKoViolation(board, c, player))
+          all_moves->moves[all_moves->num_moves++] = c;
+        continue;
+      }
+#endif
       if (!EMPTY(board->_infos[c].color))
         continue;
       StoneLibertyAnalysis(board, player, c, &ids);
@@ -988,9 +1224,20 @@ void FindAllValidMovesInRegion(
   Coord c;
   all_moves->board = board;
   all_moves->num_moves = 0;
+#ifdef GO_BITBOARD
+  BitBoard free_points;
+  getFreePoints(board, &free_points);
+#endif
   for (int x = left; x < right; ++x) {
     for (int y = top; y < bottom; ++y) {
       c = OFFSETXY(x, y);
+#ifdef GO_BITBOARD
+      if (bbTest(&free_points, c)) {
+        if (!isSimpleKoViolation(board, c, board->_next_player))
+          all_moves->moves[all_moves->num_moves++] = c;
+        continue;
+      }
+#endif
       if (!EMPTY(board->_infos[c].color))
         continue;
       StoneLibertyAnalysis(board, board->_next_player, c, &ids);
@@ -1321,6 +1568,7 @@ bool Play(Board* board, const GroupId4* ids) {
       continue;
     unsigned short id = ids->ids[i];
     Group* g = &board->_groups[id];
+    journalGroup(board, id);
 
     Stone s = g->color;
     // The group adjacent to it lose one liberty.
@@ -1400,6 +1648,45 @@ bool Play(Board* board, const GroupId4* ids) {
   return false;
 }
 
+bool PlayJournaled(Board* board, const GroupId4* ids, BoardJournal* journal) {
+  journal->moves.emplace_back();
+  BoardUndo* u = &journal->moves.back();
+  const char* p = reinterpret_cast<const char*>(board);
+  memcpy(u->head, p + offsetof(Board, _bits), sizeof(u->head));
+  memcpy(u->tail, p + offsetof(Board, _num_groups), sizeof(u->tail));
+  u->info_start = journal->infos.size();
+  u->group_start = journal->groups.size();
+  bbClear(&u->info_saved);
+  memset(u->group_saved, 0, sizeof(u->group_saved));
+
+  _journal = journal;
+  bool end = Play(board, ids);
+  _journal = nullptr;
+  return end;
+}
+
+bool Undo(Board* board, BoardJournal* journal) {
+  if (journal->moves.empty())
+    return false;
+  const BoardUndo* u = &journal->moves.back();
+  for (size_t i = u->info_start; i < journal->infos.size(); ++i) {
+    const InfoRecord& r = journal->infos[i];
+    board->_infos[r.c] = r.info;
+  }
+  for (size_t i = u->group_start; i < journal->groups.size(); ++i) {
+    const GroupRecord& r = journal->groups[i];
+    board->_groups[r.id] = r.group;
+  }
+  char* p = reinterpret_cast<char*>(board);
+  memcpy(p + offsetof(Board, _bits), u->head, sizeof(u->head));
+  memcpy(p + offsetof(Board, _num_groups), u->tail, sizeof(u->tail));
+
+  journal->infos.resize(u->info_start);
+  journal->groups.resize(u->group_start);
+  journal->moves.pop_back();
+  return true;
+}
+
 bool UndoPass(Board* board) {
   if (board->_last_move != M_PASS)
     return false;
@@ -1724,6 +2011,24 @@ void VerifyBoard(Board* board) {
     }
   }
 
+#ifdef GO_BITBOARD
+  // 1.5 Check the packed stone sets against the point table.
+  for (int i = 0; i < BOARD_SIZE; ++i) {
+    for (int j = 0; j < BOARD_SIZE; ++j) {
+      Coord c = OFFSETXY(i, j);
+      Stone s = board->_infos[c].color;
+      if (bbTest(&board->_stones[0], c) != (s == S_BLACK) ||
+          bbTest(&board->_stones[1], c) != (s == S_WHITE)) {
+        printf(
+            "[VerifyError]: bitboard and stone [%d] mismatch at (%d, %d)\n",
+            s,
+            X(c),
+            Y(c));
+      }
+    }
+  }
+#endif
+
   if (board->_num_groups < 1 || board->_num_groups >= MAX_GROUP) {
     printf(
         "[VerifyError]: #groups = %d [MAX_GROUP = %d]",
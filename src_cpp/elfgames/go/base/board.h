@@ -9,7 +9,9 @@
 #pragma once
 
 #include <memory.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <vector>
 #include "common.h"
 
 // 19x19 only
@@ -26,18 +28,37 @@
   ((((i) == 2 || (i) == 6) && ((j) == 2 || (j) == 6)) || (i == 4 && j == 4))
 #define BOARD9_PROMPT "A B C D E F G H J"
 
-#ifdef BOARD9x9
+// The board size is set at build time with GO_BOARD_SIZE (9, 13 or 19).
+// BOARD9x9 is a shorthand for GO_BOARD_SIZE=9. Each size is a separate build
+// of the engine, see GO_EXTRA_BOARD_SIZES in CMakeLists.txt.
+#if !defined(GO_BOARD_SIZE) && defined(BOARD9x9)
+#define GO_BOARD_SIZE 9
+#endif
+
+#ifndef GO_BOARD_SIZE
+#define GO_BOARD_SIZE 19
+#endif
+
+#if GO_BOARD_SIZE == 9
 
 #define STAR_ON STAR_ON9
 #define BOARD_PROMPT BOARD9_PROMPT
 #define __MACRO_BOARD_SIZE 9
 
-#else
+#elif GO_BOARD_SIZE == 13
+
+#define STAR_ON STAR_ON13
+#define BOARD_PROMPT BOARD13_PROMPT
+#define __MACRO_BOARD_SIZE 13
+
+#elif GO_BOARD_SIZE == 19
 
 #define STAR_ON STAR_ON19
 #define BOARD_PROMPT BOARD19_PROMPT
 #define __MACRO_BOARD_SIZE 19
 
+#else
+#error "GO_BOARD_SIZE must be 9, 13 or 19"
 #endif
 
 constexpr int BOARD_SIZE = __MACRO_BOARD_SIZE;
@@ -97,6 +118,8 @@ Next step
 // Maximum possible value of coords.
 constexpr int BOUND_COORD = BOARD_EXPAND_SIZE * BOARD_EXPAND_SIZE;
 
+#include "bitboard.h"
+
 // Board
 typedef struct {
   // Board
@@ -106,6 +129,14 @@ typedef struct {
   Bits _bits;
   uint64_t _hash;
 
+#ifdef GO_BITBOARD
+  // Packed stone sets, _stones[S_BLACK - 1] and _stones[S_WHITE - 1], kept in
+  // sync with _infos[].color. Used by the word-parallel paths (liberty
+  // recount, move generation). Note that with these sizeof(Board) exceeds
+  // 4096 on 19x19.
+  BitBoard _stones[2];
+#endif
+
   // Group info
   Group _groups[MAX_GROUP];
   // Number of groups, including group 0 (empty intersection). So for empty
@@ -163,6 +194,41 @@ typedef struct {
   int num_moves;
 } AllMoves;
 
+// Make/unmake support. PlayJournaled records the original value of every Info
+// and Group entry that Play overwrites, plus the remaining per-board fields
+// (bits, hash, captures, ko, last moves, ply), and Undo writes them back. A
+// search can then walk a single mutable board instead of copying it at every
+// node. The journal is a stack, moves are taken back in reverse order. Its
+// buffers are kept across moves, so a reused journal does not allocate.
+typedef struct {
+  Coord c;
+  Info info;
+} InfoRecord;
+
+typedef struct {
+  unsigned char id;
+  Group group;
+} GroupRecord;
+
+typedef struct {
+  // Raw copies of Board from _bits up to _groups, and from _num_groups to the
+  // end.
+  unsigned char head[offsetof(Board, _groups) - offsetof(Board, _bits)];
+  unsigned char tail[sizeof(Board) - offsetof(Board, _num_groups)];
+  // Where the records of this move start in BoardJournal.
+  size_t info_start;
+  size_t group_start;
+  // Entries already recorded for this move. Only the first value is kept.
+  BitBoard info_saved;
+  uint64_t group_saved[(MAX_GROUP + 63) / 64];
+} BoardUndo;
+
+typedef struct {
+  std::vector<BoardUndo> moves;
+  std::vector<InfoRecord> infos;
+  std::vector<GroupRecord> groups;
+} BoardJournal;
+
 #define OPPONENT(p) ((Stone)(S_WHITE + S_BLACK - (int)(p)))
 #define HAS_STONE(s) (((s) == S_BLACK) || ((s) == S_WHITE))
 #define EMPTY(s) ((s) == S_EMPTY)
@@ -303,6 +369,12 @@ bool Play(Board* board, const GroupId4* ids);
 // Place handicap stone.
 bool PlaceHandicap(Board* board, int x, int y, Stone player);
 
+// Same as Play, and push what it changes onto journal.
+bool PlayJournaled(Board* board, const GroupId4* ids, BoardJournal* journal);
+// Take back the last move pushed onto journal, restoring the board exactly.
+// Return false if journal is empty.
+bool Undo(Board* board, BoardJournal* journal);
+
 // Undo pass, currently we only support undo at most 2 passes.
 // Return true if last_move_ is pass.
 // After Undo, last_move4 is not usable.
@@ -333,6 +405,9 @@ void FindAllCandidateMovesInRegion(
 
 // Find all valid moves including self-atari.
 void FindAllValidMoves(const Board* board, Stone player, AllMoves* all_moves);
+// Same as a mask: bit c of legal is set iff TryPlay() of c by player succeeds.
+// Pass is not included.
+void getLegalMoveBits(const Board* board, Stone player, BitBoard* legal);
 void showBoardFancy(const Board* board, ShowChoice choice);
 void showBoard2Buf(const Board* board, ShowChoice choice, char* buf);
 void showBoard(const Board* board, ShowChoice choice);
@@ -410,6 +485,19 @@ bool isTrueEye(const Board* board, Coord c, Stone player);
 bool isTrueEyeXY(const Board* board, int x, int y, Stone player);
 Stone getEyeColor(const Board* board, Coord c);
 
+// Empty on-board points.
+void getEmptyBits(const Board* board, BitBoard* empty);
+// Black and white stones.
+void getStoneBits(const Board* board, BitBoard* black, BitBoard* white);
+
+// Tromp-Taylor area scoring, without dead stone removal. The area of a player
+// is its stones plus the empty points that reach only its stones. If not
+// nullptr, black_area/white_area receive the two areas. Return
+// black_area - white_area.
+int ttScore(const Board* board, int* black_area, int* white_area);
+// Score n boards, scores[i] = ttScore(boards[i], nullptr, nullptr).
+void ttScoreBatch(const Board* const* boards, int n, int* scores);
+
 bool isBitsEqual(const Board::Bits bits1, const Board::Bits bits2);
 void copyBits(Board::Bits bits_dst, const Board::Bits bits_src);
 
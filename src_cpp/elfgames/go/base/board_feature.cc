@@ -248,7 +248,7 @@ void BoardFeature::extractAGZ(float* features) const {
   std::fill(features, features + MAX_NUM_AGZ_FEATURE * kBoardRegion, 0.0);
 
   const Board* _board = &s_.board();
-  // get history of type std::deque<BoardHistory>
+  // get history of type BoardHistoryWindow
   // and BoardHistory is a struct with members:
   // std::vector<Coord> black;
   // std::vector<Coord> white;
@@ -264,9 +264,9 @@ void BoardFeature::extractAGZ(float* features) const {
 
   // Save the current board state to game state.
   int i = 0;
-  for (auto it = history.rbegin(); it != history.rend(); ++it) {
-    const std::vector<Coord>* myself = &it->black;
-    const std::vector<Coord>* opponent = &it->white;
+  for (size_t k = 0; k < history.size(); ++k) {
+    const std::vector<Coord>* myself = &history.recent(k).black;
+    const std::vector<Coord>* opponent = &history.recent(k).white;
     if (player == S_WHITE)
       std::swap(myself, opponent);
 
@@ -22,12 +22,23 @@ static std::vector<std::string> split(const std::string& s, char delim) {
   return elems;
 }
 
+// The table below is written for 19x19. Map its lines (4, 10 and 16) onto the
+// star point lines of the current board size.
+static int star_line(int v19) {
+  const int lo = BOARD_SIZE >= 13 ? 3 : 2;
+  if (v19 < 9)
+    return lo;
+  if (v19 == 9)
+    return BOARD_SIZE / 2;
+  return BOARD_SIZE - 1 - lo;
+}
+
 static Coord s2c(const std::string& s) {
   int row = s[0] - 'A';
   if (row >= 9)
     row--;
   int col = stoi(s.substr(1)) - 1;
-  return getCoord(row, col);
+  return getCoord(star_line(row), star_line(col));
 }
 
 HandicapTable::HandicapTable() {
@@ -86,10 +97,9 @@ bool GoState::forward(const Coord& c) {
 
   Play(&_board, &ids);
 
-  _moves.push_back(c);
-  _history.emplace_back(_board);
-  if (_history.size() > MAX_NUM_AGZ_HISTORY)
-    _history.pop_front();
+  _moves = std::make_shared<const _MoveNode>(
+      _MoveNode{c, getNumMoves() + 1, std::move(_moves)});
+  _history.push(_board);
   return true;
 }
 
@@ -99,25 +109,54 @@ bool GoState::_check_superko() const {
   if (lastMove() == M_PASS)
     return false;
 
+  // The verify hash is only computed once a Zobrist key matches.
   uint64_t key = _board._hash;
-  auto it = _board_hash.find(key);
-  if (it != _board_hash.end()) {
-    for (const auto& r : it->second) {
-      if (isBitsEqual(_board._bits, r.bits))
+  uint64_t verify = 0;
+  for (const _BoardHashNode* n = _board_hash_overlay.get(); n != nullptr;
+       n = n->prev.get()) {
+    if (n->key == key) {
+      if (verify == 0)
+        verify = superkoVerifyHash(_board._bits);
+      if (n->verify == verify)
         return true;
     }
   }
-  return false;
+
+  if (_board_hash == nullptr || !_board_hash->containsKey(key))
+    return false;
+  if (verify == 0)
+    verify = superkoVerifyHash(_board._bits);
+  return _board_hash->contains(key, verify);
 }
 
 void GoState::_add_board_hash(const Coord& c) {
   if (c == M_PASS)
     return;
 
-  uint64_t key = _board._hash;
-  auto& r = _board_hash[key];
-  r.emplace_back();
-  copyBits(r.back().bits, _board._bits);
+  auto node = std::make_shared<_BoardHashNode>();
+  node->key = _board._hash;
+  node->verify = superkoVerifyHash(_board._bits);
+  node->depth = _board_hash_overlay == nullptr
+      ? 1
+      : _board_hash_overlay->depth + 1;
+  node->prev = std::move(_board_hash_overlay);
+  _superko_hash += node->verify ^ (node->key * 0x9E3779B97F4A7C15ULL);
+  _board_hash_overlay = std::move(node);
+
+  if (_board_hash_overlay->depth <= kSuperkoOverlayMax)
+    return;
+
+  // Fold the overlay into a fresh table. The old table may still be used by
+  // other states, so it is never modified in place.
+  auto table = _board_hash == nullptr
+      ? std::make_shared<SuperkoTable>()
+      : std::make_shared<SuperkoTable>(*_board_hash);
+  for (const _BoardHashNode* n = _board_hash_overlay.get(); n != nullptr;
+       n = n->prev.get()) {
+    table->insert(n->key, n->verify);
+  }
+  _board_hash = std::move(table);
+  _board_hash_overlay.reset();
 }
 
 bool GoState::checkMove(const Coord& c) const {
@@ -133,8 +172,10 @@ void GoState::applyHandicap(int handi) {
 
 void GoState::reset() {
   clearBoard(&_board);
-  _moves.clear();
-  _board_hash.clear();
+  _moves.reset();
+  _board_hash.reset();
+  _board_hash_overlay.reset();
+  _superko_hash = 0;
   _history.clear();
   _final_value = 0.0;
   _has_final_value = false;
@@ -8,8 +8,9 @@
 
 #pragma once
 
-#include <deque>
-#include <queue>
+#include <algorithm>
+#include <array>
+#include <memory>
 #include <sstream>
 #include <unordered_map>
 #include <vector>
@@ -18,6 +19,7 @@
 
 #include "board.h"
 #include "board_feature.h"
+#include "superko.h"
 
 class HandicapTable {
  private:
@@ -29,68 +31,61 @@ class HandicapTable {
   void apply(int handi, Board* board) const;
 };
 
-inline std::vector<bool>
-simple_flood_fill(const Board& b, Stone player, std::ostream* oo = nullptr) {
-  std::queue<Coord> q;
-  for (int i = 0; i < BOARD_SIZE; ++i) {
-    for (int j = 0; j < BOARD_SIZE; ++j) {
-      Coord c = OFFSETXY(i, j);
-      if (b._infos[c].color == player) {
-        q.push(c);
-      }
-    }
-  }
+inline int simple_tt_scoring(const Board& b, std::ostream* oo = nullptr) {
+  // No dead stone considered.
+  int black_v = 0, white_v = 0;
+  int score = ttScore(&b, &black_v, &white_v);
 
   if (oo != nullptr)
-    *oo << "For player " << player2str(player) << ": #stone: " << q.size()
-        << std::endl;
-
-  std::vector<bool> open(BOARD_SIZE * BOARD_SIZE, false);
-  std::vector<bool> f(BOARD_SIZE * BOARD_SIZE, false);
-
-  int counter = 0;
-  while (!q.empty()) {
-    Coord c = q.front();
-    // if (oo != nullptr) *oo << coord2str2(c) << " ";
-    q.pop();
-    f[EXPORT_OFFSET(c)] = true;
-    counter++;
-
-    FOR4(c, _, cc)
-    int offset = EXPORT_OFFSET(cc);
-    if (b._infos[cc].color == S_EMPTY && !open[offset]) {
-      open[offset] = true;
-      q.push(cc);
-    }
-    ENDFOR4
+    *oo << "black_v: " << black_v << ", white: " << white_v << std::endl;
+  return score;
+}
+
+// The most recent MAX_NUM_AGZ_HISTORY board histories. Entries are immutable
+// and shared between copies, so copying the window only bumps refcounts.
+class BoardHistoryWindow {
+ public:
+  void clear() {
+    for (auto& h : _h)
+      h.reset();
+    _size = 0;
+    _next = 0;
   }
 
-  if (oo != nullptr)
-    *oo << std::endl
-        << "For player " << player2str(player) << ": territory = " << counter
-        << std::endl;
-  return f;
-}
+  void push(const Board& b) {
+    _h[_next] = std::make_shared<const BoardHistory>(b);
+    _keys[_next] = b._hash;
+    _next = (_next + 1) % MAX_NUM_AGZ_HISTORY;
+    if (_size < MAX_NUM_AGZ_HISTORY)
+      _size++;
+  }
 
-inline int simple_tt_scoring(const Board& b, std::ostream* oo = nullptr) {
-  // No dead stone considered.
-  // [TODO] Can be more efficient with bitset.
-  // if (oo != nullptr) *oo << "In tt scoring" << endl;
-  std::vector<bool> black = simple_flood_fill(b, S_BLACK, oo);
-  std::vector<bool> white = simple_flood_fill(b, S_WHITE, oo);
+  size_t size() const {
+    return _size;
+  }
 
-  int black_v = 0, white_v = 0;
-  for (size_t i = 0; i < black.size(); ++i) {
-    if (black[i] && !white[i])
-      black_v++;
-    else if (white[i] && !black[i])
-      white_v++;
+  // i == 0 is the most recent board.
+  const BoardHistory& recent(size_t i) const {
+    return *_h[(_next + MAX_NUM_AGZ_HISTORY - 1 - i) % MAX_NUM_AGZ_HISTORY];
   }
 
-  if (oo != nullptr)
-    *oo << "black_v: " << black_v << ", white: " << white_v << std::endl;
-  return black_v - white_v;
-}
+  // Hash of the boards in the window, most recent first.
+  uint64_t hashCode() const {
+    uint64_t h = _size;
+    for (size_t i = 0; i < _size; ++i) {
+      h ^= _keys[(_next + MAX_NUM_AGZ_HISTORY - 1 - i) % MAX_NUM_AGZ_HISTORY];
+      h *= 0x9E3779B97F4A7C15ULL;
+      h ^= h >> 29;
+    }
+    return h;
+  }
+
+ private:
+  std::array<std::shared_ptr<const BoardHistory>, MAX_NUM_AGZ_HISTORY> _h;
+  std::array<uint64_t, MAX_NUM_AGZ_HISTORY> _keys;
+  size_t _size = 0;
+  size_t _next = 0;
+};
 
 class GoState {
  public:
@@ -114,9 +109,13 @@ class GoState {
   void reset();
   void applyHandicap(int handi);
 
+  // Only the board is copied. Move list, history and the superko positions
+  // are shared with s.
   GoState(const GoState& s)
       : _history(s._history),
         _board_hash(s._board_hash),
+        _board_hash_overlay(s._board_hash_overlay),
+        _superko_hash(s._superko_hash),
         _moves(s._moves),
         _final_value(s._final_value),
         _has_final_value(s._has_final_value) {
@@ -157,15 +156,18 @@ class GoState {
   }
 
   bool moves_since(const GoState& ref, std::vector<Coord>* moves) const {
-    if (ref._moves.size() > _moves.size()) {
+    if (ref.getNumMoves() > getNumMoves()) {
       // The move number is not right.
       return false;
     }
     moves->clear();
     // TODO: More rigid check?
-    for (size_t i = ref._moves.size(); i < _moves.size(); ++i) {
-      moves->push_back(_moves[i]);
+    for (const _MoveNode* m = _moves.get();
+         m != nullptr && m->num_moves > ref.getNumMoves();
+         m = m->prev.get()) {
+      moves->push_back(m->c);
     }
+    std::reverse(moves->begin(), moves->end());
     return true;
   }
 
@@ -173,8 +175,30 @@ class GoState {
     return _board._hash;
   }
 
-  const std::vector<Coord>& getAllMoves() const {
-    return _moves;
+  // Hash of the set of positions seen so far: states with the same one
+  // forbid the same repetitions (positional superko).
+  uint64_t getSuperkoHashCode() const {
+    return _superko_hash;
+  }
+
+  // Hash of everything the network input depends on: the board, the player
+  // to move and the board history.
+  uint64_t getHistoryHashCode() const {
+    uint64_t h = _history.hashCode() ^ _board._hash;
+    h *= 0x9E3779B97F4A7C15ULL;
+    return h ^ (h >> 31) ^ (uint64_t)_board._next_player;
+  }
+
+  size_t getNumMoves() const {
+    return _moves == nullptr ? 0 : _moves->num_moves;
+  }
+
+  std::vector<Coord> getAllMoves() const {
+    std::vector<Coord> moves(getNumMoves());
+    for (const _MoveNode* m = _moves.get(); m != nullptr; m = m->prev.get()) {
+      moves[m->num_moves - 1] = m->c;
+    }
+    return moves;
   }
 
   std::vector<Coord> getAllValidMoves() const {
@@ -190,7 +214,7 @@ class GoState {
 
   std::string getAllMovesString() const {
     std::stringstream ss;
-    for (const Coord& c : _moves) {
+    for (const Coord& c : getAllMoves()) {
       ss << "[" << coord2str2(c) << "] ";
     }
     return ss.str();
@@ -218,21 +242,40 @@ class GoState {
   }
 
   // TODO: not a good design..
-  const std::deque<BoardHistory>& getHistory() const {
+  const BoardHistoryWindow& getHistory() const {
     return _history;
   }
 
  protected:
   Board _board;
-  std::deque<BoardHistory> _history;
-
-  struct _BoardRecord {
-    Board::Bits bits;
+  BoardHistoryWindow _history;
+
+  // Positions seen so far in this game trajectory, as (Zobrist key, verify
+  // hash) pairs. Older positions live in an immutable SuperkoTable shared by
+  // all states of the trajectory, the path since then in a parent-linked
+  // overlay, so a copy never duplicates either. Once the overlay gets longer
+  // than kSuperkoOverlayMax, it is folded into a new table.
+  struct _BoardHashNode {
+    uint64_t key;
+    uint64_t verify;
+    size_t depth;
+    std::shared_ptr<const _BoardHashNode> prev;
   };
-
-  std::unordered_map<uint64_t, std::vector<_BoardRecord>> _board_hash;
-
-  std::vector<Coord> _moves;
+  static constexpr size_t kSuperkoOverlayMax = 64;
+
+  std::shared_ptr<const SuperkoTable> _board_hash;
+  std::shared_ptr<const _BoardHashNode> _board_hash_overlay;
+  // Sum of a hash of each of these positions (in any order).
+  uint64_t _superko_hash = 0;
+
+  // Persistent list of all moves, shared with the states this one was copied
+  // from.
+  struct _MoveNode {
+    Coord c;
+    size_t num_moves;
+    std::shared_ptr<const _MoveNode> prev;
+  };
+  std::shared_ptr<const _MoveNode> _moves;
   float _final_value = 0.0;
   bool _has_final_value = false;
 
@@ -0,0 +1,118 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <string.h>
+#include <vector>
+
+#include "board.h"
+
+// A second, independent hash of the packed board. A Zobrist match is only
+// accepted as a repeated position if this one matches too. Never returns 0.
+inline uint64_t superkoVerifyHash(const Board::Bits bits) {
+  auto mix = [](uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+  };
+
+  constexpr size_t n = sizeof(Board::Bits);
+  uint64_t h = 0x9e3779b97f4a7c15ULL;
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= n; i += sizeof(uint64_t)) {
+    uint64_t w;
+    ::memcpy(&w, bits + i, sizeof(w));
+    h = mix(h ^ w);
+  }
+  uint64_t tail = 0;
+  ::memcpy(&tail, bits + i, n - i);
+  h = mix(h ^ tail ^ n);
+  return h | 1;
+}
+
+// Set of positions, keyed by (Zobrist key, verify hash). Open addressing with
+// linear probing over a flat array, 16 bytes per position.
+class SuperkoTable {
+ public:
+  SuperkoTable() : _entries(kMinCapacity) {}
+
+  bool contains(uint64_t key, uint64_t verify) const {
+    const size_t mask = _entries.size() - 1;
+    for (size_t i = key & mask;; i = (i + 1) & mask) {
+      const Entry& e = _entries[i];
+      if (e.verify == 0)
+        return false;
+      if (e.key == key && e.verify == verify)
+        return true;
+    }
+  }
+
+  // Whether some position has this Zobrist key. Cheaper than contains() for
+  // the caller, which only needs the verify hash when this is true.
+  bool containsKey(uint64_t key) const {
+    const size_t mask = _entries.size() - 1;
+    for (size_t i = key & mask;; i = (i + 1) & mask) {
+      const Entry& e = _entries[i];
+      if (e.verify == 0)
+        return false;
+      if (e.key == key)
+        return true;
+    }
+  }
+
+  void insert(uint64_t key, uint64_t verify) {
+    // Keep the load factor at or below 1/2.
+    if ((_size + 1) * 2 > _entries.size())
+      _grow();
+    if (_insert(key, verify))
+      _size++;
+  }
+
+  size_t size() const {
+    return _size;
+  }
+
+ private:
+  static constexpr size_t kMinCapacity = 256;
+
+  struct Entry {
+    uint64_t key = 0;
+    // 0 marks an empty slot.
+    uint64_t verify = 0;
+  };
+
+  std::vector<Entry> _entries;
+  size_t _size = 0;
+
+  bool _insert(uint64_t key, uint64_t verify) {
+    const size_t mask = _entries.size() - 1;
+    for (size_t i = key & mask;; i = (i + 1) & mask) {
+      Entry& e = _entries[i];
+      if (e.verify == 0) {
+        e.key = key;
+        e.verify = verify;
+        return true;
+      }
+      if (e.key == key && e.verify == verify)
+        return false;
+    }
+  }
+
+  void _grow() {
+    std::vector<Entry> old(_entries.size() * 2);
+    old.swap(_entries);
+    for (const Entry& e : old) {
+      if (e.verify != 0)
+        _insert(e.key, e.verify);
+    }
+  }
+};
@@ -0,0 +1,190 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "elfgames/go/base/board.h"
+#include "elfgames/go/base/go_state.h"
+#include "elfgames/go/base/test/test_utils.h"
+
+TEST(BitBoardTest, testNeighbors) {
+  BitBoard bb, n;
+  bbClear(&bb);
+  bbSet(&bb, toFlat(4, 4));
+  bbNeighbors(&bb, &n);
+
+  EXPECT_EQ(bbPopCount(&n), 4);
+  EXPECT_TRUE(bbTest(&n, toFlat(3, 4)));
+  EXPECT_TRUE(bbTest(&n, toFlat(5, 4)));
+  EXPECT_TRUE(bbTest(&n, toFlat(4, 3)));
+  EXPECT_TRUE(bbTest(&n, toFlat(4, 5)));
+  EXPECT_FALSE(bbTest(&n, toFlat(4, 4)));
+
+  // Corner: two of the neighbors are border points.
+  bbClear(&bb);
+  bbSet(&bb, toFlat(BOARD_SIZE - 1, BOARD_SIZE - 1));
+  bbNeighbors(&bb, &n);
+  bbAnd(&n, bbOnBoard(), &n);
+  EXPECT_EQ(bbPopCount(&n), 2);
+}
+
+TEST(BitBoardTest, testFloodFill) {
+  GoState b;
+  std::string str("XX.......");
+  str += ".X.......";
+  str += ".X...X...";
+  for (int i = 0; i < 6; ++i)
+    str += ".........";
+  loadBoard(b, str);
+
+  const Board& board = b.board();
+  BitBoard black, seed, group;
+  bbClear(&black);
+  for (int i = 0; i < BOARD_SIZE; ++i) {
+    for (int j = 0; j < BOARD_SIZE; ++j) {
+      if (board._infos[toFlat(i, j)].color == S_BLACK)
+        bbSet(&black, toFlat(i, j));
+    }
+  }
+  bbClear(&seed);
+  bbSet(&seed, toFlat(0, 0));
+  bbFloodFill(&seed, &black, &group);
+
+  EXPECT_EQ(bbPopCount(&group), 4);
+  EXPECT_FALSE(bbTest(&group, toFlat(5, 2)));
+
+  BitBoard empty, libs;
+  getEmptyBits(&board, &empty);
+  EXPECT_EQ(bbPopCount(&empty), BOARD_SIZE * BOARD_SIZE - 5);
+  bbNeighbors(&group, &libs);
+  bbAnd(&libs, &empty, &libs);
+  unsigned char id = board._infos[toFlat(0, 0)].id;
+  EXPECT_EQ(bbPopCount(&libs), board._groups[id].liberties);
+}
+
+// Random games: group liberties and legal moves must agree with a reference
+// computed point by point.
+TEST(BitBoardTest, testRandomGames) {
+  std::mt19937 rng(0);
+  GoState b;
+  for (int game = 0; game < 50; ++game) {
+    b.reset();
+    for (int ply = 0; ply < 200; ++ply) {
+      const Board& board = b.board();
+      for (int id = 1; id < board._num_groups; ++id) {
+        BitBoard group, libs, empty;
+        bbClear(&group);
+        TRAVERSE((&board), id, c) {
+          bbSet(&group, c);
+        }
+        ENDTRAVERSE
+        bbNeighbors(&group, &libs);
+        getEmptyBits(&board, &empty);
+        bbAnd(&libs, &empty, &libs);
+        ASSERT_EQ(bbPopCount(&libs), board._groups[id].liberties);
+      }
+
+      std::vector<Coord> moves = b.getAllValidMoves();
+      std::vector<Coord> expected;
+      GroupId4 ids;
+      for (int x = 0; x < BOARD_SIZE; ++x) {
+        for (int y = 0; y < BOARD_SIZE; ++y) {
+          if (TryPlay(&board, x, y, board._next_player, &ids))
+            expected.push_back(OFFSETXY(x, y));
+        }
+      }
+      ASSERT_EQ(moves, expected);
+
+      BitBoard legal, expected_legal;
+      getLegalMoveBits(&board, board._next_player, &legal);
+      bbClear(&expected_legal);
+      for (Coord c : expected)
+        bbSet(&expected_legal, c);
+      ASSERT_TRUE(bbEqual(&legal, &expected_legal));
+      if (moves.empty())
+        break;
+      b.forward(moves[rng() % moves.size()]);
+    }
+  }
+}
+
+// Reference Tromp-Taylor area of player: stones plus empty points reached
+// from them, by breadth-first search.
+static std::vector<bool> ttArea(const Board& b, Stone player) {
+  std::vector<bool> f(BOUND_COORD, false);
+  std::vector<Coord> q;
+  for (int x = 0; x < BOARD_SIZE; ++x) {
+    for (int y = 0; y < BOARD_SIZE; ++y) {
+      if (b._infos[OFFSETXY(x, y)].color == player) {
+        f[OFFSETXY(x, y)] = true;
+        q.push_back(OFFSETXY(x, y));
+      }
+    }
+  }
+  while (!q.empty()) {
+    Coord c = q.back();
+    q.pop_back();
+    FOR4(c, _, cc) {
+      if (b._infos[cc].color == S_EMPTY && !f[cc]) {
+        f[cc] = true;
+        q.push_back(cc);
+      }
+    }
+    ENDFOR4
+  }
+  return f;
+}
+
+TEST(BitBoardTest, testTTScore) {
+  std::mt19937 rng(0);
+  std::vector<Board> boards;
+  std::vector<int> expected;
+  for (int game = 0; game < 20; ++game) {
+    GoState b;
+    for (int ply = 0; ply < 300; ++ply) {
+      std::vector<bool> black = ttArea(b.board(), S_BLACK);
+      std::vector<bool> white = ttArea(b.board(), S_WHITE);
+      int black_v = 0, white_v = 0;
+      for (int c = 0; c < BOUND_COORD; ++c) {
+        black_v += black[c] && !white[c];
+        white_v += white[c] && !black[c];
+      }
+
+      int black_area = 0, white_area = 0;
+      ASSERT_EQ(
+          ttScore(&b.board(), &black_area, &white_area), black_v - white_v);
+      EXPECT_EQ(black_area, black_v);
+      EXPECT_EQ(white_area, white_v);
+      if (ply % 10 == 0) {
+        boards.push_back(b.board());
+        expected.push_back(black_v - white_v);
+      }
+
+      std::vector<Coord> moves = b.getAllValidMoves();
+      if (moves.empty())
+        break;
+      b.forward(moves[rng() % moves.size()]);
+    }
+  }
+
+  std::vector<const Board*> ptrs;
+  for (const Board& board : boards)
+    ptrs.push_back(&board);
+  std::vector<int> scores(boards.size());
+  ttScoreBatch(ptrs.data(), ptrs.size(), scores.data());
+  EXPECT_EQ(scores, expected);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,193 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Random playouts on Board: every move is drawn among the valid moves that do
+// not fill an eye of the player, until both players pass, then the board is
+// scored (Tromp-Taylor). The games are then replayed, which only times the
+// board updates (TryPlay2 and Play: captures, merges, liberties). The same
+// source is built against each engine on 9x9 (bench_cpp_elfgames_go_board and
+// bench_cpp_elfgames_go_board_bitboard), so the two can be compared, and the
+// two play the same games. Prints one line per repetition, as JSON (default)
+// or CSV:
+//
+//   bench_cpp_elfgames_go_board --num_playout=20000 --num_repeat=5
+//
+// Run with --help for the flags and their defaults.
+
+#include <stdlib.h>
+
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "elfgames/go/base/board.h"
+
+using json = nlohmann::json;
+
+struct Flag {
+  std::string value;
+  std::string help;
+};
+
+static std::map<std::string, Flag> defaultFlags() {
+  return {
+      {"num_playout", {"10000", "Playouts per repetition"}},
+      {"max_move", {"1000", "Moves after which a playout stops"}},
+      {"num_repeat", {"3", "Repetitions"}},
+      {"seed", {"0", "Seed of the move choice"}},
+      {"format", {"json", "json or csv"}},
+  };
+}
+
+struct Result {
+  double sec = 0;
+  double replay_sec = 0;
+  long num_move = 0;
+  long num_capture = 0;
+  // Sum of the scores, so that the playouts cannot be optimized out. The
+  // replays subtract theirs, so it is 0 unless they differ.
+  long score = 0;
+};
+
+// Append the moves to moves.
+static int playout(
+    Board* b,
+    int max_move,
+    std::mt19937* rng,
+    std::vector<Coord>* moves) {
+  clearBoard(b);
+  AllMoves all_moves;
+  GroupId4 ids;
+  int num_pass = 0;
+  int num_move = 0;
+  while (num_move < max_move && num_pass < 2) {
+    Stone player = b->_next_player;
+    FindAllValidMoves(b, player, &all_moves);
+
+    // Scan from a random start for a move that does not fill an eye.
+    Coord m = M_PASS;
+    const int n = all_moves.num_moves;
+    const int start = n > 0 ? (*rng)() % n : 0;
+    for (int i = 0; i < n; ++i) {
+      Coord c = all_moves.moves[(start + i) % n];
+      if (!isEye(b, c, player)) {
+        m = c;
+        break;
+      }
+    }
+
+    num_pass = m == M_PASS ? num_pass + 1 : 0;
+    moves->push_back(m);
+    TryPlay2(b, m, &ids);
+    Play(b, &ids);
+    num_move++;
+  }
+  return num_move;
+}
+
+static Result run(int num_playout, int max_move, std::mt19937* rng) {
+  Board b;
+  Result r;
+  std::vector<Coord> moves;
+  std::vector<int> lengths;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < num_playout; ++i) {
+    lengths.push_back(playout(&b, max_move, rng, &moves));
+    r.num_move += lengths.back();
+    r.num_capture += b._b_cap + b._w_cap;
+    r.score += ttScore(&b, nullptr, nullptr);
+  }
+  std::chrono::duration<double> dur = std::chrono::steady_clock::now() - start;
+  r.sec = dur.count();
+
+  GroupId4 ids;
+  const Coord* m = moves.data();
+  start = std::chrono::steady_clock::now();
+  for (int n : lengths) {
+    clearBoard(&b);
+    for (int i = 0; i < n; ++i) {
+      TryPlay2(&b, *m++, &ids);
+      Play(&b, &ids);
+    }
+    r.score -= ttScore(&b, nullptr, nullptr);
+  }
+  dur = std::chrono::steady_clock::now() - start;
+  r.replay_sec = dur.count();
+  return r;
+}
+
+int main(int argc, char** argv) {
+  std::map<std::string, Flag> flags = defaultFlags();
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    size_t eq = arg.find('=');
+    if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos ||
+        flags.find(arg.substr(2, eq - 2)) == flags.end()) {
+      std::cout << "Usage: " << argv[0] << " [--flag=value ...]" << std::endl;
+      for (const auto& f : flags) {
+        std::cout << "  --" << f.first << " (" << f.second.value
+                  << "): " << f.second.help << std::endl;
+      }
+      return arg == "--help" ? 0 : 1;
+    }
+    flags[arg.substr(2, eq - 2)].value = arg.substr(eq + 1);
+  }
+
+  auto flag = [&flags](const std::string& key) {
+    return atoi(flags[key].value.c_str());
+  };
+  const bool csv = flags["format"].value == "csv";
+#ifdef GO_BITBOARD
+  const std::string engine = "bitboard";
+#else
+  const std::string engine = "plain";
+#endif
+
+  if (csv) {
+    std::cout << "engine,board_size,repeat,num_playout,num_move,sec,"
+              << "playouts_per_sec,usec_per_move,replay_usec_per_move,"
+              << "num_capture,score" << std::endl;
+  }
+
+  std::mt19937 rng(flag("seed"));
+  for (int repeat = 0; repeat < flag("num_repeat"); ++repeat) {
+    const int num_playout = flag("num_playout");
+    Result r = run(num_playout, flag("max_move"), &rng);
+    double per_sec = num_playout / r.sec;
+    double usec_per_move = r.sec * 1e6 / r.num_move;
+    double replay_usec_per_move = r.replay_sec * 1e6 / r.num_move;
+
+    if (csv) {
+      std::cout << engine << "," << BOARD_SIZE << "," << repeat << ","
+                << num_playout << "," << r.num_move << "," << r.sec << ","
+                << per_sec << "," << usec_per_move << ","
+                << replay_usec_per_move << "," << r.num_capture
+                << "," << r.score << std::endl;
+    } else {
+      json j;
+      j["engine"] = engine;
+      j["board_size"] = BOARD_SIZE;
+      j["repeat"] = repeat;
+      j["num_playout"] = num_playout;
+      j["num_move"] = r.num_move;
+      j["sec"] = r.sec;
+      j["playouts_per_sec"] = per_sec;
+      j["usec_per_move"] = usec_per_move;
+      j["replay_usec_per_move"] = replay_usec_per_move;
+      j["num_capture"] = r.num_capture;
+      j["score"] = r.score;
+      std::cout << j.dump() << std::endl;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,106 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "elfgames/go/base/board.h"
+#include "elfgames/go/base/go_state.h"
+#include "elfgames/go/base/test/test_utils.h"
+
+// Random games: a few moves played ahead with PlayJournaled must give the
+// same board as Play, and undoing them must restore the board byte by byte.
+TEST(BoardUndoTest, testPlayUndo) {
+  std::mt19937 rng(0);
+  BoardJournal journal;
+  for (int game = 0; game < 20; ++game) {
+    GoState s;
+    for (int ply = 0; ply < 150; ++ply) {
+      Board b, ref;
+      copyBoard(&b, &s.board());
+      copyBoard(&ref, &s.board());
+
+      for (int k = 0; k < 6; ++k) {
+        std::vector<Coord> moves;
+        GroupId4 ids;
+        for (int x = 0; x < BOARD_SIZE; ++x) {
+          for (int y = 0; y < BOARD_SIZE; ++y) {
+            if (TryPlay(&b, x, y, b._next_player, &ids))
+              moves.push_back(OFFSETXY(x, y));
+          }
+        }
+        // Passes are journaled as well.
+        moves.push_back(M_PASS);
+        TryPlay2(&b, moves[rng() % moves.size()], &ids);
+
+        Board expected;
+        copyBoard(&expected, &b);
+        Play(&expected, &ids);
+        PlayJournaled(&b, &ids, &journal);
+        ASSERT_TRUE(compareBoard(&b, &expected));
+      }
+      while (Undo(&b, &journal))
+        ;
+      ASSERT_TRUE(compareBoard(&b, &ref));
+      EXPECT_TRUE(journal.infos.empty());
+      EXPECT_TRUE(journal.groups.empty());
+
+      std::vector<Coord> moves = s.getAllValidMoves();
+      if (moves.empty())
+        break;
+      s.forward(moves[rng() % moves.size()]);
+    }
+  }
+}
+
+// isSelfAtari must agree with playing the move out on a copy.
+TEST(BoardUndoTest, testSelfAtari) {
+  std::mt19937 rng(1);
+  int num_self_atari = 0;
+  for (int game = 0; game < 20; ++game) {
+    GoState s;
+    for (int ply = 0; ply < 150; ++ply) {
+      const Board& board = s.board();
+      const Stone player = board._next_player;
+      GroupId4 ids;
+      for (int x = 0; x < BOARD_SIZE; ++x) {
+        for (int y = 0; y < BOARD_SIZE; ++y) {
+          if (!TryPlay(&board, x, y, player, &ids))
+            continue;
+          Board b2;
+          copyBoard(&b2, &board);
+          Play(&b2, &ids);
+          const Group& g = b2._groups[b2._infos[OFFSETXY(x, y)].id];
+
+          int num_stones = 0;
+          bool self_atari =
+              isSelfAtariXY(&board, &ids, x, y, player, &num_stones);
+          ASSERT_EQ(self_atari, g.liberties == 1);
+          if (self_atari) {
+            EXPECT_EQ(num_stones, g.stones);
+            num_self_atari++;
+          }
+        }
+      }
+
+      std::vector<Coord> moves = s.getAllValidMoves();
+      if (moves.empty())
+        break;
+      s.forward(moves[rng() % moves.size()]);
+    }
+  }
+  EXPECT_GT(num_self_atari, 0);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
@@ -13,6 +13,7 @@
  */
 
 #include <gtest/gtest.h>
+#include <random>
 #include <set>
 
 #include "elfgames/go/base/board.h"
@@ -664,6 +665,84 @@ TEST(GoTest, testReplayPosition) {
   EXPECT_TRUE(boardEqual(b, b2));
 }
 
+// Copies share move list, history and superko positions with the original.
+// Moving either one afterwards must not affect the other.
+TEST(GoTest, testSharedCopies) {
+  std::mt19937 rng(0);
+  GoState b;
+  std::vector<Coord> played;
+  for (int i = 0; i < 40; ++i) {
+    std::vector<Coord> moves = b.getAllValidMoves();
+    if (moves.empty())
+      break;
+    Coord m = moves[rng() % moves.size()];
+    if (!b.forward(m))
+      break;
+    played.push_back(m);
+  }
+  EXPECT_EQ(b.getAllMoves(), played);
+
+  GoState copy(b);
+  std::vector<Coord> moves = copy.getAllValidMoves();
+  ASSERT_FALSE(moves.empty());
+  EXPECT_TRUE(copy.forward(moves[0]));
+  EXPECT_EQ(b.getAllMoves(), played);
+  EXPECT_EQ(copy.getNumMoves(), played.size() + 1);
+  EXPECT_EQ(copy.getAllMoves().back(), moves[0]);
+
+  std::vector<Coord> since;
+  EXPECT_TRUE(copy.moves_since(b, &since));
+  EXPECT_EQ(since, std::vector<Coord>{moves[0]});
+  EXPECT_EQ(copy.getHistory().size(), (size_t)MAX_NUM_AGZ_HISTORY);
+  EXPECT_FALSE(boardEqual(b, copy));
+}
+
+// The history hash tells apart transpositions, which the network sees with
+// different histories, but not positions that only differ further back than
+// the history window.
+TEST(GoTest, testHistoryHashCode) {
+  auto play = [](const std::vector<Coord>& moves) {
+    GoState s;
+    for (Coord m : moves) {
+      EXPECT_TRUE(s.forward(m));
+    }
+    return s;
+  };
+  Coord a = OFFSETXY(2, 2), b = OFFSETXY(6, 6), c = OFFSETXY(2, 6),
+        d = OFFSETXY(6, 2);
+
+  GoState s1 = play({a, b, c, d});
+  GoState s2 = play({c, b, a, d});
+  EXPECT_EQ(s1.getHashCode(), s2.getHashCode());
+  EXPECT_NE(s1.getHistoryHashCode(), s2.getHistoryHashCode());
+  EXPECT_EQ(s1.getHistoryHashCode(), play({a, b, c, d}).getHistoryHashCode());
+
+  std::vector<Coord> tail;
+  for (int i = 0; i < MAX_NUM_AGZ_HISTORY; ++i) {
+    tail.push_back(OFFSETXY(4, i % 2 == 0 ? i / 2 : BOARD_SIZE - 1 - i / 2));
+  }
+  std::vector<Coord> m1 = {a, b, c, d}, m2 = {c, b, a, d};
+  m1.insert(m1.end(), tail.begin(), tail.end());
+  m2.insert(m2.end(), tail.begin(), tail.end());
+  EXPECT_EQ(play(m1).getHistoryHashCode(), play(m2).getHistoryHashCode());
+}
+
+TEST(GoTest, testHandicap) {
+  for (int handi = 2; handi <= 9; ++handi) {
+    GoState b;
+    b.applyHandicap(handi);
+    // All stones are distinct and on the board of the current size.
+    int num_black = 0;
+    for (int x = 0; x < BOARD_SIZE; ++x) {
+      for (int y = 0; y < BOARD_SIZE; ++y) {
+        if (b.board()._infos[OFFSETXY(x, y)].color == S_BLACK)
+          num_black++;
+      }
+    }
+    EXPECT_EQ(num_black, handi);
+  }
+}
+
 int main(int argc, char** argv) {
   testing::InitGoogleTest(&argc, argv);
 
@@ -0,0 +1,110 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "elfgames/go/base/go_state.h"
+#include "elfgames/go/base/superko.h"
+#include "elfgames/go/base/test/test_utils.h"
+
+class SuperkoState : public GoState {
+ public:
+  // Whether the position of other has been seen in this trajectory.
+  bool seen(const GoState& other) const {
+    SuperkoState tmp(*this);
+    copyBoard(&tmp._board, &other.board());
+    return tmp._check_superko();
+  }
+};
+
+TEST(SuperkoTest, testTable) {
+  SuperkoTable t;
+  std::mt19937_64 rng(0);
+  std::vector<std::pair<uint64_t, uint64_t>> keys;
+  for (int i = 0; i < 1000; ++i) {
+    keys.emplace_back(rng(), rng() | 1);
+    t.insert(keys.back().first, keys.back().second);
+  }
+  // Duplicates are not stored twice.
+  t.insert(keys[0].first, keys[0].second);
+  EXPECT_EQ(t.size(), keys.size());
+
+  for (const auto& k : keys) {
+    EXPECT_TRUE(t.containsKey(k.first));
+    EXPECT_TRUE(t.contains(k.first, k.second));
+    // Same Zobrist key, different position.
+    EXPECT_FALSE(t.contains(k.first, k.second ^ 2));
+    EXPECT_FALSE(t.containsKey(k.first ^ 2));
+  }
+}
+
+TEST(SuperkoTest, testTrajectory) {
+  std::mt19937 rng(0);
+  SuperkoState s;
+  std::vector<Coord> played;
+  // Long enough that the overlay is folded into the table at least once.
+  for (int i = 0; i < 100; ++i) {
+    std::vector<Coord> moves = s.getAllValidMoves();
+    if (moves.empty() || !s.forward(moves[rng() % moves.size()]))
+      break;
+    played.push_back(s.lastMove());
+  }
+  ASSERT_GT(played.size(), 70u);
+
+  GoState replay;
+  for (size_t i = 0; i + 1 < played.size(); ++i) {
+    replay.forward(played[i]);
+    EXPECT_TRUE(s.seen(replay));
+  }
+  // The current position has not been seen before.
+  EXPECT_FALSE(s.seen(s));
+  EXPECT_FALSE(s.terminated());
+}
+
+// The same stones played in another order give the same board, but after
+// other positions, hence other repetitions.
+TEST(SuperkoTest, testHashCode) {
+  const Coord a = getCoord(2, 2), b = getCoord(6, 6), c = getCoord(2, 6);
+  GoState s1, s2;
+  for (Coord m : {a, b, c})
+    ASSERT_TRUE(s1.forward(m));
+  for (Coord m : {c, b, a})
+    ASSERT_TRUE(s2.forward(m));
+  EXPECT_EQ(s1.getHashCode(), s2.getHashCode());
+  EXPECT_NE(s1.getSuperkoHashCode(), s2.getSuperkoHashCode());
+  EXPECT_EQ(GoState(s1).getSuperkoHashCode(), s1.getSuperkoHashCode());
+
+  // The same moves give the same hash, also once the positions are folded
+  // into a table.
+  std::mt19937 rng(0);
+  GoState s;
+  std::vector<Coord> played;
+  for (int i = 0; i < 100; ++i) {
+    std::vector<Coord> moves = s.getAllValidMoves();
+    if (moves.empty() || !s.forward(moves[rng() % moves.size()]))
+      break;
+    played.push_back(s.lastMove());
+  }
+  GoState replay;
+  for (Coord m : played)
+    ASSERT_TRUE(replay.forward(m));
+  EXPECT_EQ(replay.getSuperkoHashCode(), s.getSuperkoHashCode());
+  EXPECT_NE(replay.getSuperkoHashCode(), s1.getSuperkoHashCode());
+
+  replay.reset();
+  EXPECT_EQ(replay.getSuperkoHashCode(), GoState().getSuperkoHashCode());
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
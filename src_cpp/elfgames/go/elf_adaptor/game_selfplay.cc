@@ -19,7 +19,11 @@ GoGameSelfPlay::GoGameSelfPlay(
       game_stats_(game_stats),
       logger_(elf::logging::getLogger(
           "elfgames::go::GoGameSelfPlay-" + std::to_string(game_idx) + "-",
-          "")) {}
+          "")) {
+  if (options_.eval_cache_size > 0) {
+    GoEvalCache::get().setCapacity(options_.eval_cache_size);
+  }
+}
 
 MCTSGoAI* GoGameSelfPlay::init_ai(
     const std::string& actor_name,
@@ -42,6 +46,7 @@ MCTSGoAI* GoGameSelfPlay::init_ai(
   params.ply_pass_enabled = options_.ply_pass_enabled;
   params.komi = options_.common.komi;
   params.required_version = model_ver;
+  params.use_eval_cache = options_.eval_cache_size > 0;
 
   size_t batchsize = options_.common.base.batchsize;
 
@@ -53,6 +58,7 @@ MCTSGoAI* GoGameSelfPlay::init_ai(
   }
 
   elf::ai::tree_search::TSOptions opt = mcts_options;
+  opt.setHostFields(options_.common.mcts);
   if (puct_override > 0.0) {
     logger_->warn(
         "PUCT overridden: {} -> {}", opt.alg_opt.c_puct, puct_override);
@@ -169,6 +175,9 @@ StepStatus GoGameSelfPlay::finish_game(FinishReason reason, Record *r) {
 
   game_stats_.resetRankingIfNeeded(options_.num_reset_ranking);
   game_stats_.feedWinRate(_state_ext.state().getFinalValue());
+  if (options_.eval_cache_size > 0 && _state_ext.gameIdx() == 0) {
+    logger_->info("Eval cache: {}", GoEvalCache::get().info());
+  }
   // game_stats_.feedSgf(s.dumpSgf(""));
 
   // Report winrate (so that Python side could know).
@@ -26,6 +26,9 @@ void registerPy(pybind11::module& m) {
 
   m.def("get_elf_options", get_elf_options);
 
+  // Which build of the engine this is (see elfgames/go/engine.py).
+  m.attr("board_size") = BOARD_SIZE;
+
   py::class_<ClientWrapper>(m, "ClientWrapper")
       .def(py::init<const GameOptionsSelfPlay&>())
       .def("getParams", &ClientWrapper::getParams)
@@ -10,6 +10,11 @@
 
 #include "Pybind.h"
 
-PYBIND11_MODULE(_elfgames_go_inference, m) {
+// Builds for other board sizes set this to _elfgames_go_inference9, ...
+#ifndef ELFGAMES_GO_INFERENCE_MODULE
+#define ELFGAMES_GO_INFERENCE_MODULE _elfgames_go_inference
+#endif
+
+PYBIND11_MODULE(ELFGAMES_GO_INFERENCE_MODULE, m) {
   elfgames::go::registerPy(m);
 }
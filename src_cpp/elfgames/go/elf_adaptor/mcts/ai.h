@@ -8,6 +8,8 @@
 
 #pragma once
 
+#include <string.h>
+
 #include "elf/ai/ai.h"
 #include "elf/ai/tree_search/tree_search_base.h"
 
@@ -60,6 +62,41 @@ struct StateTrait<GoState, Coord> {
       std::vector<Coord>* moves) {
     return s.moves_since(s_ref, moves);
   }
+
+  // Transpositions happen at the same ply, which also keeps the search graph
+  // acyclic, and after the same positions (superko).
+  static uint64_t hash(const GoState& s) {
+    const Board& b = s.board();
+    Coord ko = getSimpleKoLocation(&b, nullptr);
+    uint64_t h = b._hash ^ ((uint64_t)b._ply << 48) ^ ((uint64_t)ko << 32) ^
+        (uint64_t)b._next_player ^ s.getSuperkoHashCode();
+    return h * 0x9E3779B97F4A7C15ULL;
+  }
+
+  // Same position (compared in full, not by hash), same player, ko and pass
+  // status, and the same positions seen before (by hash), so that the same
+  // continuations repeat one of them. Terminal states, in particular superko
+  // repetitions, are never shared, since their value depends on the path.
+  static bool transposes(const GoState& s1, const GoState& s2) {
+    const Board& b1 = s1.board();
+    const Board& b2 = s2.board();
+    Stone ko_color1 = S_EMPTY, ko_color2 = S_EMPTY;
+    if (b1._hash != b2._hash || b1._ply != b2._ply ||
+        b1._next_player != b2._next_player ||
+        getSimpleKoLocation(&b1, &ko_color1) !=
+            getSimpleKoLocation(&b2, &ko_color2) ||
+        ko_color1 != ko_color2 || b1._last_move != b2._last_move ||
+        s1.getSuperkoHashCode() != s2.getSuperkoHashCode()) {
+      return false;
+    }
+    if (b1._last_move == M_PASS && b1._last_move2 != b2._last_move2) {
+      return false;
+    }
+    if (s1.terminated() || s2.terminated()) {
+      return false;
+    }
+    return memcmp(b1._bits, b2._bits, sizeof(b1._bits)) == 0;
+  }
 };
 
 } // namespace tree_search
@@ -8,11 +8,26 @@
 
 #pragma once
 
+#include <atomic>
 #include <iostream>
+#include <memory>
 
+#include "elf/ai/tree_search/eval_cache.h"
 #include "elf/ai/tree_search/mcts.h"
+#include "elf/concurrency/ConcurrentQueue.h"
+#include "elf/concurrency/Fiber.h"
+#include "elf/concurrency/ParkingLot.h"
 #include "ai.h"
 
+// A network evaluation in board coordinates: the value, and the policy over
+// the legal moves (pass included) with probabilities quantized to 16 bits.
+struct GoEvalCacheEntry {
+  float value = 0;
+  std::vector<std::pair<Coord, uint16_t>> pi;
+};
+
+using GoEvalCache = elf::ai::tree_search::EvalCacheT<GoEvalCacheEntry>;
+
 struct MCTSActorParams {
   std::string actor_name;
   int ply_pass_enabled = 0;
@@ -27,13 +42,17 @@ struct MCTSActorParams {
 
   size_t sub_batchsize = 0;
 
+  // Share network evaluations through GoEvalCache::get().
+  bool use_eval_cache = false;
+
   std::string info() const {
     std::stringstream ss;
     ss << "[name=" << actor_name << "][ply_pass_enabled=" << ply_pass_enabled
        << "][seed=" << seed << "][requred_ver=" << required_version
        << "][remove_pass_if_dangerous=" << remove_pass_if_dangerous
        << "][rotation_flip=" << rotation_flip << "][komi=" << komi
-       << "][sub_batchsize=" << sub_batchsize << "]";
+       << "][sub_batchsize=" << sub_batchsize
+       << "][use_eval_cache=" << use_eval_cache << "]";
     return ss.str();
   }
 };
@@ -75,73 +94,98 @@ class MCTSActor {
     if (states.empty())
       return;
 
-    if (oo_ != nullptr)
-      *oo_ << "Evaluating batch state. #states: " << states.size() << std::endl;
-
-    std::vector<BoardFeature> sel_bfs;
-    std::vector<size_t> sel_indices;
-
-    // Make sure for each state, the callback is invoked once and only once.
-    std::vector<bool> visited(states.size(), false);
-
-    for (size_t i = 0; i < states.size(); i++) {
-      assert(states[i] != nullptr);
-      if (states[i]->terminated()) {
-        NodeResponse resp;
-        setTerminalValue(*states[i], &resp);
-        callback(i, std::move(resp));
-        assert(!visited[i]);
-        visited[i] = true;
-      } else {
-        sel_bfs.push_back(get_extractor(*states[i]));
-        sel_indices.push_back(i);
-      } 
-    }
-
-    if (sel_bfs.empty())
+    _Batch batch(std::move(callback));
+    if (!prepare_batch(states, &batch))
       return;
 
-    std::vector<GoReply> replies;
-    for (size_t i = 0; i < sel_bfs.size(); ++i) {
-      replies.emplace_back(sel_bfs[i]);
-      replies.back().idx = i;
-    }
-
-    // Get all pointers.
-    std::vector<GoReply*> p_replies;
-    std::vector<const BoardFeature*> p_bfs;
-
-    for (size_t i = 0; i < sel_bfs.size(); ++i) {
-      p_bfs.push_back(&sel_bfs[i]);
-      p_replies.push_back(&replies[i]);
-    }
-
     typename AI::BatchCtrl batch_ctrl;
     batch_ctrl.sub_batchsize = params_.sub_batchsize;
     batch_ctrl.action_cb = [&](size_t i, const GoReply &reply) {
-      size_t idx = sel_indices[i];
-      NodeResponse resp;
-      post_nn_result(reply, &resp);
-      if (reply.idx != i) {
-        std::cout << "reply idx " << reply.idx << " is not the same as i " << i << ", which has global idx: " << idx << std::endl;
-        assert(false);
-      }
-      // std::cout << "assign node: " << idx << ", #pi: " << resp.pi.size() << std::endl;
-      callback(idx, std::move(resp));
-      assert(!visited[idx]);
-      visited[idx] = true;
+      reply_batch(&batch, i, reply);
     };
 
     // cout << "About to send situation to " << params_.actor_name << endl;
     // cout << s.showBoard() << endl;
 
-    if (!ai_->act_batch(p_bfs, p_replies, batch_ctrl)) {
+    if (!ai_->act_batch(batch.p_bfs, batch.p_replies, batch_ctrl)) {
       std::cout << "act unsuccessful! " << std::endl;
     } else {
       // std::cout << "act successful! " << std::endl;
     }
 
-    for (const bool &b : visited) assert(b);
+    for (const bool &b : batch.visited) assert(b);
+  }
+
+  // Same as above, but the batch is sent by a fiber of the process-wide
+  // FiberPool, and evaluate_async returns at once. The callback runs in
+  // poll_evaluations(), on the calling thread. Waiting for the reply only
+  // suspends the fiber, so batches in flight hold no thread.
+  void evaluate_async(
+      const std::vector<const GoState*>& states,
+      std::function<void (size_t, NodeResponse &&)> callback) {
+    if (states.empty())
+      return;
+
+    std::unique_ptr<_Batch> batch(new _Batch(std::move(callback)));
+    if (!prepare_batch(states, batch.get()))
+      return;
+
+    numInflight_++;
+    _Batch* b = batch.release();
+    elf::concurrency::FiberPool::get().spawn([this, b, sent = sent_]() {
+      send(b);
+      // The actor may be gone once the batch is in.
+      sent->batches.push(b);
+      sent->num++;
+      elf::concurrency::ParkingLot::unpark(sent.get());
+    });
+  }
+
+  // Run the callbacks of the batches that came back. If block is true, wait
+  // for one if none has.
+  void poll_evaluations(bool block) {
+    _Batch* b = nullptr;
+    while (numInflight_ > 0) {
+      if (block) {
+        sent_->batches.pop(&b);
+        block = false;
+      } else if (!sent_->batches.pop(&b, std::chrono::microseconds(0))) {
+        return;
+      }
+      std::unique_ptr<_Batch> batch(b);
+      numInflight_--;
+      sent_->num--;
+      if (batch->ok) {
+        for (size_t i = 0; i < batch->replies.size(); ++i) {
+          reply_batch(batch.get(), i, batch->replies[i]);
+        }
+      } else {
+        // The search waits for every state of the batch: reply with nothing.
+        std::cout << "act unsuccessful! " << std::endl;
+        for (size_t idx : batch->indices) {
+          batch->callback(idx, NodeResponse());
+        }
+      }
+    }
+  }
+
+  // Call wake() once a batch of evaluate_async() has come back (from its
+  // fiber), or right away if one has. Never blocks.
+  void on_evaluations(std::function<void()> wake) {
+    elf::concurrency::ParkingLot::parkAsync(
+        sent_.get(),
+        [sent = sent_]() { return sent->num > 0; },
+        std::move(wake));
+  }
+
+  ~MCTSActor() {
+    // The fibers refer to the actor: wait for the batches still in flight.
+    _Batch* b = nullptr;
+    while (numInflight_ > 0) {
+      sent_->batches.pop(&b);
+      delete b;
+      numInflight_--;
+    }
   }
 
   void evaluate(const GoState& s, NodeResponse* resp) {
@@ -152,6 +196,9 @@ class MCTSActor {
     // else res = EVAL_NEED_NN
     if (!s.terminated()) {
       BoardFeature bf = get_extractor(s);
+      if (lookup_cache(bf, resp)) {
+        return;
+      }
       // GoReply struct initialization
       // members containing:
       // Coord c, vector<float> pi, float v;
@@ -190,11 +237,101 @@ class MCTSActor {
   }
 
  protected:
+  // States of a batch that go to the network.
+  struct _Batch {
+    std::function<void (size_t, NodeResponse &&)> callback;
+    std::vector<BoardFeature> bfs;
+    std::vector<size_t> indices;
+    std::vector<GoReply> replies;
+    std::vector<const BoardFeature*> p_bfs;
+    std::vector<GoReply*> p_replies;
+    // Make sure for each state, the callback is invoked once and only once.
+    std::vector<bool> visited;
+    bool ok = false;
+
+    explicit _Batch(std::function<void (size_t, NodeResponse &&)> cb)
+        : callback(std::move(cb)) {}
+  };
+
   MCTSActorParams params_;
   std::unique_ptr<AI> ai_;
   std::ostream* oo_ = nullptr;
   std::mt19937 rng_;
 
+  // Batches of evaluate_async() that came back, shared with the fibers.
+  struct _Sent {
+    // Polled by whichever thread runs the search (any worker of the search
+    // pool), hence several consumers.
+    elf::concurrency::ConcurrentQueueMoodyCamelNoCheck<_Batch*> batches;
+    // Batches in the queue.
+    std::atomic<int> num{0};
+  };
+  std::shared_ptr<_Sent> sent_ = std::make_shared<_Sent>();
+  size_t numInflight_ = 0;
+
+  // Reply to the terminal and cached states right away, and set up the others
+  // to be sent. Returns whether there are any.
+  bool prepare_batch(const std::vector<const GoState*>& states, _Batch* batch) {
+    if (oo_ != nullptr)
+      *oo_ << "Evaluating batch state. #states: " << states.size() << std::endl;
+
+    batch->visited.resize(states.size(), false);
+    for (size_t i = 0; i < states.size(); i++) {
+      assert(states[i] != nullptr);
+      NodeResponse resp;
+      if (states[i]->terminated()) {
+        setTerminalValue(*states[i], &resp);
+      } else {
+        BoardFeature bf = get_extractor(*states[i]);
+        if (!lookup_cache(bf, &resp)) {
+          batch->bfs.push_back(bf);
+          batch->indices.push_back(i);
+          continue;
+        }
+      }
+      batch->callback(i, std::move(resp));
+      assert(!batch->visited[i]);
+      batch->visited[i] = true;
+    }
+
+    if (batch->bfs.empty())
+      return false;
+
+    // Replies refer to the features: set up once they no longer move.
+    for (size_t i = 0; i < batch->bfs.size(); ++i) {
+      batch->replies.emplace_back(batch->bfs[i]);
+      batch->replies.back().idx = i;
+    }
+    for (size_t i = 0; i < batch->bfs.size(); ++i) {
+      batch->p_bfs.push_back(&batch->bfs[i]);
+      batch->p_replies.push_back(&batch->replies[i]);
+    }
+    return true;
+  }
+
+  void reply_batch(_Batch* batch, size_t i, const GoReply& reply) {
+    size_t idx = batch->indices[i];
+    NodeResponse resp;
+    post_nn_result(reply, &resp);
+    if (reply.idx != i) {
+      std::cout << "reply idx " << reply.idx << " is not the same as i " << i << ", which has global idx: " << idx << std::endl;
+      assert(false);
+    }
+    // std::cout << "assign node: " << idx << ", #pi: " << resp.pi.size() << std::endl;
+    batch->callback(idx, std::move(resp));
+    assert(!batch->visited[idx]);
+    batch->visited[idx] = true;
+  }
+
+  // Runs in a fiber: the replies are only filled here, and handled by the
+  // thread that polls.
+  void send(_Batch* batch) {
+    typename AI::BatchCtrl batch_ctrl;
+    batch_ctrl.sub_batchsize = params_.sub_batchsize;
+    batch_ctrl.action_cb = [](size_t, const GoReply &) {};
+    batch->ok = ai_->act_batch(batch->p_bfs, batch->p_replies, batch_ctrl);
+  }
+
   BoardFeature get_extractor(const GoState& s) {
     // RandomShuffle: static
     // All extractor will go through a
@@ -245,14 +382,89 @@ class MCTSActor {
       throw std::runtime_error(ss.str());
     }
 
+    if (params_.use_eval_cache) {
+      // Hits and misses go through the same (quantized) entry, so that the
+      // search sees the same policy either way.
+      GoEvalCacheEntry entry;
+      compress_nn_result(reply, &entry);
+      GoEvalCache::get().insert(cache_key(reply.bf), reply.version, entry);
+      cache2response(s, entry, resp);
+      return;
+    }
+
     resp->q_flip = s.nextPlayer() == S_WHITE;
     resp->value = reply.value;
 
+    pi2response(reply.bf, reply.pi, is_pass_enabled(s), &resp->pi, oo_);
+    resp->normalize();
+  }
+
+  bool is_pass_enabled(const GoState& s) {
     bool pass_enabled = s.getPly() >= params_.ply_pass_enabled;
     if (params_.remove_pass_if_dangerous) {
       remove_pass_if_dangerous(s, &pass_enabled);
     }
-    pi2response(reply.bf, reply.pi, pass_enabled, &resp->pi, oo_);
+    return pass_enabled;
+  }
+
+  // Entries are in board coordinates (see compress_nn_result), so the
+  // evaluation of a position under any symmetry serves all the others.
+  static uint64_t cache_key(const BoardFeature& bf) {
+    return bf.state().getHistoryHashCode();
+  }
+
+  bool lookup_cache(const BoardFeature& bf, NodeResponse* resp) {
+    if (!params_.use_eval_cache) {
+      return false;
+    }
+    GoEvalCacheEntry entry;
+    if (!GoEvalCache::get().lookup(
+            cache_key(bf), params_.required_version, &entry)) {
+      return false;
+    }
+    if (oo_ != nullptr)
+      *oo_ << "Got information from the evaluation cache" << std::endl;
+    cache2response(bf.state(), entry, resp);
+    return true;
+  }
+
+  static void compress_nn_result(
+      const GoReply& reply,
+      GoEvalCacheEntry* entry) {
+    const GoState& s = reply.bf.state();
+    BitBoard legal;
+    getLegalMoveBits(&s.board(), s.nextPlayer(), &legal);
+
+    entry->value = reply.value;
+    entry->pi.clear();
+    for (size_t i = 0; i < reply.pi.size(); ++i) {
+      Coord m = reply.bf.action2Coord(i);
+      if (m == M_PASS || bbTest(&legal, m)) {
+        float p = std::min(std::max(reply.pi[i], 0.0f), 1.0f);
+        entry->pi.emplace_back(m, (uint16_t)(p * 65535 + 0.5));
+      }
+    }
+  }
+
+  // Same as pi2response, from a cache entry.
+  void cache2response(
+      const GoState& s,
+      const GoEvalCacheEntry& entry,
+      NodeResponse* resp) {
+    resp->q_flip = s.nextPlayer() == S_WHITE;
+    resp->value = entry.value;
+
+    auto& output_pi = resp->pi;
+    output_pi.clear();
+    bool pass_enabled = is_pass_enabled(s);
+    output_pi.reserve(entry.pi.size());
+    for (const auto& p : entry.pi) {
+      if (p.first != M_PASS || pass_enabled)
+        output_pi.add(p.first, p.second / 65535.0f);
+    }
+    if (output_pi.empty() && !pass_enabled) {
+      output_pi.add(M_PASS, 1.0);
+    }
     resp->normalize();
   }
 
@@ -272,7 +484,7 @@ class MCTSActor {
       const BoardFeature& bf,
       const std::vector<float>& pi,
       bool pass_enabled,
-      std::unordered_map<Coord, EdgeInfo>* p_output_pi,
+      elf::ai::tree_search::EdgeArrayT<Coord>* p_output_pi,
       std::ostream* oo = nullptr) {
     const GoState& s = bf.state();
 
@@ -291,29 +503,24 @@ class MCTSActor {
       return;
     }
 
+    // Legal moves of the player to move, computed once for the whole board
+    // instead of a TryPlay per action.
+    BitBoard legal;
+    getLegalMoveBits(&s.board(), s.nextPlayer(), &legal);
+
+    // Single sweep over the policy: map each action back through the random
+    // transform and keep it if it is legal.
+    output_pi.reserve(pi.size());
     for (size_t i = 0; i < pi.size(); ++i) {
       // Inv random transform will be applied
       Coord m = bf.action2Coord(i);
-      if (oo != nullptr)
-        *oo << "  Action " << i << " to Coord "
-            << elf::ai::tree_search::ActionTrait<Coord>::to_string(m)
-            << std::endl;
-      output_pi.emplace(m, EdgeInfo(pi[i]));
-    }
-    // sorting..
-    std::unordered_map<Coord, EdgeInfo> tmp;
-
-    for (const auto& v : output_pi) {
-      // Check whether this move is right.
-      bool valid = (v.first == M_PASS && pass_enabled) ||
-          (v.first != M_PASS && s.checkMove(v.first));
-      if (valid) {
-        tmp.insert(v);
-      }
+      bool valid = m == M_PASS ? pass_enabled : bbTest(&legal, m);
+      if (valid)
+        output_pi.add(m, pi[i]);
 
       if (oo != nullptr) {
-        *oo << "Predict [" << coord2str(v.first) << "][" << coord2str2(v.first)
-            << "][" << v.first << "] " << v.second.prior_probability;
+        *oo << "Predict [" << coord2str(m) << "][" << coord2str2(m) << "]["
+            << m << "] " << pi[i];
         if (valid)
           *oo << " added" << std::endl;
         else
@@ -321,11 +528,10 @@ class MCTSActor {
       }
     }
 
-    if (tmp.empty() && !pass_enabled) {
+    if (output_pi.empty() && !pass_enabled) {
       // Add pass if there is no valid move.
-      tmp.emplace(M_PASS, EdgeInfo(1.0));
+      output_pi.add(M_PASS, 1.0);
     }
-    output_pi = tmp;
     if (oo != nullptr)
       *oo << "#Valid move: " << output_pi.size() << std::endl;
   }
@@ -76,6 +76,9 @@ void registerPy(pybind11::module& m) {
   m.def("getServerOpt", getServerOpt);
   m.def("getClientOpt", getClientOpt);
 
+  // Which build of the engine this is (see elfgames/go/engine.py).
+  m.attr("board_size") = BOARD_SIZE;
+
   py::class_<ServerWrapper>(m, "ServerWrapper")
       .def(py::init<const GameOptionsTrain&>())
       .def("getParams", &ServerWrapper::getParams)
@@ -10,6 +10,11 @@
 
 #include "Pybind.h"
 
-PYBIND11_MODULE(_elfgames_go, m) {
+// Builds for other board sizes set this to _elfgames_go9, _elfgames_go13, ...
+#ifndef ELFGAMES_GO_MODULE
+#define ELFGAMES_GO_MODULE _elfgames_go
+#endif
+
+PYBIND11_MODULE(ELFGAMES_GO_MODULE, m) {
   elfgames::go::registerPy(m);
 }
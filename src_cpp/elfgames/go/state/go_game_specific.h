@@ -65,6 +65,12 @@ DEF_FIELD(int, preload_sgf_move_to, -1, "Starting ply for preloaded SGF file");
 
 DEF_FIELD(int, ply_pass_enabled, 0, "Allow pass after >= ply");
 
+DEF_FIELD(
+    int,
+    eval_cache_size,
+    0,
+    "#Network evaluations cached, shared by all games. 0 disables the cache");
+
 // Second puct used for ai2, if -1 then use the same puct.
 DEF_FIELD(
     float,
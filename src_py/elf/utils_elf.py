@@ -106,8 +106,17 @@ class Allocator(object):
 
             smem_opts = elf.SharedMemOptions(name, this_batchsize)
             smem_opts.setTimeout(v.get("timeout_usec", 0))
-
-            for _ in range(num_recv):
+            # Batches each collector keeps in flight.
+            num_slot = v.get("num_slot", 1)
+            smem_opts.setNumSlot(num_slot)
+            # Let the collectors tune how long they wait for a batch.
+            if v.get("latency_slo_usec", 0) > 0:
+                smem_opts.setBatchTarget(
+                    elf.LATENCY_SLO, v["latency_slo_usec"])
+            elif v.get("adaptive_batch", False):
+                smem_opts.setBatchTarget(elf.MAX_THROUGHPUT)
+
+            for _ in range(num_recv * num_slot):
                 smem = GC.allocateSharedMem(smem_opts, keys)
                 spec_local = dict()
                 for field in keys:
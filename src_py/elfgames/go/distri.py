@@ -13,7 +13,9 @@ from elf import GCWrapper, MoreLabels
 from elf.options import auto_import_options, PyOptionSpec
 
 import _elf as elf
-import _elfgames_go as go
+from elfgames.go.engine import import_go
+
+go = import_go()
 
 
 class Loader(object):
@@ -0,0 +1,41 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+
+# Copyright (c) 2018-present, Facebook, Inc.
+# All rights reserved.
+#
+# This source code is licensed under the BSD-style license found in the
+# LICENSE file in the root directory of this source tree.
+
+import importlib
+import os
+
+
+def import_go(board_size=None, module="_elfgames_go"):
+    ''' Import the Go engine built for board_size.
+
+    The board size is fixed when the engine is built: module (_elfgames_go,
+    or _elfgames_go_inference) has the size of GO_BOARD_SIZE (19 by
+    default), and each size of GO_EXTRA_BOARD_SIZES has its own module
+    <module><size>. So a process runs games of a single size. board_size
+    defaults to the board_size environment variable (set from BOARD_SIZE by
+    the scripts in scripts/elfgames/go); if neither is set, the default
+    module is used.
+    '''
+    if board_size is None:
+        board_size = os.environ.get("board_size")
+    if not board_size:
+        return importlib.import_module(module)
+
+    board_size = int(board_size)
+    try:
+        return importlib.import_module("%s%d" % (module, board_size))
+    except ImportError:
+        go = importlib.import_module(module)
+        if go.board_size != board_size:
+            raise ImportError(
+                "No Go engine for %dx%d boards (%s is %dx%d); "
+                "build with -DGO_EXTRA_BOARD_SIZES=%d" %
+                (board_size, board_size, module, go.board_size,
+                 go.board_size, board_size))
+        return go